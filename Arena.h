@@ -0,0 +1,206 @@
+#ifndef SMPL_ARENA_H
+#define SMPL_ARENA_H
+
+#include <new>
+#include <utility>
+#include <cstddef>
+#include <cstdlib>
+#include <cassert>
+
+namespace smpl
+{
+    /**
+     * Арена памяти движка: выделение сдвигом указателя внутри крупных блоков
+     * и списки свободных ячеек для небольших объектов фиксированного размера
+     * (узлы деревьев, элементы списков). Память возвращается целиком вызовом release
+     */
+    class Arena {
+    private:
+        /** Ячейки выделяются классами размеров, кратными Granularity */
+        static const size_t Granularity = 16;
+        static const size_t SizeClasses = 32;
+
+        struct Chunk {
+            Chunk *next;
+            size_t size;
+        };
+
+        struct FreeCell {
+            FreeCell *next;
+        };
+
+        Chunk *chunks;
+        char *current;
+        char *end;
+        size_t chunkSize;
+        FreeCell *freeCells[SizeClasses];
+        size_t used;
+
+        Arena(const Arena &);
+        Arena &operator=(const Arena &);
+
+        static size_t headerSize() {
+            return (sizeof(Chunk) + Granularity - 1) / Granularity * Granularity;
+        }
+
+        void addChunk(size_t minSize) {
+            size_t size = chunkSize;
+            while (size < minSize + headerSize())
+                size *= 2;
+            Chunk *c = static_cast<Chunk *>(std::malloc(size));
+            if (c == NULL)
+                throw std::bad_alloc();
+            c->next = chunks;
+            c->size = size;
+            chunks = c;
+            current = reinterpret_cast<char *>(c) + headerSize();
+            end = reinterpret_cast<char *>(c) + size;
+        }
+
+    public:
+        /** Наибольший размер ячейки, обслуживаемый списками свободных ячеек */
+        static const size_t MaxCell = Granularity * SizeClasses;
+
+        explicit Arena(size_t chunkSize = 64 * 1024)
+                : chunks(NULL), current(NULL), end(NULL), chunkSize(chunkSize), used(0) {
+            for (size_t i = 0; i < SizeClasses; i++) {
+                freeCells[i] = NULL;
+            }
+        }
+
+        ~Arena() {
+            while (chunks != NULL) {
+                Chunk *next = chunks->next;
+                std::free(chunks);
+                chunks = next;
+            }
+        }
+
+        /**
+         * Выделение памяти, освобождаемой только вместе со всей ареной
+         */
+        void *allocate(size_t size, size_t align = Granularity) {
+            assert(align <= Granularity && (align & (align - 1)) == 0);
+            size = (size + Granularity - 1) / Granularity * Granularity;
+            if (current == NULL || (size_t)(end - current) < size)
+                addChunk(size);
+            void *p = current;
+            current += size;
+            used += size;
+            return p;
+        }
+
+        /**
+         * Выделение ячейки с возможностью повторного использования после deallocateCell
+         */
+        void *allocateCell(size_t size) {
+            assert(size > 0 && size <= MaxCell);
+            size_t cls = (size - 1) / Granularity;
+            if (freeCells[cls] != NULL) {
+                FreeCell *cell = freeCells[cls];
+                freeCells[cls] = cell->next;
+                return cell;
+            }
+            return allocate((cls + 1) * Granularity);
+        }
+
+        void deallocateCell(void *p, size_t size) {
+            assert(size > 0 && size <= MaxCell);
+            size_t cls = (size - 1) / Granularity;
+            FreeCell *cell = static_cast<FreeCell *>(p);
+            cell->next = freeCells[cls];
+            freeCells[cls] = cell;
+        }
+
+        /**
+         * Создание объекта в арене. Деструктор вызывается владельцем явно
+         */
+        template<typename T, typename... Args>
+        T *create(Args&&... args) {
+            return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+        }
+
+        /**
+         * Освобождение всей памяти арены. Самый большой блок сохраняется для повторного использования,
+         * поэтому следующий прогон обычно не обращается к системному распределителю
+         */
+        void release() {
+            Chunk *keep = chunks;
+            for (Chunk *c = chunks; c != NULL; c = c->next) {
+                if (c->size > keep->size)
+                    keep = c;
+            }
+            while (chunks != NULL) {
+                Chunk *next = chunks->next;
+                if (chunks != keep)
+                    std::free(chunks);
+                chunks = next;
+            }
+            chunks = keep;
+            if (keep != NULL) {
+                keep->next = NULL;
+                current = reinterpret_cast<char *>(keep) + headerSize();
+                end = reinterpret_cast<char *>(keep) + keep->size;
+            } else {
+                current = end = NULL;
+            }
+            for (size_t i = 0; i < SizeClasses; i++) {
+                freeCells[i] = NULL;
+            }
+            used = 0;
+        }
+
+        /**
+         * Объем памяти, выделенной с момента последнего release
+         */
+        size_t usedBytes() const {
+            return used;
+        }
+    };
+
+    /**
+     * Распределитель для контейнеров стандартной библиотеки, берущий память из арены.
+     * Небольшие блоки (узлы деревьев и списков) повторно используются через списки свободных ячеек,
+     * крупные (буферы векторов) выделяются обычным образом
+     */
+    template<typename T>
+    class PoolAllocator {
+    public:
+        typedef T value_type;
+
+        Arena *arena;
+
+        explicit PoolAllocator(Arena *arena) : arena(arena) {}
+
+        template<typename U>
+        PoolAllocator(const PoolAllocator<U> &other) : arena(other.arena) {}
+
+        T *allocate(size_t n) {
+            size_t size = n * sizeof(T);
+            if (size <= Arena::MaxCell && alignof(T) <= 16)
+                return static_cast<T *>(arena->allocateCell(size));
+            return static_cast<T *>(::operator new(size));
+        }
+
+        void deallocate(T *p, size_t n) {
+            size_t size = n * sizeof(T);
+            if (size <= Arena::MaxCell && alignof(T) <= 16) {
+                arena->deallocateCell(p, size);
+            } else {
+                ::operator delete(p);
+            }
+        }
+
+        template<typename U>
+        bool operator==(const PoolAllocator<U> &other) const {
+            return arena == other.arena;
+        }
+
+        template<typename U>
+        bool operator!=(const PoolAllocator<U> &other) const {
+            return arena != other.arena;
+        }
+    };
+}
+
+#endif //SMPL_ARENA_H
@@ -0,0 +1,145 @@
+#ifndef SMPL_CONDITION_H
+#define SMPL_CONDITION_H
+
+#include <vector>
+#include <utility>
+#include <cstddef>
+#include <cassert>
+
+namespace smpl
+{
+    typedef unsigned int uint;
+    typedef unsigned long long u64;
+    typedef u64 transact_t;
+
+    class Engine;
+
+    /**
+     * Величина движка, от которой зависит условие ожидания
+     */
+    enum WaitSource {
+        /** Занятость устройства: 1 - занято, 0 - свободно */
+        WaitDevice,
+        /** Длина очереди */
+        WaitQueue,
+        /** Число свободных единиц накопителя */
+        WaitStorage,
+        /** Значение переменной (createVariable) */
+        WaitVariable,
+        WaitSourcesEnd
+    };
+
+    enum WaitCompare {
+        WaitLess,
+        WaitLessEqual,
+        WaitEqual,
+        WaitNotEqual,
+        WaitGreaterEqual,
+        WaitGreater
+    };
+
+    /**
+     * Условие ожидания (WAIT UNTIL): конъюнкция сравнений величин движка с константами и, возможно,
+     * функция пользователя. Входы условия - величины сравнений и величины, перечисленные в on; движок
+     * перепроверяет условие только при изменении одного из входов
+     */
+    class Condition {
+    public:
+        struct Term {
+            WaitSource source;
+            uint index;
+            WaitCompare compare;
+            double value;
+        };
+
+        /**
+         * Функция пользователя только читает состояние: она вызывается движком во время просмотра индекса
+         * ожидающих, и изменение величин (setVariable, занятие устройства, планирование событий) из нее
+         * недопустимо
+         */
+        typedef bool (*Predicate)(Engine *engine, transact_t transactId);
+
+        std::vector<Term> terms;
+        /** Функция пользователя, проверяется после сравнений; NULL - нет */
+        Predicate predicate;
+        /** Входы функции пользователя */
+        std::vector<std::pair<WaitSource, uint> > inputs;
+
+        Condition() : predicate(NULL) {}
+
+        Condition(WaitSource source, uint index, WaitCompare compare, double value) : predicate(NULL) {
+            Term t = {source, index, compare, value};
+            terms.push_back(t);
+        }
+
+        static Condition deviceFree(uint device) {
+            return Condition(WaitDevice, device, WaitEqual, 0);
+        }
+
+        static Condition queueLength(uint queue, WaitCompare compare, double value) {
+            return Condition(WaitQueue, queue, compare, value);
+        }
+
+        static Condition queueNotEmpty(uint queue) {
+            return Condition(WaitQueue, queue, WaitGreater, 0);
+        }
+
+        static Condition storageAvailable(uint storage, uint units = 1) {
+            return Condition(WaitStorage, storage, WaitGreaterEqual, units);
+        }
+
+        static Condition variable(uint id, WaitCompare compare, double value) {
+            return Condition(WaitVariable, id, compare, value);
+        }
+
+        /**
+         * Условие, заданное функцией; входы перечисляются вызовами on
+         */
+        static Condition custom(Predicate predicate) {
+            Condition c;
+            c.predicate = predicate;
+            return c;
+        }
+
+        /**
+         * Добавление входа функции пользователя
+         */
+        Condition &on(WaitSource source, uint index) {
+            inputs.push_back(std::make_pair(source, index));
+            return *this;
+        }
+
+        /**
+         * Конъюнкция условий; у результата может быть только одна функция пользователя
+         */
+        Condition operator&&(const Condition &other) const {
+            assert(predicate == NULL || other.predicate == NULL);
+            Condition c(*this);
+            c.terms.insert(c.terms.end(), other.terms.begin(), other.terms.end());
+            c.inputs.insert(c.inputs.end(), other.inputs.begin(), other.inputs.end());
+            if (c.predicate == NULL)
+                c.predicate = other.predicate;
+            return c;
+        }
+
+        static bool compare(double left, WaitCompare compare, double right) {
+            switch (compare) {
+                case WaitLess:
+                    return left < right;
+                case WaitLessEqual:
+                    return left <= right;
+                case WaitEqual:
+                    return left == right;
+                case WaitNotEqual:
+                    return left != right;
+                case WaitGreaterEqual:
+                    return left >= right;
+                case WaitGreater:
+                    return left > right;
+            }
+            return false;
+        }
+    };
+}
+
+#endif //SMPL_CONDITION_H
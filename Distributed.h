@@ -0,0 +1,283 @@
+#ifndef PROJECT_DISTRIBUTED_H
+#define PROJECT_DISTRIBUTED_H
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+#include <stdexcept>
+
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+namespace multiSMPL {
+
+    /**
+     * Двоичная запись сообщения: числа в порядке байтов машины (координатор и рабочие процессы
+     * предполагаются на одной архитектуре), строки и массивы предваряются длиной
+     */
+    class WireWriter {
+    private:
+        std::string data;
+
+        void raw(const void *p, size_t size) {
+            data.append(static_cast<const char *>(p), size);
+        }
+
+    public:
+        void u8(unsigned char x) {
+            raw(&x, sizeof(x));
+        }
+
+        void i32(int x) {
+            int32_t v = x;
+            raw(&v, sizeof(v));
+        }
+
+        void i64(long long x) {
+            int64_t v = x;
+            raw(&v, sizeof(v));
+        }
+
+        void f64(double x) {
+            raw(&x, sizeof(x));
+        }
+
+        void string(const std::string &s) {
+            i32((int)s.size());
+            raw(s.data(), s.size());
+        }
+
+        void doubles(const std::vector<double> &v) {
+            i32((int)v.size());
+            raw(v.data(), v.size() * sizeof(double));
+        }
+
+        const std::string &buffer() const {
+            return data;
+        }
+    };
+
+    /**
+     * Чтение сообщения WireWriter. При выходе за границу сообщения чтение возвращает нули,
+     * а ok() - false
+     */
+    class WireReader {
+    private:
+        const char *p;
+        const char *end;
+        bool valid;
+
+        bool raw(void *out, size_t size) {
+            if (!valid || (size_t)(end - p) < size) {
+                valid = false;
+                memset(out, 0, size);
+                return false;
+            }
+            memcpy(out, p, size);
+            p += size;
+            return true;
+        }
+
+    public:
+        explicit WireReader(const std::string &message)
+                : p(message.data()), end(message.data() + message.size()), valid(true) {}
+
+        unsigned char u8() {
+            unsigned char x;
+            raw(&x, sizeof(x));
+            return x;
+        }
+
+        int i32() {
+            int32_t x;
+            raw(&x, sizeof(x));
+            return x;
+        }
+
+        long long i64() {
+            int64_t x;
+            raw(&x, sizeof(x));
+            return x;
+        }
+
+        double f64() {
+            double x;
+            raw(&x, sizeof(x));
+            return x;
+        }
+
+        std::string string() {
+            int n = i32();
+            if (n < 0 || (size_t)(end - p) < (size_t)n) {
+                valid = false;
+                return std::string();
+            }
+            std::string s(p, n);
+            p += n;
+            return s;
+        }
+
+        void doubles(std::vector<double> &v) {
+            int n = i32();
+            if (n < 0 || (size_t)(end - p) < (size_t)n * sizeof(double)) {
+                valid = false;
+                v.clear();
+                return;
+            }
+            v.resize(n);
+            raw(v.data(), n * sizeof(double));
+        }
+
+        bool ok() const {
+            return valid;
+        }
+    };
+
+    /**
+     * TCP-соединения координатора и рабочих процессов. Сообщение (кадр) - u32 длина и содержимое
+     */
+    namespace net {
+        /** Наибольшая длина кадра, более длинный считается ошибкой протокола */
+        const size_t MaxFrame = 1u << 30;
+
+        /**
+         * Прослушивание порта на всех адресах
+         * @param port Номер порта, 0 - выбрать свободный; на выходе - выбранный номер
+         * @return Дескриптор сокета
+         */
+        inline int listenTCP(int &port) {
+            int fd = socket(AF_INET6, SOCK_STREAM, 0);
+            bool v6 = fd >= 0;
+            if (!v6)
+                fd = socket(AF_INET, SOCK_STREAM, 0);
+            if (fd < 0)
+                throw std::runtime_error("Не удалось создать сокет");
+            int one = 1, zero = 0;
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+            int result;
+            if (v6) {
+                setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &zero, sizeof(zero));
+                sockaddr_in6 addr;
+                memset(&addr, 0, sizeof(addr));
+                addr.sin6_family = AF_INET6;
+                addr.sin6_addr = in6addr_any;
+                addr.sin6_port = htons((uint16_t)port);
+                result = bind(fd, (sockaddr *)&addr, sizeof(addr));
+            } else {
+                sockaddr_in addr;
+                memset(&addr, 0, sizeof(addr));
+                addr.sin_family = AF_INET;
+                addr.sin_addr.s_addr = htonl(INADDR_ANY);
+                addr.sin_port = htons((uint16_t)port);
+                result = bind(fd, (sockaddr *)&addr, sizeof(addr));
+            }
+            if (result != 0 || listen(fd, 64) != 0) {
+                close(fd);
+                throw std::runtime_error("Не удалось открыть порт " + std::to_string(port));
+            }
+
+            sockaddr_storage bound;
+            socklen_t length = sizeof(bound);
+            getsockname(fd, (sockaddr *)&bound, &length);
+            port = bound.ss_family == AF_INET6 ? ntohs(((sockaddr_in6 *)&bound)->sin6_port)
+                                               : ntohs(((sockaddr_in *)&bound)->sin_port);
+            return fd;
+        }
+
+        /**
+         * Подключение к host:port
+         * @return Дескриптор сокета, -1 - подключиться не удалось
+         */
+        inline int connectTCP(const std::string &host, int port) {
+            addrinfo hints, *list = nullptr;
+            memset(&hints, 0, sizeof(hints));
+            hints.ai_family = AF_UNSPEC;
+            hints.ai_socktype = SOCK_STREAM;
+            if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &list) != 0)
+                return -1;
+            int fd = -1;
+            for (addrinfo *a = list; a != nullptr; a = a->ai_next) {
+                fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+                if (fd < 0)
+                    continue;
+                if (connect(fd, a->ai_addr, a->ai_addrlen) == 0)
+                    break;
+                close(fd);
+                fd = -1;
+            }
+            freeaddrinfo(list);
+            if (fd >= 0) {
+                int one = 1;
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            }
+            return fd;
+        }
+
+        inline bool sendAll(int fd, const char *data, size_t size) {
+            while (size > 0) {
+                ssize_t n = send(fd, data, size, MSG_NOSIGNAL);
+                if (n <= 0)
+                    return false;
+                data += n;
+                size -= (size_t)n;
+            }
+            return true;
+        }
+
+        inline bool sendFrame(int fd, const std::string &payload) {
+            uint32_t length = (uint32_t)payload.size();
+            return sendAll(fd, reinterpret_cast<const char *>(&length), sizeof(length)) &&
+                   sendAll(fd, payload.data(), payload.size());
+        }
+
+        /**
+         * Блокирующее чтение кадра
+         */
+        inline bool readFrame(int fd, std::string &payload) {
+            uint32_t length;
+            char *p = reinterpret_cast<char *>(&length);
+            for (size_t got = 0; got < sizeof(length);) {
+                ssize_t n = recv(fd, p + got, sizeof(length) - got, 0);
+                if (n <= 0)
+                    return false;
+                got += (size_t)n;
+            }
+            if (length > MaxFrame)
+                return false;
+            payload.resize(length);
+            for (size_t got = 0; got < length;) {
+                ssize_t n = recv(fd, &payload[got], length - got, 0);
+                if (n <= 0)
+                    return false;
+                got += (size_t)n;
+            }
+            return true;
+        }
+
+        /**
+         * Извлечение очередного полного кадра из накопленных входных данных
+         * @param invalid Устанавливается при недопустимой длине кадра
+         * @return false - кадр еще не получен целиком или недопустим
+         */
+        inline bool takeFrame(std::string &buffer, std::string &payload, bool &invalid) {
+            uint32_t length;
+            if (buffer.size() < sizeof(length))
+                return false;
+            memcpy(&length, buffer.data(), sizeof(length));
+            invalid = length > MaxFrame;
+            if (invalid || buffer.size() < sizeof(length) + length)
+                return false;
+            payload.assign(buffer, sizeof(length), length);
+            buffer.erase(0, sizeof(length) + length);
+            return true;
+        }
+    }
+}
+
+#endif //PROJECT_DISTRIBUTED_H
@@ -0,0 +1,296 @@
+#ifndef SMPL_DISTRIBUTIONS_H
+#define SMPL_DISTRIBUTIONS_H
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cassert>
+
+#include "Random.h"
+
+namespace smpl
+{
+    /**
+     * Таблица псевдонимов (метод Уолкера, построение по Возе) для
+     * дискретного эмпирического распределения: одно равномерное число на значение
+     */
+    class AliasTable {
+    private:
+        std::vector<double> values;
+        std::vector<double> prob;
+        std::vector<uint> alias;
+
+    public:
+        AliasTable() {}
+        /**
+         * @param values Значения случайной величины
+         * @param weights Неотрицательные веса значений, не обязательно нормированные
+         */
+        AliasTable(const std::vector<double> &values, const std::vector<double> &weights);
+
+        /**
+         * Значение по равномерному числу u из [0; 1)
+         */
+        double sample(double u) const {
+            double x = u * prob.size();
+            size_t i = std::min((size_t)x, prob.size() - 1);
+            return x - i < prob[i] ? values[i] : values[alias[i]];
+        }
+
+        size_t size() const {
+            return values.size();
+        }
+    };
+
+    AliasTable::AliasTable(const std::vector<double> &values, const std::vector<double> &weights)
+            : values(values), prob(values.size()), alias(values.size()) {
+        assert(!values.empty() && values.size() == weights.size());
+        size_t n = values.size();
+        double total = 0;
+        for (size_t i = 0; i < n; i++) {
+            assert(weights[i] >= 0);
+            total += weights[i];
+        }
+        assert(total > 0);
+
+        std::vector<double> scaled(n);
+        std::vector<uint> small, large;
+        for (size_t i = 0; i < n; i++) {
+            scaled[i] = weights[i] * n / total;
+            (scaled[i] < 1 ? small : large).push_back((uint)i);
+        }
+        while (!small.empty() && !large.empty()) {
+            uint s = small.back(), l = large.back();
+            small.pop_back();
+            prob[s] = scaled[s];
+            alias[s] = l;
+            scaled[l] = scaled[l] + scaled[s] - 1;
+            if (scaled[l] < 1) {
+                large.pop_back();
+                small.push_back(l);
+            }
+        }
+        for (size_t i = 0; i < large.size(); i++) {
+            prob[large[i]] = 1;
+            alias[large[i]] = large[i];
+        }
+        for (size_t i = 0; i < small.size(); i++) {
+            prob[small[i]] = 1;
+            alias[small[i]] = small[i];
+        }
+    }
+
+    /**
+     * Пакетная генерация случайных величин.
+     * Случайные биты вырабатываются пачкой (RandomStream::fill использует AVX2/AVX-512, если они доступны),
+     * преобразование выполняется плотным циклом без ветвлений. Функции libm не заменяются
+     * приближениями, поэтому значения совпадают побитно на любом процессоре и с поштучной генерацией
+     */
+    namespace variates {
+        /** Размер порции случайных 32-битных значений на стеке */
+        const size_t ChunkSize = 512;
+
+        /**
+         * n равномерно распределенных чисел из [0; 1), то же, что n вызовов RandomStream::uniform
+         */
+        inline void fillUniform(RandomStream &s, double *out, size_t n) {
+            uint raw[ChunkSize];
+            for (size_t done = 0; done < n; ) {
+                size_t m = std::min(n - done, ChunkSize / 2);
+                s.fill(raw, 2 * m);
+                for (size_t i = 0; i < m; i++) {
+                    out[done + i] = RandomStream::toUniform(raw[2 * i], raw[2 * i + 1]);
+                }
+                done += m;
+            }
+        }
+
+        /**
+         * Равномерное распределение на [L; R)
+         */
+        inline void fillUniform(RandomStream &s, double *out, size_t n, double L, double R) {
+            fillUniform(s, out, n);
+            double width = R - L;
+            for (size_t i = 0; i < n; i++) {
+                out[i] = L + width * out[i];
+            }
+        }
+
+        /**
+         * Экспоненциальное распределение со средним mean, то же, что n вызовов RandomStream::exponential
+         */
+        inline void fillExponential(RandomStream &s, double *out, size_t n, double mean) {
+            fillUniform(s, out, n);
+            for (size_t i = 0; i < n; i++) {
+                out[i] = -log(1 - out[i]) * mean;
+            }
+        }
+
+        /**
+         * Нормальное распределение, преобразование Бокса-Мюллера.
+         * Каждая пара значений использует два равномерных числа
+         */
+        inline void fillNormal(RandomStream &s, double *out, size_t n, double mean, double sigma) {
+            const double TwoPi = 6.283185307179586;
+            double u[ChunkSize];
+            for (size_t done = 0; done < n; ) {
+                size_t m = std::min((n - done + 1) / 2, ChunkSize / 2);
+                fillUniform(s, u, 2 * m);
+                for (size_t i = 0; i < m; i++) {
+                    double r = sigma * sqrt(-2 * log(1 - u[2 * i]));
+                    double phi = TwoPi * u[2 * i + 1];
+                    out[done + 2 * i] = mean + r * cos(phi);
+                    if (done + 2 * i + 1 < n)
+                        out[done + 2 * i + 1] = mean + r * sin(phi);
+                }
+                done += 2 * m;
+            }
+        }
+
+        /**
+         * Распределение Эрланга порядка k со средним mean: сумма k экспоненциальных
+         * величин, вычисляется как логарифм произведения равномерных чисел
+         */
+        inline void fillErlang(RandomStream &s, double *out, size_t n, uint k, double mean) {
+            assert(k > 0);
+            // Произведение не более 32 сомножителей не уходит в денормализованные числа
+            const uint MaxProduct = 32;
+            double u[ChunkSize];
+            double scale = mean / k;
+            for (size_t i = 0; i < n; i++) {
+                double sum = 0;
+                for (uint done = 0; done < k; ) {
+                    uint m = std::min(k - done, MaxProduct);
+                    fillUniform(s, u, m);
+                    double prod = 1;
+                    for (uint j = 0; j < m; j++) {
+                        prod *= 1 - u[j];
+                    }
+                    sum += log(prod);
+                    done += m;
+                }
+                out[i] = -sum * scale;
+            }
+        }
+
+        /**
+         * Эмпирическое распределение по таблице псевдонимов
+         */
+        inline void fillEmpirical(RandomStream &s, double *out, size_t n, const AliasTable &table) {
+            fillUniform(s, out, n);
+            for (size_t i = 0; i < n; i++) {
+                out[i] = table.sample(out[i]);
+            }
+        }
+    }
+
+    enum DistributionType {
+        DistributionUniform,
+        DistributionExponential,
+        DistributionNormal,
+        DistributionErlang,
+        DistributionEmpirical
+    };
+
+    /**
+     * Описание распределения для пакетной генерации
+     */
+    struct Distribution {
+        DistributionType type;
+        /** Параметры: границы для равномерного, среднее и отклонение для нормального, среднее для остальных */
+        double a, b;
+        /** Порядок распределения Эрланга */
+        uint k;
+        /** Таблица эмпирического распределения, должна жить дольше распределения */
+        const AliasTable *table;
+
+        static Distribution uniform(double L, double R) {
+            Distribution d = {DistributionUniform, L, R, 0, NULL};
+            return d;
+        }
+
+        static Distribution exponential(double mean) {
+            Distribution d = {DistributionExponential, mean, 0, 0, NULL};
+            return d;
+        }
+
+        static Distribution normal(double mean, double sigma) {
+            Distribution d = {DistributionNormal, mean, sigma, 0, NULL};
+            return d;
+        }
+
+        static Distribution erlang(uint k, double mean) {
+            Distribution d = {DistributionErlang, mean, 0, k, NULL};
+            return d;
+        }
+
+        static Distribution empirical(const AliasTable &table) {
+            Distribution d = {DistributionEmpirical, 0, 0, 0, &table};
+            return d;
+        }
+
+        /**
+         * Заполнение out n значениями из потока s
+         */
+        void fill(RandomStream &s, double *out, size_t n) const {
+            switch (type) {
+                case DistributionUniform:
+                    variates::fillUniform(s, out, n, a, b);
+                    break;
+                case DistributionExponential:
+                    variates::fillExponential(s, out, n, a);
+                    break;
+                case DistributionNormal:
+                    variates::fillNormal(s, out, n, a, b);
+                    break;
+                case DistributionErlang:
+                    variates::fillErlang(s, out, n, k, a);
+                    break;
+                case DistributionEmpirical:
+                    variates::fillEmpirical(s, out, n, *table);
+                    break;
+            }
+        }
+    };
+
+    /**
+     * Буфер случайных величин одного источника: значения вырабатываются пачкой
+     * и выдаются по одному. Поток, к которому привязан буфер, не должен
+     * использоваться напрямую, иначе последовательность зависит от размера буфера
+     */
+    class VariateBuffer {
+    private:
+        RandomStream *stream;
+        Distribution distribution;
+        std::vector<double> values;
+        size_t position;
+
+    public:
+        static const size_t DefaultSize = 256;
+
+        VariateBuffer() : stream(NULL), position(0) {}
+
+        VariateBuffer(RandomStream &stream, const Distribution &distribution, size_t size = DefaultSize)
+                : stream(&stream), distribution(distribution), values(size), position(size) {
+            assert(size > 0);
+        }
+
+        double next() {
+            if (position == values.size()) {
+                assert(stream != NULL);
+                distribution.fill(*stream, &values[0], values.size());
+                position = 0;
+            }
+            return values[position++];
+        }
+
+        /**
+         * Сброс выработанных, но не выданных значений
+         */
+        void discard() {
+            position = values.size();
+        }
+    };
+}
+
+#endif //SMPL_DISTRIBUTIONS_H
@@ -0,0 +1,493 @@
+#ifndef SMPL_EVENTLIST_H
+#define SMPL_EVENTLIST_H
+
+#include <vector>
+#include <set>
+#include <algorithm>
+
+#include <ctime>
+#include <cassert>
+
+#include "Arena.h"
+
+namespace smpl
+{
+    typedef unsigned long long u64;
+    typedef u64 transact_t;
+
+    /**
+     * Событие
+     */
+    class Event {
+    public:
+        /** T, время события */
+        time_t time;
+        /** E, номер события */
+        u64 eventId;
+        /** J, транзакт */
+        transact_t transactId;
+        /** Порядковый номер планирования, разрешает равенство времени и номера события */
+        u64 seq;
+        /** Номер записи в таблице запланированных событий */
+        unsigned int slot;
+
+        /**
+         * События упорядочены по времени, затем по номеру события,
+         * а совпадающие по обоим полям - в порядке планирования
+         */
+        friend bool operator<(const Event &a, const Event &b) {
+            return a.time < b.time || (a.time == b.time && (a.eventId < b.eventId ||
+                    (a.eventId == b.eventId && a.seq < b.seq)));
+        }
+    };
+
+    /**
+     * Способ хранения списка будущих событий
+     */
+    enum EventListType {
+        /** Красно-черное дерево std::multiset */
+        EventListMultiset,
+        /** Плоская 4-арная куча */
+        EventListHeap,
+        /** Календарная очередь с автоматическим изменением размера */
+        EventListCalendar,
+        /** Лестничная очередь */
+        EventListLadder
+    };
+
+    /**
+     * Список будущих событий.
+     * Все реализации выдают события в порядке Event::operator<
+     */
+    class EventList {
+    public:
+        virtual ~EventList() {}
+        /**
+         * Добавление события в список
+         */
+        virtual void push(const Event &e) = 0;
+        /**
+         * Извлечение ближайшего события. Список не должен быть пуст
+         */
+        virtual Event pop() = 0;
+        virtual size_t size() const = 0;
+        virtual void clear() = 0;
+        /**
+         * Добавляет в out все события списка в произвольном порядке
+         */
+        virtual void collect(std::vector<Event> &out) const = 0;
+
+        bool empty() const {
+            return size() == 0;
+        }
+    };
+
+    class MultisetEventList : public EventList {
+    private:
+        std::multiset<Event, std::less<Event>, PoolAllocator<Event> > events;
+
+    public:
+        explicit MultisetEventList(Arena &arena) : events(std::less<Event>(), PoolAllocator<Event>(&arena)) {}
+
+        void push(const Event &e) {
+            events.insert(e);
+        }
+
+        Event pop() {
+            assert(!events.empty());
+            Event e = *events.begin();
+            events.erase(events.begin());
+            return e;
+        }
+
+        size_t size() const {
+            return events.size();
+        }
+
+        void clear() {
+            events.clear();
+        }
+
+        void collect(std::vector<Event> &out) const {
+            out.insert(out.end(), events.begin(), events.end());
+        }
+    };
+
+    /**
+     * D-арная куча на непрерывном массиве
+     */
+    template<unsigned D>
+    class HeapEventList : public EventList {
+    private:
+        std::vector<Event> heap;
+
+    public:
+        void push(const Event &e) {
+            size_t i = heap.size();
+            heap.push_back(e);
+            while (i > 0) {
+                size_t parent = (i - 1) / D;
+                if (!(e < heap[parent]))
+                    break;
+                heap[i] = heap[parent];
+                i = parent;
+            }
+            heap[i] = e;
+        }
+
+        Event pop() {
+            assert(!heap.empty());
+            Event res = heap[0];
+            Event last = heap.back();
+            heap.pop_back();
+
+            size_t n = heap.size();
+            if (n == 0)
+                return res;
+
+            size_t i = 0;
+            while (true) {
+                size_t first = i * D + 1;
+                if (first >= n)
+                    break;
+                size_t end = std::min(first + D, n);
+                size_t best = first;
+                for (size_t c = first + 1; c < end; ++c) {
+                    if (heap[c] < heap[best])
+                        best = c;
+                }
+                if (!(heap[best] < last))
+                    break;
+                heap[i] = heap[best];
+                i = best;
+            }
+            heap[i] = last;
+            return res;
+        }
+
+        size_t size() const {
+            return heap.size();
+        }
+
+        void clear() {
+            heap.clear();
+        }
+
+        void collect(std::vector<Event> &out) const {
+            out.insert(out.end(), heap.begin(), heap.end());
+        }
+    };
+
+    inline bool greaterEvent(const Event &a, const Event &b) {
+        return b < a;
+    }
+
+    /**
+     * Вставка в вектор, упорядоченный по убыванию (ближайшее событие в конце)
+     */
+    inline void insertDescending(std::vector<Event> &v, const Event &e) {
+        v.insert(std::lower_bound(v.begin(), v.end(), e, greaterEvent), e);
+    }
+
+    /**
+     * Календарная очередь (R. Brown, 1988).
+     * Число "дней" удваивается или уменьшается вдвое при изменении размера списка,
+     * ширина дня оценивается по ближайшим событиям
+     */
+    class CalendarEventList : public EventList {
+    private:
+        static const size_t MinBuckets = 2;
+        static const size_t SampleSize = 25;
+
+        /** Дни календаря, события каждого дня хранятся в куче с ближайшим в начале */
+        std::vector< std::vector<Event> > buckets;
+        /** Ширина дня */
+        time_t width;
+        /** Текущий день */
+        size_t current;
+        /** Верхняя граница текущего дня */
+        time_t bucketTop;
+        /** Время последнего извлеченного события */
+        time_t lastTime;
+        size_t count;
+
+        size_t bucketOf(time_t t) const {
+            return (size_t)(t / width) & (buckets.size() - 1);
+        }
+
+        void rebuild(size_t bucketsCount) {
+            std::vector<Event> all;
+            all.reserve(count);
+            collect(all);
+
+            size_t sample = std::min(all.size(), (size_t)SampleSize);
+            if (sample > 1) {
+                std::partial_sort(all.begin(), all.begin() + sample, all.end());
+                double avg = (all[sample - 1].time - all[0].time) * 1.0 / (sample - 1);
+                double sum = 0;
+                size_t n = 0;
+                for (size_t i = 1; i < sample; ++i) {
+                    time_t gap = all[i].time - all[i - 1].time;
+                    if (gap <= 2 * avg) {
+                        sum += gap;
+                        n++;
+                    }
+                }
+                width = n && sum > 0 ? (time_t)(3 * sum / n) : 1;
+                width = std::max(width, (time_t)1);
+            }
+
+            buckets.assign(bucketsCount, std::vector<Event>());
+            for (size_t i = 0; i < all.size(); ++i) {
+                buckets[bucketOf(all[i].time)].push_back(all[i]);
+            }
+            for (size_t i = 0; i < buckets.size(); ++i) {
+                std::make_heap(buckets[i].begin(), buckets[i].end(), greaterEvent);
+            }
+            current = bucketOf(lastTime);
+            bucketTop = (lastTime / width + 1) * width;
+        }
+
+    public:
+        CalendarEventList() : width(1), current(0), bucketTop(1), lastTime(0), count(0) {
+            buckets.resize(MinBuckets);
+        }
+
+        void push(const Event &e) {
+            std::vector<Event> &b = buckets[bucketOf(e.time)];
+            b.push_back(e);
+            std::push_heap(b.begin(), b.end(), greaterEvent);
+            count++;
+            if (count > 2 * buckets.size())
+                rebuild(buckets.size() * 2);
+        }
+
+        Event pop() {
+            assert(count > 0);
+            size_t i = current;
+            time_t top = bucketTop;
+            size_t found = buckets.size();
+
+            for (size_t step = 0; step < buckets.size(); ++step) {
+                if (!buckets[i].empty() && buckets[i].front().time < top) {
+                    found = i;
+                    break;
+                }
+                i = (i + 1) & (buckets.size() - 1);
+                top += width;
+            }
+
+            if (found == buckets.size()) {
+                // За целый "год" событий нет - прямой поиск минимума
+                for (size_t j = 0; j < buckets.size(); ++j) {
+                    if (!buckets[j].empty() && (found == buckets.size() || buckets[j].front() < buckets[found].front()))
+                        found = j;
+                }
+                top = (buckets[found].front().time / width + 1) * width;
+            }
+
+            current = found;
+            bucketTop = top;
+            std::vector<Event> &b = buckets[found];
+            std::pop_heap(b.begin(), b.end(), greaterEvent);
+            Event e = b.back();
+            b.pop_back();
+            lastTime = e.time;
+            count--;
+
+            if (buckets.size() > MinBuckets && count < buckets.size() / 2)
+                rebuild(buckets.size() / 2);
+            return e;
+        }
+
+        size_t size() const {
+            return count;
+        }
+
+        void clear() {
+            buckets.assign(MinBuckets, std::vector<Event>());
+            width = 1;
+            current = 0;
+            bucketTop = 1;
+            lastTime = 0;
+            count = 0;
+        }
+
+        void collect(std::vector<Event> &out) const {
+            for (size_t i = 0; i < buckets.size(); ++i) {
+                out.insert(out.end(), buckets[i].begin(), buckets[i].end());
+            }
+        }
+    };
+
+    /**
+     * Лестничная очередь (W. T. Tang, R. S. M. Goh, I. L.-J. Thng, 2005).
+     * Top - неупорядоченный список дальних событий, ступени (rungs) - корзины
+     * уменьшающейся ширины, Bottom - короткий упорядоченный список ближайших событий
+     */
+    class LadderEventList : public EventList {
+    private:
+        static const size_t Threshold = 50;
+        static const size_t MaxRungs = 8;
+
+        struct Rung {
+            /** Начало первой корзины */
+            time_t start;
+            /** Ширина корзины */
+            time_t width;
+            /** Текущая корзина */
+            size_t cur;
+            size_t count;
+            std::vector< std::vector<Event> > buckets;
+
+            time_t curStart() const {
+                return start + (time_t)cur * width;
+            }
+        };
+
+        std::vector<Event> top;
+        time_t topMin, topMax;
+        /** События с временем не меньше topStart попадают в top */
+        time_t topStart;
+        std::vector<Rung> rungs;
+        /** Упорядочен по убыванию, ближайшее событие в конце */
+        std::vector<Event> bottom;
+        size_t count;
+
+        void addRung(std::vector<Event> &src, time_t start, time_t end, time_t width) {
+            Rung r;
+            r.start = start;
+            r.width = std::max(width, (time_t)1);
+            r.cur = 0;
+            r.count = src.size();
+            r.buckets.resize((size_t)((end - start + r.width - 1) / r.width));
+            for (size_t i = 0; i < src.size(); ++i) {
+                r.buckets[(size_t)((src[i].time - start) / r.width)].push_back(src[i]);
+            }
+            src.clear();
+            rungs.push_back(r);
+        }
+
+        void toBottom(std::vector<Event> &src) {
+            bottom.swap(src);
+            src.clear();
+            std::sort(bottom.begin(), bottom.end(), greaterEvent);
+        }
+
+        void refill() {
+            while (bottom.empty()) {
+                if (rungs.empty()) {
+                    assert(!top.empty());
+                    time_t start = topMin, end = topMax + 1;
+                    topStart = end;
+                    if (top.size() <= Threshold || topMin == topMax) {
+                        toBottom(top);
+                    } else {
+                        addRung(top, start, end, (end - start + (time_t)top.size() - 1) / (time_t)top.size());
+                    }
+                    continue;
+                }
+
+                Rung &r = rungs.back();
+                if (r.count == 0) {
+                    rungs.pop_back();
+                    continue;
+                }
+                while (r.buckets[r.cur].empty())
+                    r.cur++;
+
+                std::vector<Event> &b = r.buckets[r.cur];
+                time_t bStart = r.curStart();
+                time_t bWidth = r.width;
+                r.count -= b.size();
+                r.cur++;
+
+                if (b.size() > Threshold && bWidth > 1 && rungs.size() < MaxRungs) {
+                    std::vector<Event> src;
+                    src.swap(b);
+                    addRung(src, bStart, bStart + bWidth, bWidth / (time_t)Threshold);
+                } else {
+                    toBottom(b);
+                }
+            }
+        }
+
+    public:
+        LadderEventList() : topMin(0), topMax(0), topStart(0), count(0) {}
+
+        void push(const Event &e) {
+            count++;
+            if (e.time >= topStart) {
+                if (top.empty()) {
+                    topMin = topMax = e.time;
+                } else {
+                    topMin = std::min(topMin, e.time);
+                    topMax = std::max(topMax, e.time);
+                }
+                top.push_back(e);
+                return;
+            }
+            for (size_t i = 0; i < rungs.size(); ++i) {
+                Rung &r = rungs[i];
+                if (e.time >= r.curStart()) {
+                    r.buckets[(size_t)((e.time - r.start) / r.width)].push_back(e);
+                    r.count++;
+                    return;
+                }
+            }
+            insertDescending(bottom, e);
+        }
+
+        Event pop() {
+            assert(count > 0);
+            if (bottom.empty())
+                refill();
+            Event e = bottom.back();
+            bottom.pop_back();
+            count--;
+            return e;
+        }
+
+        size_t size() const {
+            return count;
+        }
+
+        void clear() {
+            top.clear();
+            rungs.clear();
+            bottom.clear();
+            topMin = topMax = topStart = 0;
+            count = 0;
+        }
+
+        void collect(std::vector<Event> &out) const {
+            out.insert(out.end(), top.begin(), top.end());
+            for (size_t i = 0; i < rungs.size(); ++i) {
+                for (size_t j = rungs[i].cur; j < rungs[i].buckets.size(); ++j) {
+                    out.insert(out.end(), rungs[i].buckets[j].begin(), rungs[i].buckets[j].end());
+                }
+            }
+            out.insert(out.end(), bottom.begin(), bottom.end());
+        }
+    };
+
+    /**
+     * Создание списка событий выбранного типа в арене.
+     * Узлы дерева EventListMultiset также берутся из арены
+     */
+    inline EventList *createEventList(EventListType type, Arena &arena) {
+        switch (type) {
+            case EventListMultiset:
+                return arena.create<MultisetEventList>(arena);
+            case EventListCalendar:
+                return arena.create<CalendarEventList>();
+            case EventListLadder:
+                return arena.create<LadderEventList>();
+            case EventListHeap:
+            default:
+                return arena.create< HeapEventList<4> >();
+        }
+    }
+}
+
+#endif //SMPL_EVENTLIST_H
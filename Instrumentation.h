@@ -0,0 +1,230 @@
+#ifndef SMPL_INSTRUMENTATION_H
+#define SMPL_INSTRUMENTATION_H
+
+/**
+ * Измерения горячего пути движка включаются макросом SMPL_INSTRUMENT (например, -DSMPL_INSTRUMENT).
+ * Без него SMPL_PROFILE(...) раскрывается в пустоту, и движок не содержит ни счетчиков, ни вызовов
+ */
+#ifdef SMPL_INSTRUMENT
+#define SMPL_PROFILE(...) __VA_ARGS__
+#else
+#define SMPL_PROFILE(...)
+#endif
+
+#ifdef SMPL_INSTRUMENT
+
+#include <vector>
+#include <map>
+#include <string>
+#include <ostream>
+#include <chrono>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace smpl
+{
+    /**
+     * Профиль прогона: количество событий каждого типа, гистограммы времени обработчиков в тактах,
+     * наибольшая длина списка событий и очередей, время прогона
+     */
+    class Profile {
+    public:
+        /** Корзина b гистограммы - длительности [2^(b-1); 2^b) тактов, корзина 0 - ноль тактов */
+        static const int Buckets = 64;
+
+        struct EventStats {
+            unsigned long long count;
+            unsigned long long cycles;
+            unsigned long long histogram[Buckets];
+
+            EventStats() : count(0), cycles(0) {
+                for (int i = 0; i < Buckets; i++) {
+                    histogram[i] = 0;
+                }
+            }
+        };
+
+    private:
+        /** Пользовательские события с небольшими номерами - плотный массив, остальные - словарь */
+        static const size_t DenseLimit = 1024;
+        std::vector<EventStats> dense;
+        std::map<unsigned long long, EventStats> sparse;
+
+    public:
+        /** Обработано событий */
+        unsigned long long events;
+        /** Наибольшее число запланированных событий */
+        size_t eventListHighWater;
+        /** Наибольшая длина каждой очереди */
+        std::vector<size_t> queueHighWater;
+        /** Время выполнения, секунды */
+        double seconds;
+
+        Profile() : events(0), eventListHighWater(0), seconds(0) {}
+
+        /**
+         * Счетчик тактов процессора (на других архитектурах - наносекунды монотонных часов)
+         */
+        static unsigned long long cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+            return __rdtsc();
+#else
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+        }
+
+        EventStats &stats(unsigned long long eventId) {
+            if (eventId < DenseLimit) {
+                if (dense.size() <= eventId)
+                    dense.resize(eventId + 1);
+                return dense[eventId];
+            }
+            return sparse[eventId];
+        }
+
+        void countEvent(unsigned long long eventId) {
+            stats(eventId).count++;
+            events++;
+        }
+
+        void handlerTime(unsigned long long eventId, unsigned long long cycles) {
+            EventStats &s = stats(eventId);
+            s.cycles += cycles;
+            // Разность тактов при переходе потока на ядро с другим TSC может быть огромной: последний
+            // интервал открыт сверху
+            int bucket = cycles == 0 ? 0 : 64 - __builtin_clzll(cycles);
+            s.histogram[bucket < Buckets ? bucket : Buckets - 1]++;
+        }
+
+        void eventListSize(size_t n) {
+            if (n > eventListHighWater)
+                eventListHighWater = n;
+        }
+
+        void queueLength(size_t queue, size_t n) {
+            if (queueHighWater.size() <= queue)
+                queueHighWater.resize(queue + 1, 0);
+            if (n > queueHighWater[queue])
+                queueHighWater[queue] = n;
+        }
+
+        /**
+         * Вызов f(eventId, stats) для всех встречавшихся типов событий по возрастанию номера
+         */
+        template<typename F>
+        void forEach(F f) const {
+            for (size_t i = 0; i < dense.size(); i++) {
+                if (dense[i].count != 0 || dense[i].cycles != 0)
+                    f((unsigned long long)i, dense[i]);
+            }
+            for (std::map<unsigned long long, EventStats>::const_iterator it = sparse.begin(); it != sparse.end(); it++) {
+                f(it->first, it->second);
+            }
+        }
+
+        void clear() {
+            dense.clear();
+            sparse.clear();
+            events = 0;
+            eventListHighWater = 0;
+            queueHighWater.clear();
+            seconds = 0;
+        }
+
+        /**
+         * Сложение профилей прогонов: счетчики суммируются, наибольшие значения - по максимуму
+         */
+        void merge(const Profile &other);
+
+        /**
+         * Сводка в формате JSON
+         * @param queues Имена очередей по номерам
+         * @param eventsPerSecond Скорость каждого прогона
+         */
+        void writeJSON(std::ostream &out, const std::vector<std::string> &queues,
+                const std::vector<double> &eventsPerSecond) const;
+
+        static void writeString(std::ostream &out, const std::string &s);
+    };
+
+    void Profile::merge(const Profile &other) {
+        other.forEach([this](unsigned long long id, const EventStats &s) {
+            EventStats &to = stats(id);
+            to.count += s.count;
+            to.cycles += s.cycles;
+            for (int i = 0; i < Buckets; i++) {
+                to.histogram[i] += s.histogram[i];
+            }
+        });
+        events += other.events;
+        eventListSize(other.eventListHighWater);
+        for (size_t i = 0; i < other.queueHighWater.size(); i++) {
+            queueLength(i, other.queueHighWater[i]);
+        }
+        seconds += other.seconds;
+    }
+
+    void Profile::writeString(std::ostream &out, const std::string &s) {
+        out << '"';
+        for (size_t i = 0; i < s.size(); i++) {
+            char c = s[i];
+            if (c == '"' || c == '\\') {
+                out << '\\' << c;
+            } else if ((unsigned char)c < 0x20) {
+                const char *hex = "0123456789abcdef";
+                out << "\\u00" << hex[(c >> 4) & 0xf] << hex[c & 0xf];
+            } else {
+                out << c;
+            }
+        }
+        out << '"';
+    }
+
+    void Profile::writeJSON(std::ostream &out, const std::vector<std::string> &queues,
+            const std::vector<double> &eventsPerSecond) const {
+        out << "{\"events\": " << events << ", \"seconds\": " << seconds
+            << ", \"eventsPerSecond\": " << (seconds > 0 ? events / seconds : 0)
+            << ", \"eventListHighWater\": " << eventListHighWater;
+
+        out << ", \"replications\": [";
+        for (size_t i = 0; i < eventsPerSecond.size(); i++) {
+            out << (i ? ", " : "") << "{\"eventsPerSecond\": " << eventsPerSecond[i] << "}";
+        }
+        out << "]";
+
+        out << ", \"queues\": [";
+        for (size_t i = 0; i < queueHighWater.size(); i++) {
+            out << (i ? ", " : "") << "{\"name\": ";
+            writeString(out, i < queues.size() ? queues[i] : std::string());
+            out << ", \"highWater\": " << queueHighWater[i] << "}";
+        }
+        out << "]";
+
+        out << ", \"eventTypes\": [";
+        bool first = true;
+        forEach([&out, &first](unsigned long long id, const EventStats &s) {
+            out << (first ? "" : ", ") << "{\"id\": " << id << ", \"count\": " << s.count
+                << ", \"handlerCycles\": " << s.cycles
+                << ", \"meanCycles\": " << (s.count ? (double)s.cycles / s.count : 0) << ", \"histogram\": [";
+            bool firstBucket = true;
+            for (int b = 0; b < Buckets; b++) {
+                if (s.histogram[b] == 0)
+                    continue;
+                // Нижняя граница корзины в тактах и количество
+                out << (firstBucket ? "" : ", ") << "[" << (b == 0 ? 0ULL : 1ULL << (b - 1)) << ", "
+                    << s.histogram[b] << "]";
+                firstBucket = false;
+            }
+            out << "]}";
+            first = false;
+        });
+        out << "]}" << std::endl;
+    }
+}
+
+#endif
+
+#endif //SMPL_INSTRUMENTATION_H
@@ -0,0 +1,71 @@
+#ifndef SMPL_MAPPEDFILE_H
+#define SMPL_MAPPEDFILE_H
+
+#include <string>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace smpl
+{
+    /**
+     * Файл, отображенный в память только для чтения. Общая часть читателей трасс и срезов
+     */
+    class MappedFile {
+    private:
+        const char *data;
+        size_t size;
+
+        MappedFile(const MappedFile &);
+        MappedFile &operator=(const MappedFile &);
+
+    public:
+        /**
+         * @param path Путь к файлу
+         * @param kind Название файла в сообщениях об ошибках, например "трассы"
+         */
+        MappedFile(const std::string &path, const std::string &kind);
+        ~MappedFile() {
+            if (data != NULL)
+                munmap((void *)data, size);
+        }
+
+        /**
+         * Содержимое файла, NULL для пустого файла
+         */
+        const char *bytes() const {
+            return data;
+        }
+
+        size_t length() const {
+            return size;
+        }
+    };
+
+    MappedFile::MappedFile(const std::string &path, const std::string &kind) : data(NULL), size(0) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw std::runtime_error("Не удалось открыть файл " + kind + " " + path);
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            close(fd);
+            throw std::runtime_error("Не удалось прочитать файл " + kind + " " + path);
+        }
+        size_t length = (size_t)st.st_size;
+        if (length > 0) {
+            void *p = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p == MAP_FAILED) {
+                close(fd);
+                throw std::runtime_error("Не удалось отобразить файл " + kind + " " + path);
+            }
+            data = static_cast<const char *>(p);
+            size = length;
+        }
+        close(fd);
+    }
+}
+
+#endif //SMPL_MAPPEDFILE_H
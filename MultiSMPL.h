@@ -8,23 +8,232 @@
 #include <ostream>
 #include <iostream>
 #include <map>
+#include <memory>
+#include <deque>
+#include <functional>
+#include <type_traits>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstdlib>
 #include <cmath>
+#include <ctime>
+
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
 
 #include "smpl.h"
+#include "ThreadPool.h"
+#include "Statistics.h"
+#include "SnapshotStore.h"
+#include "Distributed.h"
 
 namespace multiSMPL {
 
     enum SystemEvents {
         SystemEventMonitor = 1000000000LL,
-        SystemEventEnd
+        SystemEventEnd,
+        /** Конец общего разгона в MultiSMPL::runForked, обработчик не вызывается */
+        SystemEventWarmupEnd,
+        SystemEventsEnd
+    };
+
+    typedef void (*Handler)(std::pair<smpl::u64, smpl::transact_t>, int, smpl::Engine *);
+
+    /**
+     * Таблица обработчиков событий.
+     * Пользовательские события индексируют плотный массив, системные - отдельный короткий массив,
+     * поэтому вызов обработчика - одна проверка диапазона и один косвенный вызов.
+     * Кроме функций принимает лямбды и функциональные объекты; объекты копируются в таблицу и
+     * при параллельных прогонах вызываются из разных потоков одновременно
+     */
+    class HandlerTable {
+    private:
+        struct Entry {
+            /** Обычная функция, если object == nullptr */
+            Handler function;
+            /** Функциональный объект и функция его вызова */
+            void *object;
+            void (*invoke)(void *, std::pair<smpl::u64, smpl::transact_t>, int, smpl::Engine *);
+        };
+
+        std::vector<Entry> userHandlers;
+        Entry systemHandlers[SystemEventsEnd - SystemEventMonitor];
+        /** Обработчик для незарегистрированных событий */
+        Entry missing;
+        std::vector<std::shared_ptr<void>> objects;
+
+        static void unhandled(std::pair<smpl::u64, smpl::transact_t> event, int testNumber, smpl::Engine *) {
+            std::cerr << "Нет обработчика события " << event.first << " (транзакт " << event.second
+                      << ", прогон " << testNumber + 1 << ")" << std::endl;
+            std::abort();
+        }
+
+        template<typename F>
+        static void invokeObject(void *object, std::pair<smpl::u64, smpl::transact_t> event, int testNumber,
+                smpl::Engine *e) {
+            (*static_cast<F *>(object))(event, testNumber, e);
+        }
+
+        Entry &entry(smpl::u64 eventId);
+
+        template<typename F>
+        void addObject(smpl::u64 eventId, const F &handler, std::true_type) {
+            add(eventId, static_cast<Handler>(handler));
+        }
+
+        template<typename F>
+        void addObject(smpl::u64 eventId, const F &handler, std::false_type) {
+            std::shared_ptr<F> object = std::make_shared<F>(handler);
+            objects.push_back(object);
+            Entry &e = entry(eventId);
+            e.function = nullptr;
+            e.object = object.get();
+            e.invoke = invokeObject<F>;
+        }
+
+    public:
+        /** Наибольший номер пользовательского события плюс один */
+        static const smpl::u64 MaxUserEvent = 1 << 20;
+
+        HandlerTable();
+
+        /**
+         * Регистрация обработчика события
+         * @param eventId Номер события: меньше MaxUserEvent или системное событие
+         */
+        void add(smpl::u64 eventId, Handler handler);
+        /**
+         * Регистрация лямбды или функционального объекта с сигнатурой обработчика
+         */
+        template<typename F>
+        void add(smpl::u64 eventId, const F &handler) {
+            addObject(eventId, handler, std::is_convertible<F, Handler>());
+        }
+
+        bool has(smpl::u64 eventId) const;
+
+        /**
+         * Вызов обработчика события. Для незарегистрированного события выводится
+         * сообщение и выполнение прерывается
+         */
+        void dispatch(std::pair<smpl::u64, smpl::transact_t> event, int testNumber, smpl::Engine *e) const {
+            const Entry &h = event.first < userHandlers.size() ? userHandlers[event.first] :
+                    event.first >= SystemEventMonitor && event.first < SystemEventsEnd ?
+                    systemHandlers[event.first - SystemEventMonitor] : missing;
+            if (h.object == nullptr) {
+                h.function(event, testNumber, e);
+            } else {
+                h.invoke(h.object, event, testNumber, e);
+            }
+        }
+    };
+
+    HandlerTable::HandlerTable() {
+        missing.function = unhandled;
+        missing.object = nullptr;
+        missing.invoke = nullptr;
+        for (int i = 0; i < SystemEventsEnd - SystemEventMonitor; i++) {
+            systemHandlers[i] = missing;
+        }
+    }
+
+    HandlerTable::Entry &HandlerTable::entry(smpl::u64 eventId) {
+        if (eventId >= SystemEventMonitor && eventId < SystemEventsEnd)
+            return systemHandlers[eventId - SystemEventMonitor];
+
+        assert(eventId < MaxUserEvent);
+        if (userHandlers.size() <= eventId)
+            userHandlers.resize(eventId + 1, missing);
+        return userHandlers[eventId];
+    }
+
+    void HandlerTable::add(smpl::u64 eventId, Handler handler) {
+        assert(handler != nullptr);
+        Entry &e = entry(eventId);
+        e.function = handler;
+        e.object = nullptr;
+        e.invoke = nullptr;
+    }
+
+    bool HandlerTable::has(smpl::u64 eventId) const {
+        if (eventId >= SystemEventMonitor && eventId < SystemEventsEnd)
+            return systemHandlers[eventId - SystemEventMonitor].function != unhandled;
+        return eventId < userHandlers.size() && userHandlers[eventId].function != unhandled;
+    }
+
+    /**
+     * Показатель, оцениваемый по прогонам
+     */
+    enum MetricType {
+        /** Процент занятости устройства */
+        MetricDeviceUtilization,
+        /** Среднее время занятости устройства одним транзактом */
+        MetricDeviceReserveTime,
+        /** Среднее время ожидания в очереди */
+        MetricQueueWaitTime,
+        /** Средняя длина очереди */
+        MetricQueueLength,
+        /** Процент занятых единиц многоканального устройства */
+        MetricStorageUtilization,
+        /** Среднее по времени значение переменной (Engine::createVariable) */
+        MetricVariableMean,
+        /** Значение функции пользователя в конце прогона */
+        MetricUser
+    };
+
+    /**
+     * Оценка показателя по выполненным прогонам
+     */
+    struct Estimate {
+        std::string name;
+        /** Способ оценки: обычная, по антитетическим парам, с контрольной переменной, разность на общих случайных числах */
+        std::string method;
+        double mean;
+        /** Полуширина доверительного интервала */
+        double halfWidth;
+        int replications;
+        /** Заданная точность достигнута */
+        bool reached;
+    };
+
+    /**
+     * Сообщения координатора и рабочих процессов (MultiSMPL::runDistributed, MultiSMPL::runWorker)
+     */
+    enum WireMessage {
+        /** Координатор: параметры эксперимента для проверки совместимости */
+        WireHello = 1,
+        /** Рабочий процесс: готов к получению порций */
+        WireReady,
+        /** Координатор: порция прогонов */
+        WireUnit,
+        /** Рабочий процесс: результат одного прогона */
+        WireResult,
+        /** Координатор: работа закончена */
+        WireStop,
+        /** Рабочий процесс: модель несовместима с координатором */
+        WireError,
+        /** Рабочий процесс: порция выполняется, сообщение только продлевает setWorkerTimeout */
+        WireHeartbeat
     };
 
     struct Meta {
         std::vector<std::string> devices;
         std::vector<std::string> queues;
+        /** Дисциплины очередей по порядку; для очередей без дисциплины - QueueOrdered */
+        std::vector<smpl::QueueDiscipline> queueDisciplines;
+        /** Переменные с интегральной статистикой, создаются в движке каждого потока по порядку */
+        std::vector<std::string> variables;
+        /** Многоканальные устройства и их емкости; в срезах следуют за устройствами */
+        std::vector<std::string> storages;
+        std::vector<smpl::uint> storageCapacities;
     };
 
     class MultiSMPL {
+        friend class Sweep;
+
     private:
         struct QueueInformation {
             std::vector<double> avgWaitTime;
@@ -37,18 +246,105 @@ namespace multiSMPL {
             std::vector<double> avgPercentTime;
         };
 
-        class DecPoint : public std::numpunct<char>
-        {
-        public:
-            DecPoint ( char ch_ ) : ch(ch_) {}
-            char do_decimal_point() const { return ch ; }
-        private:
-            char ch ;
+        /**
+         * Срезы одного прогона. Прогоны выполняются независимо,
+         * а затем суммируются по порядку номеров
+         */
+        struct ReplicationResult {
+            std::vector<QueueInformation> queuesInformation;
+            std::vector<DeviceInformation> devicesInformation;
+            std::vector<double> monitoringTimes;
+            /** Значения показателей в конце прогона */
+            std::vector<double> metrics;
+            /** Время окончания разгона, -1 - разгон не обнаружен */
+            time_t warmupTime;
+            /** Текстовый отчет прогона при параллельном выполнении */
+            std::string log;
+#ifdef SMPL_INSTRUMENT
+            smpl::Profile profile;
+#endif
+        };
+
+        /**
+         * Суммы срезов и оценки показателей по выполненным прогонам
+         */
+        struct Accumulated {
+            std::vector<QueueInformation> queuesInformation;
+            std::vector<DeviceInformation> devicesInformation;
+            std::vector<double> monitoringTimes;
+            std::vector<Summary> metrics;
+            /** Значения показателей по прогонам для оценок с понижением дисперсии */
+            std::vector<std::vector<double>> values;
+            std::vector<time_t> warmupTimes;
+            int replications;
+            /** Двоичный файл срезов, если задан */
+            std::shared_ptr<SnapshotWriter> snapshots;
+#ifdef SMPL_INSTRUMENT
+            /** Сумма профилей прогонов и скорость каждого прогона, событий в секунду */
+            smpl::Profile profile;
+            std::vector<double> eventsPerSecond;
+#endif
+        };
+
+        /**
+         * Общий разгон, от которого продолжаются прогоны runForked
+         */
+        struct Fork {
+            const smpl::Engine::Snapshot *snapshot;
+            /** Срезы, снятые во время разгона */
+            const ReplicationResult *warmup;
+            /** Номер прогона, под которым выполнялся разгон */
+            int warmupTest;
+        };
+
+        struct Metric {
+            std::string name;
+            MetricType type;
+            /** Номер устройства или очереди в Meta */
+            int index;
+            double (*function)(int, smpl::Engine *);
+            /** Требуемая абсолютная и относительная полуширина интервала, 0 - не задана */
+            double absolute, relative;
+            /** Контрольная переменная (номер показателя) и ее известное математическое ожидание, -1 - нет */
+            int control;
+            double controlMean;
         };
 
         std::ostream *fileOutputStream, *csvOutputStream;
-        std::map<smpl::u64, void (*)(std::pair<smpl::u64, smpl::transact_t>, int, smpl::Engine *)> handlers;
+        HandlerTable handlers;
         Meta meta;
+        smpl::EventListType eventListType;
+        int threadsCount;
+        smpl::u64 seed;
+        std::vector<Metric> metrics;
+        double confidence;
+        std::vector<Estimate> estimates;
+        /** Значения показателей по прогонам последнего run, runUntilPrecise или runForked */
+        std::vector<std::vector<double>> metricValues;
+        /** Прогоны 2k и 2k + 1 образуют антитетическую пару */
+        bool antithetic;
+        /** Показатель, по которому определяется конец разгона, -1 - определение выключено */
+        int warmupMetric;
+        int warmupMinBatches;
+        /** Длительность наблюдения после разгона, 0 - прогон не сокращается */
+        time_t observationTime;
+        std::vector<time_t> warmupTimes;
+        std::string snapshotPath;
+        bool textSnapshots;
+        void (*forkHandler)(int warmupTest, int testNumber, smpl::Engine *e);
+        /** Количество копий состояния модели пользователя для runForked */
+        int forkModelsCount;
+        /** Движки потоков, сохраняются между прогонами и вызовами run */
+        std::vector<std::unique_ptr<smpl::Engine>> engines;
+        /** Допустимое время молчания рабочего процесса и ожидания соединения, секунды */
+        int workerTimeout;
+        std::ostream *profileStream;
+        /** Префикс файлов трассы, пустой - трасса не записывается */
+        std::string tracePrefix;
+        size_t traceCapacity;
+        bool traceRing;
+        /** Трассы движков потоков, параллельно engines */
+        std::vector<std::unique_ptr<smpl::TraceWriter>> traces;
 
         void updateDevicesInformation(std::vector<DeviceInformation> &devicesInformation,
                 std::vector<smpl::Device *> &devices, time_t time, int number);
@@ -57,16 +353,299 @@ namespace multiSMPL {
 
         void updateDeviceInformation(DeviceInformation &deviceInformation, smpl::Device *device, time_t time,
                 int number);
+        /**
+         * Срез многоканального устройства: среднее время занятости единицы и процент занятых единиц
+         */
+        void updateStorageInformation(DeviceInformation &deviceInformation, smpl::Storage *storage, time_t time,
+                int number);
+        /**
+         * Количество устройств в срезах: устройства, затем многоканальные устройства
+         */
+        size_t devicesCount() const {
+            return meta.devices.size() + meta.storages.size();
+        }
+
+        const std::string &deviceName(size_t i) const {
+            return i < meta.devices.size() ? meta.devices[i] : meta.storages[i - meta.devices.size()];
+        }
         void updateQueueInformation(QueueInformation &queueInformation, smpl::Queue * queue, time_t time, int number);
 
-        static double avgSum(const std::vector<double> &values, int l, int r);
+        /**
+         * Движок потока worker, подготовленный к новому прогону. Движок создается при первом
+         * обращении вместе с устройствами и очередями модели, далее переиспользуется (Engine::restart)
+         */
+        smpl::Engine *workerEngine(int worker, std::ostream *out);
+        /**
+         * Место под движки и трассы count потоков. Вызывается до запуска потоков: сами потоки
+         * обращаются только к своим элементам
+         */
+        void reserveWorkers(int count);
+        /**
+         * Запись накопленных записей трасс потоков в файлы
+         */
+        void flushTraces();
+        /**
+         * Выполнение одного прогона
+         * @param number Номер прогона
+         * @param worker Номер потока, выполняющего прогон
+         * @param out Поток для отчета прогона
+         * @param fork Если задан, прогон продолжается от общего разгона, а не с начала
+         * @param replication Номер, от которого выводятся потоки случайных чисел, -1 - совпадает с number
+         */
+        void runReplication(int number, int worker, ReplicationResult &result, std::ostream *out,
+                std::pair<smpl::u64, smpl::transact_t> startEvent, time_t startTime,
+                time_t (*monitorTime)(smpl::transact_t), const Fork *fork = nullptr, int replication = -1);
+        /**
+         * Моделирование разгона до warmupTime в движке нулевого потока и сохранение состояния.
+         * Статистика, собранная за время разгона, сбрасывается
+         */
+        void runWarmup(int number, ReplicationResult &result, smpl::Engine::Snapshot &snapshot,
+                std::pair<smpl::u64, smpl::transact_t> startEvent, time_t startTime, time_t warmupTime,
+                time_t (*monitorTime)(smpl::transact_t));
+        /**
+         * Срез монитора с номером number
+         */
+        void recordSnapshot(ReplicationResult &result, smpl::Engine *e, int number);
+        static void mergeReplication(const ReplicationResult &result, Accumulated &accumulated);
+        void startAccumulation(Accumulated &accumulated);
+        /**
+         * Дописывает срезы прогона в двоичный файл: по строке на срез
+         */
+        static void writeSnapshots(const ReplicationResult &result, int number, SnapshotWriter &writer);
+        /**
+         * Выполнение прогонов с номерами [first; first + count) и добавление их результатов по порядку номеров
+         */
+        void runReplications(int first, int count, Accumulated &accumulated,
+                std::pair<smpl::u64, smpl::transact_t> startEvent, time_t startTime,
+                time_t (*monitorTime)(smpl::transact_t), const Fork *fork = nullptr);
+        /**
+         * Выполнение прогонов [first; first + count) в results без объединения
+         * @param logs Сохранять текстовые отчеты прогонов в ReplicationResult::log
+         * @param period Если больше 0, потоки случайных чисел прогона number выводятся из number % period (Sweep)
+         * @param finished Вызывается потоком прогона сразу по его завершении с номером и результатом прогона
+         */
+        void executeReplications(int first, int count, std::vector<ReplicationResult> &results, bool logs,
+                std::pair<smpl::u64, smpl::transact_t> startEvent, time_t startTime,
+                time_t (*monitorTime)(smpl::transact_t), const Fork *fork = nullptr, int period = 0,
+                const std::function<void(int, ReplicationResult &)> &finished = nullptr);
+        /**
+         * Координатор: раздача прогонов [0; tasks) порциями по unitSize рабочим процессам и передача их
+         * результатов consume строго по порядку номеров
+         */
+        void distribute(int tasks, int period, bool logs, int port, int localWorkers, int unitSize,
+                std::pair<smpl::u64, smpl::transact_t> startEvent, time_t startTime,
+                time_t (*monitorTime)(smpl::transact_t),
+                const std::function<void(int, ReplicationResult &)> &consume);
+        void encodeHello(WireWriter &out, bool logs) const;
+        static void encodeResult(const ReplicationResult &result, WireWriter &out);
+        static bool decodeResult(WireReader &in, ReplicationResult &result);
+        double metricValue(const Metric &metric, int number, smpl::Engine *e);
+        /**
+         * Показатель в виде отношения накопленных величин sum / weight, что позволяет получать его значение
+         * на интервале между срезами. Для показателя пользователя weight = 0, sum - текущее значение
+         */
+        void metricTotals(const Metric &metric, int number, smpl::Engine *e, double &sum, double &weight);
+        /**
+         * Пересчет оценок показателей, true - заданная точность достигнута для всех показателей
+         */
+        bool updateEstimates(const Accumulated &accumulated);
+        void printResults(const Accumulated &accumulated);
+        void printSnapshotTables(const Accumulated &accumulated);
+        /**
+         * Вывод ряда срезов (время; значение / divisor) в текстовый и csv потоки без построения таблицы строк
+         */
+        void printSeries(const char *title, const std::vector<double> &times, const std::vector<double> &values,
+                double divisor);
+        void printEstimates();
+        void printWarmup(const Accumulated &accumulated);
+#ifdef SMPL_INSTRUMENT
+        void printProfile(const Accumulated &accumulated);
+#endif
+        /**
+         * Оценка по сводке прогонов; estimated - число параметров, оцененных по тем же прогонам
+         */
+        Estimate makeEstimate(const Metric &metric, const std::string &method, const Summary &summary,
+                int replications, int estimated = 0) const;
+        /**
+         * Средние соседних пар значений
+         */
+        static std::vector<double> pairMeans(const std::vector<double> &values);
+
     public:
-        MultiSMPL(const std::map<smpl::u64, void (*)(std::pair<smpl::u64, smpl::transact_t>, int, smpl::Engine *)> &handlers,
-                Meta &DevicesAndQueuesNames, std::ostream *fileOutputStream, std::ostream *csvOutputStream);
+        /**
+         * @param handlers Обработчики событий. Обработчик SystemEventEnd обязателен
+         */
+        MultiSMPL(const HandlerTable &handlers, Meta &DevicesAndQueuesNames,
+                std::ostream *fileOutputStream, std::ostream *csvOutputStream);
+        MultiSMPL(const std::map<smpl::u64, Handler> &handlers, Meta &DevicesAndQueuesNames,
+                std::ostream *fileOutputStream, std::ostream *csvOutputStream);
+
+        /**
+         * Выбор способа хранения списка событий для всех прогонов
+         */
+        void setEventListType(smpl::EventListType type);
+        /**
+         * Количество потоков для параллельного выполнения прогонов.
+         * 1 - последовательно (по умолчанию), 0 - по числу ядер.
+         * При параллельном выполнении обработчики событий не должны разделять изменяемое
+         * состояние между прогонами: состояние модели нужно хранить отдельно для каждого testNumber
+         */
+        void setThreadsCount(int threadsCount);
+        /**
+         * Зерно эксперимента. Прогон i получает собственные потоки случайных чисел,
+         * выведенные из (seed, i), поэтому результат не зависит от числа потоков
+         */
+        void setSeed(smpl::u64 seed);
 
         void run(int testsCount, std::pair<smpl::u64, smpl::transact_t> startEvent, time_t startTime,
                  time_t (*monitorTime)(smpl::transact_t));
 
+        /**
+         * Показатель устройства или очереди, вычисляемый в конце каждого прогона
+         * @param type Тип показателя, кроме MetricUser
+         * @param index Номер устройства, многоканального устройства, очереди или переменной в Meta
+         * @return Номер показателя
+         */
+        int addMetric(MetricType type, int index);
+        /**
+         * Показатель пользователя, вычисляемый в конце каждого прогона
+         * @param function Функция от номера прогона и движка
+         * @return Номер показателя
+         */
+        int addMetric(const std::string &name, double (*function)(int testNumber, smpl::Engine *e));
+        /**
+         * Требуемая точность оценки показателя: полуширина доверительного интервала не больше
+         * absoluteHalfWidth и не больше relativeHalfWidth * |среднее|. Ноль - ограничение не задано
+         */
+        void setPrecision(int metric, double absoluteHalfWidth, double relativeHalfWidth);
+        /**
+         * Доверительная вероятность интервалов, по умолчанию 0.95
+         */
+        void setConfidence(double confidence);
+        /**
+         * Последовательное выполнение прогонов до достижения заданной точности всех показателей.
+         * Прогоны выполняются пачками по batchSize (параллельно, если задано несколько потоков), точность
+         * проверяется после каждой пачки. Число прогонов не зависит от количества потоков
+         * @param minReplications Минимальное число прогонов
+         * @param maxReplications Наибольшее число прогонов
+         * @return Число выполненных прогонов
+         */
+        int runUntilPrecise(int minReplications, int maxReplications, int batchSize,
+                std::pair<smpl::u64, smpl::transact_t> startEvent, time_t startTime,
+                time_t (*monitorTime)(smpl::transact_t));
+        /**
+         * Оценки показателей после последнего run, runUntilPrecise или runForked. Первые оценки - основные,
+         * по одной на показатель в порядке addMetric: с контрольной переменной, если она задана, иначе по
+         * антитетическим парам, если они включены, иначе обычные. Точность проверяется по основным оценкам.
+         * За ними следуют прочие оценки показателей с понижением дисперсии (поле method)
+         */
+        const std::vector<Estimate> &getEstimates() const;
+        /**
+         * Антитетические пары прогонов: прогон 2k + 1 использует те же потоки случайных чисел, что и прогон 2k,
+         * в антитетическом режиме (Engine::setAntithetic). Оценка по парам учитывает только полные пары,
+         * поэтому число прогонов следует задавать четным; runUntilPrecise округляет его вверх.
+         * Модель должна брать случайные числа из именованных потоков движка в одном и том же порядке
+         */
+        void setAntithetic(bool antithetic);
+        /**
+         * Контрольная переменная для показателя metric: показатель control с известным математическим
+         * ожиданием controlMean (например, среднее время обслуживания по заданному распределению).
+         * Оценка Y - beta (C - controlMean), коэффициент beta оценивается по тем же прогонам
+         */
+        void setControlVariate(int metric, int control, double controlMean);
+        /**
+         * Сравнение двух конфигураций на общих случайных числах: оценка разности a - b показателя metric по
+         * парам прогонов с одинаковыми номерами (используются прогоны последнего запуска каждой конфигурации).
+         * Для синхронизации обе конфигурации запускаются с одним зерном (setSeed), а каждый источник
+         * случайности модели берет значения из собственного именованного потока (Engine::getStream, VariateBuffer):
+         * тогда i-е требование источника получает одно и то же значение в обеих конфигурациях, даже если
+         * события происходят в другом порядке. Общий поток по умолчанию (Engine::iRandom, negExp) синхронизацию
+         * нарушает. Конфигурации могут различаться числом показателей, но metric должен обозначать в них
+         * один и тот же показатель
+         */
+        static Estimate compare(const MultiSMPL &a, const MultiSMPL &b, int metric);
+        /**
+         * Распределенное выполнение testsCount прогонов, результат совпадает с run. Координатор принимает
+         * TCP-соединения рабочих процессов (runWorker) на порту port и раздает им порции по unitSize прогонов.
+         * Рабочий процесс возвращает сводку каждого прогона (срезы монитора, показатели, отчет), координатор
+         * объединяет их по порядку номеров. Порция рабочего процесса, который отключился или молчит дольше
+         * setWorkerTimeout, передается другому; после трех неудач выполнение прерывается исключением.
+         * Рабочие процессы - та же программа с той же настройкой модели (обработчики, показатели, зерно)
+         * @param port Порт, 0 - свободный (подходит только для локальных рабочих процессов)
+         * @param localWorkers Количество рабочих процессов, запускаемых на этой машине через fork
+         */
+        void runDistributed(int testsCount, int port, int localWorkers, int unitSize,
+                std::pair<smpl::u64, smpl::transact_t> startEvent, time_t startTime,
+                time_t (*monitorTime)(smpl::transact_t));
+        /**
+         * Рабочий процесс: подключение к координатору host:port и выполнение порций до команды завершения.
+         * Прогоны порции выполняются параллельно по setThreadsCount. Подключение повторяется в течение
+         * setWorkerTimeout, затем выбрасывается исключение
+         * @return Количество выполненных порций
+         */
+        int runWorker(const std::string &host, int port, std::pair<smpl::u64, smpl::transact_t> startEvent,
+                time_t startTime, time_t (*monitorTime)(smpl::transact_t));
+        /**
+         * Время в секундах, после которого молчащий рабочий процесс считается отказавшим, по умолчанию 60
+         */
+        void setWorkerTimeout(int seconds);
+        /**
+         * Поток для сводки измерений в формате JSON, выводимой в конце run, runUntilPrecise и runForked:
+         * события каждого типа, гистограммы времени обработчиков в тактах, наибольшая длина списка событий
+         * и очередей, событий в секунду по прогонам. Измерения выполняются только в программе, собранной
+         * с SMPL_INSTRUMENT (см. Instrumentation.h). По умолчанию - std::cerr
+         */
+        void setProfileStream(std::ostream *out);
+        /**
+         * Двоичная трасса движков (Trace.h): поток worker пишет в файл prefix.worker, каждый прогон
+         * начинается записью TraceReplication с номером прогона. Просмотр, сравнение и воспроизведение
+         * трасс - программа tracetool. Пустой prefix выключает запись
+         * @param capacity Размер буфера в записях
+         * @param ring Режим самописца: в каждом файле остаются только последние capacity записей
+         */
+        void setTraceFile(const std::string &prefix, size_t capacity = 64 * 1024, bool ring = false);
+        /**
+         * Прогоны с общим разгоном. Один прогон с номером testsCount моделирует период разгона
+         * до момента warmupTime, статистика разгона сбрасывается, и полное состояние движка сохраняется.
+         * Затем testsCount прогонов продолжаются от этого состояния, каждый со своим подпотоком всех
+         * потоков случайных чисел (Engine::setSubstream). Состояние модели пользователя копируется
+         * обработчиком setForkHandler, который обязателен. Срезы монитора, снятые во время разгона, общие
+         * для всех прогонов. Номера прогонов - от 0 до testsCount включительно, поэтому testsCount должно быть
+         * меньше modelsCount из setForkHandler
+         */
+        void runForked(int testsCount, time_t warmupTime, std::pair<smpl::u64, smpl::transact_t> startEvent,
+                time_t startTime, time_t (*monitorTime)(smpl::transact_t));
+        /**
+         * Обработчик начала продолжения в runForked: копирует состояние модели пользователя прогона
+         * warmupTest (разгон) в прогон testNumber. Ссылки на потоки случайных чисел (VariateBuffer)
+         * должны быть заново получены от движка e, а выработанные заранее значения сброшены
+         * @param modelsCount Количество копий состояния модели (номеров прогонов) у пользователя:
+         * разгон получает номер testsCount, поэтому их нужно testsCount + 1
+         */
+        void setForkHandler(void (*handler)(int warmupTest, int testNumber, smpl::Engine *e), int modelsCount);
+        /**
+         * Автоматическое определение конца разгона по правилу MSER-5. На каждом срезе монитора показатель metric
+         * вычисляется на интервале от предыдущего среза; как только точка отсечения устанавливается в первой
+         * половине наблюдений, статистика прогона сбрасывается (Engine::resetStatistics).
+         * Требуется функция монитора
+         * @param metric Номер показателя (addMetric)
+         * @param minBatches Наименьшее число пачек по 5 срезов до принятия решения
+         * @param observationTime Если не 0, прогон завершается событием SystemEventEnd через это время после разгона
+         */
+        void setWarmupDetection(int metric, int minBatches = 10, time_t observationTime = 0);
+        /**
+         * Время окончания разгона в каждом прогоне последнего run или runUntilPrecise, -1 - разгон не обнаружен
+         */
+        const std::vector<time_t> &getWarmupTimes() const;
+        /**
+         * Запись срезов монитора в двоичный столбцовый файл (см. SnapshotStore.h) по мере выполнения прогонов.
+         * Столбцы: replication, snapshot, time, затем для каждого устройства <имя>.avgReserveTime,
+         * <имя>.avgPercentTime, для каждой очереди <имя>.avgLength, <имя>.avgWaitTime, <имя>.length.
+         * Пустой путь - запись выключена
+         * @param textSnapshots Выводить также усредненные срезы в текстовый и csv потоки
+         */
+        void setSnapshotFile(const std::string &path, bool textSnapshots = false);
+
         static std::string printCSVTable(const std::vector<std::vector<std::string>> &table);
         template<typename T>
         static std::string toCSVString(T x);
@@ -93,108 +672,711 @@ namespace multiSMPL {
         static std::vector<double> welch(const std::vector<double> &values, int w);
     };
 
-    MultiSMPL::MultiSMPL(
-            const std::map<smpl::u64, void (*)(std::pair<smpl::u64, smpl::transact_t>, int, smpl::Engine *)> &handlers,
-            Meta &DevicesAndQueuesNames, std::ostream *fileOutputStream = nullptr, std::ostream *csvOutputStream = nullptr) {
+    MultiSMPL::MultiSMPL(const HandlerTable &handlers, Meta &DevicesAndQueuesNames,
+            std::ostream *fileOutputStream = nullptr, std::ostream *csvOutputStream = nullptr) {
+        assert(handlers.has(SystemEventEnd));
         this->handlers = handlers;
         this->fileOutputStream = fileOutputStream;
         this->csvOutputStream = csvOutputStream;
         this->meta = DevicesAndQueuesNames;
+        this->eventListType = smpl::EventListHeap;
+        this->threadsCount = 1;
+        this->seed = 0;
+        this->confidence = 0.95;
+        this->warmupMetric = -1;
+        this->warmupMinBatches = 10;
+        this->observationTime = 0;
+        this->textSnapshots = true;
+        this->forkHandler = nullptr;
+        this->forkModelsCount = 0;
+        this->antithetic = false;
+        this->workerTimeout = 60;
+        this->profileStream = &std::cerr;
+        this->traceCapacity = 64 * 1024;
+        this->traceRing = false;
+    }
+
+    MultiSMPL::MultiSMPL(const std::map<smpl::u64, Handler> &handlers, Meta &DevicesAndQueuesNames,
+            std::ostream *fileOutputStream = nullptr, std::ostream *csvOutputStream = nullptr) {
+        for (std::map<smpl::u64, Handler>::const_iterator it = handlers.begin(); it != handlers.end(); it++) {
+            this->handlers.add(it->first, it->second);
+        }
+        assert(this->handlers.has(SystemEventEnd));
+        this->fileOutputStream = fileOutputStream;
+        this->csvOutputStream = csvOutputStream;
+        this->meta = DevicesAndQueuesNames;
+        this->eventListType = smpl::EventListHeap;
+        this->threadsCount = 1;
+        this->seed = 0;
+        this->confidence = 0.95;
+        this->warmupMetric = -1;
+        this->warmupMinBatches = 10;
+        this->observationTime = 0;
+        this->textSnapshots = true;
+        this->forkHandler = nullptr;
+        this->forkModelsCount = 0;
+        this->antithetic = false;
+        this->workerTimeout = 60;
+        this->profileStream = &std::cerr;
+        this->traceCapacity = 64 * 1024;
+        this->traceRing = false;
+    }
+
+    void MultiSMPL::setEventListType(smpl::EventListType type) {
+        eventListType = type;
+        engines.clear();
+    }
+
+    void MultiSMPL::setThreadsCount(int threadsCount) {
+        assert(threadsCount >= 0);
+        this->threadsCount = threadsCount;
+    }
+
+    void MultiSMPL::setSeed(smpl::u64 seed) {
+        this->seed = seed;
     }
 
     void MultiSMPL::run(int testsCount, std::pair<smpl::u64, smpl::transact_t> startEvent, time_t startTime,
             time_t (*monitorTime)(smpl::transact_t)) {
         assert(startTime >= 0);
+        assert(monitorTime == nullptr || handlers.has(SystemEventMonitor));
+        assert(handlers.has(startEvent.first));
 
-        std::vector<QueueInformation> queuesInformation((int)meta.queues.size());
-        std::vector<DeviceInformation> devicesInformation((int)meta.devices.size());
-        std::vector<double> monitoringTimes;
+        assert(warmupMetric < 0 || monitorTime != nullptr);
+        Accumulated accumulated;
+        startAccumulation(accumulated);
 
-        for (int i = 0; i < testsCount; i++) {
-            if (fileOutputStream != nullptr)
-                *fileOutputStream << std::endl << "Прогон номер " << i + 1 << std::endl << std::endl;
-            smpl::Engine * e = new smpl::Engine(this->fileOutputStream);
+        runReplications(0, testsCount, accumulated, startEvent, startTime, monitorTime);
+        updateEstimates(accumulated);
+        printResults(accumulated);
+    }
 
-            for (int i = 0; i < meta.queues.size(); i++) {
-                e->createQueue(meta.queues[i]);
-            }
+    int MultiSMPL::runUntilPrecise(int minReplications, int maxReplications, int batchSize,
+            std::pair<smpl::u64, smpl::transact_t> startEvent, time_t startTime,
+            time_t (*monitorTime)(smpl::transact_t)) {
+        assert(startTime >= 0);
+        assert(monitorTime == nullptr || handlers.has(SystemEventMonitor));
+        assert(handlers.has(startEvent.first));
+        assert(minReplications >= 2 && maxReplications >= minReplications && batchSize > 0);
+        if (antithetic) {
+            // Пары не разрываются между пачками
+            minReplications += minReplications % 2;
+            maxReplications += maxReplications % 2;
+            batchSize += batchSize % 2;
+        }
 
-            for (int i = 0; i < meta.devices.size(); i++) {
-                e->createDevice(meta.devices[i]);
+        assert(warmupMetric < 0 || monitorTime != nullptr);
+        Accumulated accumulated;
+        startAccumulation(accumulated);
+
+        runReplications(0, minReplications, accumulated, startEvent, startTime, monitorTime);
+        while (!updateEstimates(accumulated) && accumulated.replications < maxReplications) {
+            int count = std::min(batchSize, maxReplications - accumulated.replications);
+            runReplications(accumulated.replications, count, accumulated, startEvent, startTime, monitorTime);
+        }
+
+        printResults(accumulated);
+        return accumulated.replications;
+    }
+
+    void MultiSMPL::startAccumulation(Accumulated &accumulated) {
+        accumulated.queuesInformation.resize(meta.queues.size());
+        accumulated.devicesInformation.resize(devicesCount());
+        accumulated.metrics.resize(metrics.size());
+        accumulated.values.resize(metrics.size());
+        accumulated.replications = 0;
+        if (snapshotPath.empty())
+            return;
+
+        std::vector<std::string> columns;
+        columns.push_back("replication");
+        columns.push_back("snapshot");
+        columns.push_back("time");
+        for (size_t i = 0; i < devicesCount(); i++) {
+            columns.push_back(deviceName(i) + ".avgReserveTime");
+            columns.push_back(deviceName(i) + ".avgPercentTime");
+        }
+        for (size_t i = 0; i < meta.queues.size(); i++) {
+            columns.push_back(meta.queues[i] + ".avgLength");
+            columns.push_back(meta.queues[i] + ".avgWaitTime");
+            columns.push_back(meta.queues[i] + ".length");
+        }
+        accumulated.snapshots = std::make_shared<SnapshotWriter>(snapshotPath, columns);
+    }
+
+    void MultiSMPL::writeSnapshots(const ReplicationResult &result, int number, SnapshotWriter &writer) {
+        std::vector<double> row(writer.columns());
+        for (size_t j = 0; j < result.monitoringTimes.size(); j++) {
+            size_t c = 0;
+            row[c++] = number;
+            row[c++] = (double)j;
+            row[c++] = result.monitoringTimes[j];
+            for (size_t i = 0; i < result.devicesInformation.size(); i++) {
+                const DeviceInformation &d = result.devicesInformation[i];
+                row[c++] = j < d.avgReserveTime.size() ? d.avgReserveTime[j] : NAN;
+                row[c++] = j < d.avgPercentTime.size() ? d.avgPercentTime[j] : NAN;
+            }
+            for (size_t i = 0; i < result.queuesInformation.size(); i++) {
+                const QueueInformation &q = result.queuesInformation[i];
+                row[c++] = j < q.avgLength.size() ? q.avgLength[j] : NAN;
+                row[c++] = j < q.avgWaitTime.size() ? q.avgWaitTime[j] : NAN;
+                row[c++] = j < q.length.size() ? q.length[j] : NAN;
             }
+            writer.append(row);
+        }
+    }
 
-            e->schedule(startEvent.first, startTime, startEvent.second);
-            if (monitorTime != nullptr)
-                e->schedule(SystemEventMonitor, monitorTime(0), 0);
+    void MultiSMPL::setSnapshotFile(const std::string &path, bool textSnapshots) {
+        this->snapshotPath = path;
+        this->textSnapshots = path.empty() || textSnapshots;
+    }
 
-            int event = SystemEventEnd;
+    void MultiSMPL::runForked(int testsCount, time_t warmupTime, std::pair<smpl::u64, smpl::transact_t> startEvent,
+            time_t startTime, time_t (*monitorTime)(smpl::transact_t)) {
+        assert(startTime >= 0 && warmupTime >= startTime && testsCount > 0);
+        assert(monitorTime == nullptr || handlers.has(SystemEventMonitor));
+        assert(handlers.has(startEvent.first));
+        assert(warmupMetric < 0 || monitorTime != nullptr);
+        // Разгон моделируется прогоном с номером testsCount
+        assert(forkHandler != nullptr && testsCount < forkModelsCount);
+
+        ReplicationResult warmup;
+        smpl::Engine::Snapshot snapshot;
+        runWarmup(testsCount, warmup, snapshot, startEvent, startTime, warmupTime, monitorTime);
+
+        Fork fork = {&snapshot, &warmup, testsCount};
+        Accumulated accumulated;
+        startAccumulation(accumulated);
+        runReplications(0, testsCount, accumulated, startEvent, startTime, monitorTime, &fork);
+        updateEstimates(accumulated);
+        printResults(accumulated);
+    }
 
-            do {
+    void MultiSMPL::setForkHandler(void (*handler)(int, int, smpl::Engine *), int modelsCount) {
+        assert(handler != nullptr && modelsCount > 1);
+        forkHandler = handler;
+        forkModelsCount = modelsCount;
+    }
 
-                std::pair<smpl::u64, smpl::transact_t> top = e->cause();
+    void MultiSMPL::runReplications(int first, int count, Accumulated &accumulated,
+            std::pair<smpl::u64, smpl::transact_t> startEvent, time_t startTime,
+            time_t (*monitorTime)(smpl::transact_t), const Fork *fork) {
+        int threads = threadsCount ? threadsCount : ThreadPool::defaultThreadsCount();
+        if (threads <= 1 || count <= 1) {
+            for (int i = first; i < first + count; i++) {
+                ReplicationResult result;
+                runReplication(i, 0, result, fileOutputStream, startEvent, startTime, monitorTime, fork);
+                mergeReplication(result, accumulated);
+            }
+            flushTraces();
+            return;
+        }
 
-                event = top.first;
-                smpl::transact_t transact = top.second;
+        std::vector<ReplicationResult> results(count);
+        executeReplications(first, count, results, fileOutputStream != nullptr, startEvent, startTime, monitorTime,
+                fork);
 
-                if (event == SystemEventMonitor) {
+        for (int i = 0; i < count; i++) {
+            if (fileOutputStream != nullptr)
+                *fileOutputStream << results[i].log;
+            mergeReplication(results[i], accumulated);
+        }
+    }
 
-                    updateDevicesInformation(devicesInformation, e->getDevices(), e->getTime(), (int)transact);
-                    updateQueuesInformation(queuesInformation, e->getQueues(), e->getTime(), (int)transact);
+    void MultiSMPL::executeReplications(int first, int count, std::vector<ReplicationResult> &results, bool logs,
+            std::pair<smpl::u64, smpl::transact_t> startEvent, time_t startTime,
+            time_t (*monitorTime)(smpl::transact_t), const Fork *fork, int period,
+            const std::function<void(int, ReplicationResult &)> &finished) {
+        results.resize(count);
+        int threads = std::min(threadsCount ? threadsCount : ThreadPool::defaultThreadsCount(), count);
+        ThreadPool pool(std::max(threads, 1));
+        reserveWorkers(pool.size());
+        for (int i = 0; i < count; i++) {
+            pool.submitWithWorker([this, i, first, &results, logs, startEvent, startTime, monitorTime, fork, period,
+                    &finished](int worker) {
+                std::ostringstream log;
+                int number = first + i;
+                runReplication(number, worker, results[i], logs ? &log : nullptr, startEvent, startTime, monitorTime,
+                        fork, period > 0 ? number % period : number);
+                results[i].log = log.str();
+                if (finished)
+                    finished(number, results[i]);
+            });
+        }
+        pool.wait();
+        flushTraces();
+    }
 
-                    if (monitoringTimes.size() <= (int)transact)
-                        monitoringTimes.push_back(e->getTime());
-                    e->schedule(SystemEventMonitor, monitorTime(transact + 1), transact + 1);
-                }
-                handlers[event](top, i, e);
+    void MultiSMPL::setProfileStream(std::ostream *out) {
+        profileStream = out;
+    }
+
+#ifdef SMPL_INSTRUMENT
+    void MultiSMPL::printProfile(const Accumulated &accumulated) {
+        if (profileStream != nullptr)
+            accumulated.profile.writeJSON(*profileStream, meta.queues, accumulated.eventsPerSecond);
+    }
+#endif
+
+    void MultiSMPL::setTraceFile(const std::string &prefix, size_t capacity, bool ring) {
+        assert(capacity > 0);
+        tracePrefix = prefix;
+        traceCapacity = capacity;
+        traceRing = ring;
+        for (size_t i = 0; i < engines.size(); i++) {
+            if (engines[i])
+                engines[i]->setTrace(nullptr);
+        }
+        traces.clear();
+    }
 
-            } while (event != SystemEventEnd);
+    void MultiSMPL::reserveWorkers(int count) {
+        if (engines.size() < (size_t)count)
+            engines.resize(count);
+        if (!tracePrefix.empty() && traces.size() < (size_t)count)
+            traces.resize(count);
+    }
 
-            if (fileOutputStream != nullptr) e->monitor();
-            if (fileOutputStream != nullptr) e->report();
+    void MultiSMPL::flushTraces() {
+        for (size_t i = 0; i < traces.size(); i++) {
+            if (traces[i])
+                traces[i]->flush();
+        }
+    }
 
-            if (fileOutputStream != nullptr) {
-                for (int i = 0; i < 1000; i++)
-                    *fileOutputStream << "-";
-                *fileOutputStream << std::endl;
+    void MultiSMPL::setWorkerTimeout(int seconds) {
+        assert(seconds > 0);
+        workerTimeout = seconds;
+    }
+
+    void MultiSMPL::encodeHello(WireWriter &out, bool logs) const {
+        out.u8(WireHello);
+        out.i64((long long)seed);
+        out.i32((int)metrics.size());
+        out.i32((int)devicesCount());
+        out.i32((int)meta.queues.size());
+        out.u8(antithetic);
+        out.u8(logs);
+    }
+
+    void MultiSMPL::encodeResult(const ReplicationResult &result, WireWriter &out) {
+        out.doubles(result.monitoringTimes);
+        out.doubles(result.metrics);
+        out.i64(result.warmupTime);
+        out.string(result.log);
+        out.i32((int)result.devicesInformation.size());
+        for (size_t i = 0; i < result.devicesInformation.size(); i++) {
+            out.doubles(result.devicesInformation[i].avgReserveTime);
+            out.doubles(result.devicesInformation[i].avgPercentTime);
+        }
+        out.i32((int)result.queuesInformation.size());
+        for (size_t i = 0; i < result.queuesInformation.size(); i++) {
+            out.doubles(result.queuesInformation[i].avgWaitTime);
+            out.doubles(result.queuesInformation[i].avgLength);
+            out.doubles(result.queuesInformation[i].length);
+        }
+#ifdef SMPL_INSTRUMENT
+        const smpl::Profile &profile = result.profile;
+        out.i64((long long)profile.events);
+        out.i64((long long)profile.eventListHighWater);
+        out.f64(profile.seconds);
+        out.i32((int)profile.queueHighWater.size());
+        for (size_t i = 0; i < profile.queueHighWater.size(); i++) {
+            out.i64((long long)profile.queueHighWater[i]);
+        }
+        int types = 0;
+        profile.forEach([&types](unsigned long long, const smpl::Profile::EventStats &) {
+            types++;
+        });
+        out.i32(types);
+        profile.forEach([&out](unsigned long long id, const smpl::Profile::EventStats &stats) {
+            out.i64((long long)id);
+            out.i64((long long)stats.count);
+            out.i64((long long)stats.cycles);
+            for (int b = 0; b < smpl::Profile::Buckets; b++) {
+                out.i64((long long)stats.histogram[b]);
             }
+        });
+#endif
+    }
 
-            delete e;
+    bool MultiSMPL::decodeResult(WireReader &in, ReplicationResult &result) {
+        in.doubles(result.monitoringTimes);
+        in.doubles(result.metrics);
+        result.warmupTime = (time_t)in.i64();
+        result.log = in.string();
+        int devices = in.i32();
+        if (!in.ok() || devices < 0)
+            return false;
+        result.devicesInformation.resize(devices);
+        for (int i = 0; i < devices && in.ok(); i++) {
+            in.doubles(result.devicesInformation[i].avgReserveTime);
+            in.doubles(result.devicesInformation[i].avgPercentTime);
+        }
+        int queues = in.i32();
+        if (!in.ok() || queues < 0)
+            return false;
+        result.queuesInformation.resize(queues);
+        for (int i = 0; i < queues && in.ok(); i++) {
+            in.doubles(result.queuesInformation[i].avgWaitTime);
+            in.doubles(result.queuesInformation[i].avgLength);
+            in.doubles(result.queuesInformation[i].length);
         }
+#ifdef SMPL_INSTRUMENT
+        smpl::Profile &profile = result.profile;
+        profile.events = (unsigned long long)in.i64();
+        profile.eventListHighWater = (size_t)in.i64();
+        profile.seconds = in.f64();
+        int highWater = in.i32();
+        for (int i = 0; i < highWater && in.ok(); i++) {
+            profile.queueLength(i, (size_t)in.i64());
+        }
+        int types = in.i32();
+        for (int i = 0; i < types && in.ok(); i++) {
+            smpl::Profile::EventStats &stats = profile.stats((unsigned long long)in.i64());
+            stats.count = (unsigned long long)in.i64();
+            stats.cycles = (unsigned long long)in.i64();
+            for (int b = 0; b < smpl::Profile::Buckets; b++) {
+                stats.histogram[b] = (unsigned long long)in.i64();
+            }
+        }
+#endif
+        return in.ok();
+    }
 
-        for (int i = 0; i < meta.devices.size(); i++) {
-            if (fileOutputStream != nullptr)
-                *fileOutputStream << "Усредненные срезы параметров устройства " << meta.devices[i] << std::endl;
-            if (csvOutputStream != nullptr)
-                *csvOutputStream << "Усредненные срезы параметров устройства " << meta.devices[i] << std::endl;
+    void MultiSMPL::runDistributed(int testsCount, int port, int localWorkers, int unitSize,
+            std::pair<smpl::u64, smpl::transact_t> startEvent, time_t startTime,
+            time_t (*monitorTime)(smpl::transact_t)) {
+        assert(startTime >= 0);
+        assert(monitorTime == nullptr || handlers.has(SystemEventMonitor));
+        assert(handlers.has(startEvent.first));
+        assert(warmupMetric < 0 || monitorTime != nullptr);
+
+        Accumulated accumulated;
+        startAccumulation(accumulated);
+        distribute(testsCount, 0, fileOutputStream != nullptr, port, localWorkers, unitSize, startEvent, startTime,
+                monitorTime, [this, &accumulated](int, ReplicationResult &result) {
+                    if (fileOutputStream != nullptr)
+                        *fileOutputStream << result.log;
+                    mergeReplication(result, accumulated);
+                });
+        updateEstimates(accumulated);
+        printResults(accumulated);
+    }
+
+    void MultiSMPL::distribute(int tasks, int period, bool logs, int port, int localWorkers, int unitSize,
+            std::pair<smpl::u64, smpl::transact_t> startEvent, time_t startTime,
+            time_t (*monitorTime)(smpl::transact_t),
+            const std::function<void(int, ReplicationResult &)> &consume) {
+        assert(tasks > 0 && unitSize > 0 && localWorkers >= 0 && port >= 0);
+        const int MaxAttempts = 3;
+
+        struct Unit {
+            int first, count;
+            /** Получено результатов, неудачных попыток */
+            int received, attempts;
+        };
+
+        struct Peer {
+            int fd;
+            std::string input;
+            /** Выполняемая порция, -1 - нет */
+            int unit;
+            bool ready;
+            time_t lastActivity;
+        };
 
-            if (fileOutputStream != nullptr) {
-                *fileOutputStream << "Среднее время работы: " << std::endl;
-                *fileOutputStream << smpl::Engine::printTable(toStringTable(
-                        makeTable(monitoringTimes, division(devicesInformation[i].avgReserveTime,(double)testsCount) ),
-                        smpl::Engine::toString)) << std::endl;
+        int listener = net::listenTCP(port);
+        std::vector<pid_t> children;
+        for (int i = 0; i < localWorkers; i++) {
+            pid_t pid = fork();
+            if (pid == 0) {
+                close(listener);
+                int code = 0;
+                try {
+                    runWorker("127.0.0.1", port, startEvent, startTime, monitorTime);
+                } catch (const std::exception &ex) {
+                    std::cerr << ex.what() << std::endl;
+                    code = 1;
+                }
+                // Буферы потоков вывода принадлежат координатору
+                _exit(code);
             }
+            if (pid > 0)
+                children.push_back(pid);
+        }
+
+        std::vector<Unit> units;
+        std::deque<int> pending;
+        for (int first = 0; first < tasks; first += unitSize) {
+            Unit u = {first, std::min(unitSize, tasks - first), 0, 0};
+            pending.push_back((int)units.size());
+            units.push_back(u);
+        }
 
-            if (csvOutputStream != nullptr) {
-                *csvOutputStream << "Среднее время работы: " << std::endl;
-                *csvOutputStream << printCSVTable(toStringTable(
-                        makeTable(monitoringTimes, division(devicesInformation[i].avgReserveTime, (double)testsCount)),
-                        toCSVString)) << std::endl;
+        std::vector<ReplicationResult> results(tasks);
+        std::vector<char> received(tasks, 0);
+        std::vector<Peer> peers;
+        int next = 0;
+        time_t idleSince = time(nullptr);
+
+        WireWriter hello;
+        encodeHello(hello, logs);
+
+        // Отключение рабочего процесса, его незавершенная порция возвращается в очередь
+        std::function<void(size_t)> drop = [&](size_t k) {
+            Peer &peer = peers[k];
+            close(peer.fd);
+            if (peer.unit >= 0) {
+                Unit &u = units[peer.unit];
+                if (++u.attempts >= MaxAttempts)
+                    throw std::runtime_error("Порция прогонов с " + std::to_string(u.first + 1) +
+                                             " не выполнена после " + std::to_string(MaxAttempts) + " попыток");
+                pending.push_front(peer.unit);
             }
+            peers.erase(peers.begin() + k);
+        };
+
+        try {
+            while (next < tasks) {
+                std::vector<pollfd> fds(1);
+                fds[0].fd = listener;
+                fds[0].events = POLLIN;
+                for (size_t k = 0; k < peers.size(); k++) {
+                    pollfd p = {peers[k].fd, POLLIN, 0};
+                    fds.push_back(p);
+                }
+                poll(fds.data(), fds.size(), 1000);
+                time_t now = time(nullptr);
+
+                if (fds[0].revents & POLLIN) {
+                    int fd = accept(listener, nullptr, nullptr);
+                    if (fd >= 0) {
+                        int one = 1;
+                        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                        if (net::sendFrame(fd, hello.buffer())) {
+                            Peer peer = {fd, std::string(), -1, false, now};
+                            peers.push_back(peer);
+                        } else {
+                            close(fd);
+                        }
+                    }
+                }
+
+                // fds[k + 1] соответствует peers[k] до изменений списка на этой итерации
+                size_t polled = fds.size() - 1;
+                for (size_t k = std::min(polled, peers.size()); k-- > 0;) {
+                    if (!(fds[k + 1].revents & (POLLIN | POLLHUP | POLLERR)))
+                        continue;
+                    Peer &peer = peers[k];
+                    char buffer[64 * 1024];
+                    ssize_t n = recv(peer.fd, buffer, sizeof(buffer), 0);
+                    if (n <= 0) {
+                        drop(k);
+                        continue;
+                    }
+                    peer.input.append(buffer, (size_t)n);
+                    peer.lastActivity = now;
+
+                    std::string message;
+                    bool invalid = false, failed = false;
+                    while (!failed && net::takeFrame(peer.input, message, invalid)) {
+                        WireReader in(message);
+                        int type = in.u8();
+                        if (type == WireReady) {
+                            peer.ready = true;
+                        } else if (type == WireHeartbeat) {
+                            // Время активности уже обновлено при получении данных
+                        } else if (type == WireResult) {
+                            int number = in.i32();
+                            ReplicationResult result;
+                            if (!decodeResult(in, result) || number < 0 || number >= tasks) {
+                                failed = true;
+                                break;
+                            }
+                            if (received[number])
+                                continue;
+                            received[number] = 1;
+                            results[number] = std::move(result);
+                            Unit &u = units[number / unitSize];
+                            if (++u.received == u.count && peer.unit == number / unitSize)
+                                peer.unit = -1;
+                        } else {
+                            if (type == WireError)
+                                std::cerr << "Рабочий процесс отклонен: " << in.string() << std::endl;
+                            failed = true;
+                        }
+                    }
+                    if (failed || invalid)
+                        drop(k);
+                }
+
+                for (size_t k = peers.size(); k-- > 0;) {
+                    if (peers[k].unit >= 0 && now - peers[k].lastActivity > workerTimeout)
+                        drop(k);
+                }
 
-            if (fileOutputStream != nullptr) {
-                *fileOutputStream << "Средний процент работы: " << std::endl;
-                *fileOutputStream << smpl::Engine::printTable(toStringTable(
-                        makeTable(monitoringTimes, division(devicesInformation[i].avgPercentTime, (double)testsCount)),
-                        smpl::Engine::toString)) << std::endl;
+                while (next < tasks && received[next]) {
+                    consume(next, results[next]);
+                    results[next] = ReplicationResult();
+                    next++;
+                }
+
+                for (size_t k = peers.size(); k-- > 0 && !pending.empty();) {
+                    Peer &peer = peers[k];
+                    if (!peer.ready || peer.unit >= 0)
+                        continue;
+                    int unit = pending.front();
+                    pending.pop_front();
+                    // Порция могла быть получена целиком от отключившегося процесса
+                    if (units[unit].received == units[unit].count)
+                        continue;
+                    WireWriter message;
+                    message.u8(WireUnit);
+                    message.i32(units[unit].first);
+                    message.i32(units[unit].count);
+                    message.i32(period);
+                    peer.unit = unit;
+                    peer.lastActivity = now;
+                    if (!net::sendFrame(peer.fd, message.buffer()))
+                        drop(k);
+                }
+
+                if (!peers.empty()) {
+                    idleSince = now;
+                } else if (now - idleSince > workerTimeout) {
+                    throw std::runtime_error("Нет подключенных рабочих процессов");
+                }
             }
+        } catch (...) {
+            for (size_t k = 0; k < peers.size(); k++) {
+                close(peers[k].fd);
+            }
+            close(listener);
+            for (size_t i = 0; i < children.size(); i++) {
+                kill(children[i], SIGTERM);
+                waitpid(children[i], nullptr, 0);
+            }
+            throw;
+        }
+
+        WireWriter stop;
+        stop.u8(WireStop);
+        for (size_t k = 0; k < peers.size(); k++) {
+            net::sendFrame(peers[k].fd, stop.buffer());
+            close(peers[k].fd);
+        }
+        close(listener);
+        for (size_t i = 0; i < children.size(); i++) {
+            waitpid(children[i], nullptr, 0);
+        }
+    }
+
+    int MultiSMPL::runWorker(const std::string &host, int port, std::pair<smpl::u64, smpl::transact_t> startEvent,
+            time_t startTime, time_t (*monitorTime)(smpl::transact_t)) {
+        assert(monitorTime == nullptr || handlers.has(SystemEventMonitor));
+        assert(handlers.has(startEvent.first));
+        int fd;
+        time_t deadline = time(nullptr) + workerTimeout;
+        while ((fd = net::connectTCP(host, port)) < 0) {
+            if (time(nullptr) >= deadline)
+                throw std::runtime_error("Не удалось подключиться к координатору " + host + ":" + std::to_string(port));
+            usleep(100 * 1000);
+        }
 
-            if (csvOutputStream != nullptr) {
-                *csvOutputStream << "Средний процент работы: " << std::endl;
-                *csvOutputStream << printCSVTable(toStringTable(
-                        makeTable(monitoringTimes, division(devicesInformation[i].avgPercentTime, (double)testsCount)),
-                        toCSVString)) << std::endl;
+        WireWriter expected;
+        encodeHello(expected, false);
+        bool logs = false;
+        int done = 0;
+        std::string message;
+        while (net::readFrame(fd, message)) {
+            WireReader in(message);
+            int type = in.u8();
+            if (type == WireHello) {
+                // Признак отчетов (последний байт) не входит в сравнение
+                logs = !message.empty() && message.back() != 0;
+                WireWriter reply;
+                if (message.size() == expected.buffer().size() &&
+                        message.compare(0, message.size() - 1, expected.buffer(), 0, message.size() - 1) == 0) {
+                    reply.u8(WireReady);
+                } else {
+                    reply.u8(WireError);
+                    reply.string("зерно, показатели, устройства или очереди модели не совпадают с координатором");
+                }
+                if (!net::sendFrame(fd, reply.buffer()) || reply.buffer()[0] == WireError)
+                    break;
+            } else if (type == WireUnit) {
+                int first = in.i32();
+                int count = in.i32();
+                int period = in.i32();
+                if (!in.ok() || count <= 0)
+                    break;
+                // Результат каждого прогона отправляется сразу, а пока порция выполняется, координатор
+                // периодически получает WireHeartbeat: долгая порция не принимается за отказ
+                std::mutex sending;
+                std::condition_variable finishedUnit;
+                bool sent = true, unitDone = false;
+                std::thread heartbeat([&]() {
+                    std::chrono::seconds interval(std::max(1, workerTimeout / 4));
+                    WireWriter beat;
+                    beat.u8(WireHeartbeat);
+                    std::unique_lock<std::mutex> lock(sending);
+                    while (!finishedUnit.wait_for(lock, interval, [&unitDone] { return unitDone; })) {
+                        if (sent)
+                            sent = net::sendFrame(fd, beat.buffer());
+                    }
+                });
+                std::vector<ReplicationResult> results;
+                executeReplications(first, count, results, logs, startEvent, startTime, monitorTime, nullptr, period,
+                        [&](int number, ReplicationResult &result) {
+                    WireWriter reply;
+                    reply.u8(WireResult);
+                    reply.i32(number);
+                    encodeResult(result, reply);
+                    result = ReplicationResult();
+                    std::lock_guard<std::mutex> lock(sending);
+                    if (sent)
+                        sent = net::sendFrame(fd, reply.buffer());
+                });
+                {
+                    std::lock_guard<std::mutex> lock(sending);
+                    unitDone = true;
+                }
+                finishedUnit.notify_one();
+                heartbeat.join();
+                if (!sent)
+                    break;
+                done++;
+            } else {
+                break;
             }
         }
+        close(fd);
+        return done;
+    }
+
+    void MultiSMPL::printResults(const Accumulated &accumulated) {
+        // Ошибка записи срезов сообщается здесь, а не теряется в деструкторе
+        if (accumulated.snapshots)
+            accumulated.snapshots->flush();
+        if (textSnapshots)
+            printSnapshotTables(accumulated);
+        printWarmup(accumulated);
+        printEstimates();
+        SMPL_PROFILE(printProfile(accumulated));
+    }
+
+    void MultiSMPL::printSnapshotTables(const Accumulated &accumulated) {
+        double n = (double)accumulated.replications;
+        for (size_t i = 0; i < devicesCount(); i++) {
+            if (fileOutputStream != nullptr)
+                *fileOutputStream << "Усредненные срезы параметров устройства " << deviceName(i) << std::endl;
+            if (csvOutputStream != nullptr)
+                *csvOutputStream << "Усредненные срезы параметров устройства " << deviceName(i) << std::endl;
+
+            printSeries("Среднее время работы: ", accumulated.monitoringTimes, accumulated.devicesInformation[i].avgReserveTime, n);
+            printSeries("Средний процент работы: ", accumulated.monitoringTimes, accumulated.devicesInformation[i].avgPercentTime, n);
+        }
 
         for (int i = 0; i < meta.queues.size(); i++) {
             if (fileOutputStream != nullptr)
@@ -202,69 +1384,595 @@ namespace multiSMPL {
             if (csvOutputStream != nullptr)
                 *csvOutputStream << "Усредненные срезы параметров очереди " << meta.queues[i] << std::endl;
 
-            if (fileOutputStream != nullptr) {
-                *fileOutputStream << "Средняя длина очереди: " << std::endl;
-                *fileOutputStream << smpl::Engine::printTable(toStringTable(
-                        makeTable(monitoringTimes, division(queuesInformation[i].avgLength, (double)testsCount)),
-                        smpl::Engine::toString)) << std::endl;
+            printSeries("Средняя длина очереди: ", accumulated.monitoringTimes, accumulated.queuesInformation[i].avgLength, n);
+            printSeries("Время ожидания: ", accumulated.monitoringTimes, accumulated.queuesInformation[i].avgWaitTime, n);
+            printSeries("Длина очереди: ", accumulated.monitoringTimes, accumulated.queuesInformation[i].length, n);
+        }
+    }
+
+    void MultiSMPL::printSeries(const char *title, const std::vector<double> &times, const std::vector<double> &values,
+            double divisor) {
+        assert(times.size() == values.size());
+        if (fileOutputStream != nullptr) {
+            *fileOutputStream << title << std::endl;
+            {
+                smpl::OutputBuffer out(*fileOutputStream);
+                smpl::writeTable(out, times.size(), 2, [&times, &values, divisor](size_t i, smpl::TableRow &row) {
+                    for (size_t j = 0; j < times.size(); j++) {
+                        double x = i == 0 ? times[j] : values[j] / divisor;
+                        if (!__isnan(x)) {
+                            row.set(j, x);
+                        } else {
+                            row[j] = "-";
+                        }
+                    }
+                });
             }
+            *fileOutputStream << std::endl;
+        }
 
-            if (csvOutputStream != nullptr) {
-                *csvOutputStream << "Средняя длина очереди: " << std::endl;
-                *csvOutputStream << printCSVTable(
-                        toStringTable(
-                                makeTable(monitoringTimes, division(queuesInformation[i].avgLength, (double)testsCount)),
-                                toCSVString)) << std::endl;
+        if (csvOutputStream != nullptr) {
+            *csvOutputStream << title << std::endl;
+            {
+                smpl::OutputBuffer out(*csvOutputStream);
+                char buf[smpl::format::MaxFixedLength];
+                for (int i = 0; i < 2; i++) {
+                    for (size_t j = 0; j < times.size(); j++) {
+                        double x = i == 0 ? times[j] : values[j] / divisor;
+                        if (!__isnan(x)) {
+                            out.write(buf, smpl::format::fixed(buf, x, 5, ','));
+                        } else {
+                            out.put('-');
+                        }
+                        out.put(';');
+                    }
+                    out.put('\n');
+                }
             }
+            *csvOutputStream << std::endl;
+        }
+    }
 
-            if (fileOutputStream != nullptr) {
-                *fileOutputStream << "Время ожидания: " << std::endl;
-                *fileOutputStream << smpl::Engine::printTable(toStringTable(
-                        makeTable(monitoringTimes, division(queuesInformation[i].avgWaitTime, (double)testsCount)),
-                        smpl::Engine::toString)) << std::endl;
+    void MultiSMPL::printWarmup(const Accumulated &accumulated) {
+        if (warmupMetric < 0)
+            return;
+        Summary summary;
+        int missed = 0;
+        for (size_t i = 0; i < accumulated.warmupTimes.size(); i++) {
+            if (accumulated.warmupTimes[i] >= 0) {
+                summary.add((double)accumulated.warmupTimes[i]);
+            } else {
+                missed++;
             }
+        }
 
-            if (csvOutputStream != nullptr) {
-                *csvOutputStream << "Время ожидания: " << std::endl;
-                *csvOutputStream << printCSVTable(
-                        toStringTable(makeTable(
-                                monitoringTimes,division(queuesInformation[i].avgWaitTime, (double)testsCount)),
-                                        toCSVString)) << std::endl;
+        std::vector<std::vector<std::string>> table(2);
+        table[0].push_back("Показатель разгона");
+        table[0].push_back("Ср.время разгона");
+        table[0].push_back("Прогонов без разгона");
+        table[1].push_back(metrics[warmupMetric].name);
+        table[1].push_back(summary.count() ? smpl::Engine::toString(summary.getMean()) : "-");
+        table[1].push_back(smpl::Engine::toString(missed));
+
+        if (fileOutputStream != nullptr) {
+            *fileOutputStream << "Разгон (MSER-5):" << std::endl;
+            *fileOutputStream << smpl::Engine::printTable(table) << std::endl;
+        }
+        if (csvOutputStream != nullptr) {
+            table[1][1] = summary.count() ? toCSVString(summary.getMean()) : "-";
+            *csvOutputStream << "Разгон (MSER-5): " << std::endl;
+            *csvOutputStream << printCSVTable(table) << std::endl;
+        }
+    }
+
+    int MultiSMPL::addMetric(MetricType type, int index) {
+        assert(type != MetricUser);
+        Metric m;
+        m.type = type;
+        m.index = index;
+        m.function = nullptr;
+        m.absolute = m.relative = 0;
+        m.control = -1;
+        m.controlMean = 0;
+        switch (type) {
+            case MetricDeviceUtilization:
+                assert(index >= 0 && index < (int)meta.devices.size());
+                m.name = "% зан.вр. " + meta.devices[index];
+                break;
+            case MetricDeviceReserveTime:
+                assert(index >= 0 && index < (int)meta.devices.size());
+                m.name = "Ср.вр.зан. " + meta.devices[index];
+                break;
+            case MetricQueueWaitTime:
+                assert(index >= 0 && index < (int)meta.queues.size());
+                m.name = "Ср.вр.ожидания " + meta.queues[index];
+                break;
+            case MetricStorageUtilization:
+                assert(index >= 0 && index < (int)meta.storages.size());
+                m.name = "% зан. " + meta.storages[index];
+                break;
+            case MetricVariableMean:
+                assert(index >= 0 && index < (int)meta.variables.size());
+                m.name = "Среднее " + meta.variables[index];
+                break;
+            default:
+                assert(index >= 0 && index < (int)meta.queues.size());
+                m.name = "Ср.длина " + meta.queues[index];
+                break;
+        }
+        metrics.push_back(m);
+        return (int)metrics.size() - 1;
+    }
+
+    int MultiSMPL::addMetric(const std::string &name, double (*function)(int, smpl::Engine *)) {
+        assert(function != nullptr);
+        Metric m;
+        m.name = name;
+        m.type = MetricUser;
+        m.index = -1;
+        m.function = function;
+        m.absolute = m.relative = 0;
+        m.control = -1;
+        m.controlMean = 0;
+        metrics.push_back(m);
+        return (int)metrics.size() - 1;
+    }
+
+    void MultiSMPL::setPrecision(int metric, double absoluteHalfWidth, double relativeHalfWidth) {
+        assert(metric >= 0 && metric < (int)metrics.size());
+        assert(absoluteHalfWidth >= 0 && relativeHalfWidth >= 0);
+        metrics[metric].absolute = absoluteHalfWidth;
+        metrics[metric].relative = relativeHalfWidth;
+    }
+
+    void MultiSMPL::setConfidence(double confidence) {
+        assert(confidence > 0 && confidence < 1);
+        this->confidence = confidence;
+    }
+
+    const std::vector<Estimate> &MultiSMPL::getEstimates() const {
+        return estimates;
+    }
+
+    void MultiSMPL::setAntithetic(bool antithetic) {
+        this->antithetic = antithetic;
+    }
+
+    void MultiSMPL::setControlVariate(int metric, int control, double controlMean) {
+        assert(metric >= 0 && metric < (int)metrics.size());
+        assert(control >= -1 && control < (int)metrics.size() && control != metric);
+        metrics[metric].control = control;
+        metrics[metric].controlMean = controlMean;
+    }
+
+    Estimate MultiSMPL::compare(const MultiSMPL &a, const MultiSMPL &b, int metric) {
+        assert(metric >= 0 && metric < (int)a.metricValues.size() && metric < (int)b.metricValues.size());
+        const std::vector<double> &x = a.metricValues[metric], &y = b.metricValues[metric];
+        std::vector<double> differences;
+        for (size_t i = 0; i < x.size() && i < y.size(); i++) {
+            differences.push_back(x[i] - y[i]);
+        }
+
+        // В антитетическом режиме независимы только пары прогонов
+        bool pairs = a.antithetic && b.antithetic;
+        Summary summary = pairs ? Summary::ofPairs(differences) : Summary::ofDifferences(x, y);
+        Metric m = a.metrics[metric];
+        m.name = "Разность " + m.name;
+        return a.makeEstimate(m, pairs ? "разность, ОСЧ, антитет." : "разность, ОСЧ", summary,
+                pairs ? summary.count() * 2 : summary.count());
+    }
+
+    std::vector<double> MultiSMPL::pairMeans(const std::vector<double> &values) {
+        std::vector<double> result;
+        for (size_t i = 0; i + 1 < values.size(); i += 2) {
+            result.push_back((values[i] + values[i + 1]) / 2);
+        }
+        return result;
+    }
+
+    Estimate MultiSMPL::makeEstimate(const Metric &metric, const std::string &method, const Summary &summary,
+            int replications, int estimated) const {
+        Estimate est;
+        est.name = metric.name;
+        est.method = method;
+        est.mean = summary.getMean();
+        est.halfWidth = summary.halfWidth(confidence, estimated);
+        est.replications = replications;
+        est.reached = (metric.absolute <= 0 || est.halfWidth <= metric.absolute) &&
+                      (metric.relative <= 0 || est.halfWidth <= metric.relative * fabs(est.mean));
+        return est;
+    }
+
+    void MultiSMPL::metricTotals(const Metric &metric, int number, smpl::Engine *e, double &sum, double &weight) {
+        switch (metric.type) {
+            case MetricDeviceUtilization: {
+                smpl::Device *d = e->getDevices()[metric.index];
+                sum = d->busyTime() * 100.0;
+                weight = (double)e->getStatisticsTime();
+                break;
             }
+            case MetricDeviceReserveTime: {
+                smpl::Device *d = e->getDevices()[metric.index];
+                sum = (double)d->timeUsedSum;
+                weight = (double)d->transactCount;
+                break;
+            }
+            case MetricQueueWaitTime: {
+                smpl::Queue *q = e->getQueues()[metric.index];
+                sum = (double)q->waitTimeSum;
+                weight = (double)q->count;
+                break;
+            }
+            case MetricQueueLength: {
+                smpl::Queue *q = e->getQueues()[metric.index];
+                sum = (double)q->lengthTimeSum();
+                weight = (double)e->getStatisticsTime();
+                break;
+            }
+            case MetricStorageUtilization: {
+                smpl::Storage *st = e->getStorages()[metric.index];
+                sum = st->occupancyTimeSum() * 100.0 / st->capacity;
+                weight = (double)e->getStatisticsTime();
+                break;
+            }
+            case MetricVariableMean: {
+                sum = e->variable(metric.index).integral;
+                weight = (double)e->getStatisticsTime();
+                break;
+            }
+            default:
+                sum = metric.function(number, e);
+                weight = 0;
+                break;
+        }
+    }
 
-            if (fileOutputStream != nullptr) {
-                *fileOutputStream << "Длина очереди: " << std::endl;
-                *fileOutputStream << smpl::Engine::printTable(toStringTable(
-                        makeTable(monitoringTimes, division(queuesInformation[i].length, (double)testsCount)),
-                        smpl::Engine::toString)) << std::endl;
+    double MultiSMPL::metricValue(const Metric &metric, int number, smpl::Engine *e) {
+        double sum, weight;
+        metricTotals(metric, number, e, sum, weight);
+        if (metric.type == MetricUser)
+            return sum;
+        return weight ? sum / weight : 0;
+    }
+
+    void MultiSMPL::setWarmupDetection(int metric, int minBatches, time_t observationTime) {
+        assert(metric >= 0 && metric < (int)metrics.size());
+        assert(minBatches >= 2 && observationTime >= 0);
+        this->warmupMetric = metric;
+        this->warmupMinBatches = minBatches;
+        this->observationTime = observationTime;
+    }
+
+    const std::vector<time_t> &MultiSMPL::getWarmupTimes() const {
+        return warmupTimes;
+    }
+
+    bool MultiSMPL::updateEstimates(const Accumulated &accumulated) {
+        warmupTimes = accumulated.warmupTimes;
+        metricValues = accumulated.values;
+        bool reached = true;
+        estimates.resize(metrics.size());
+        std::vector<Estimate> additional;
+        for (size_t i = 0; i < metrics.size(); i++) {
+            const Metric &metric = metrics[i];
+            const Summary &summary = accumulated.metrics[i];
+            Estimate plain = makeEstimate(metric, "обычная", summary, summary.count());
+            estimates[i] = plain;
+            if (antithetic) {
+                Summary pairs = Summary::ofPairs(accumulated.values[i]);
+                estimates[i] = makeEstimate(metric, "антитет.", pairs, pairs.count() * 2);
+            }
+            if (metric.control >= 0) {
+                if (estimates[i].method != plain.method)
+                    additional.push_back(estimates[i]);
+                // Контрольная переменная применяется к средним пар, если пары включены
+                const std::vector<double> &y = accumulated.values[i], &c = accumulated.values[metric.control];
+                Summary controlled = antithetic ?
+                        Summary::ofControlled(pairMeans(y), pairMeans(c), metric.controlMean) :
+                        Summary::ofControlled(y, c, metric.controlMean);
+                estimates[i] = makeEstimate(metric, antithetic ? "контр., антитет." : "контр.", controlled,
+                        antithetic ? controlled.count() * 2 : controlled.count(), 1);
+            }
+            if (estimates[i].method != plain.method)
+                additional.push_back(plain);
+            reached = reached && estimates[i].reached;
+        }
+        estimates.insert(estimates.end(), additional.begin(), additional.end());
+        return reached;
+    }
+
+    void MultiSMPL::printEstimates() {
+        if (estimates.empty())
+            return;
+
+        std::vector<std::vector<std::string>> table(1);
+        table[0].push_back("Показатель");
+        table[0].push_back("Оценка");
+        table[0].push_back("Среднее");
+        table[0].push_back("Полуширина");
+        table[0].push_back("Нижняя граница");
+        table[0].push_back("Верхняя граница");
+        table[0].push_back("Прогонов");
+        table[0].push_back("Точность");
+        std::vector<std::vector<std::string>> csvTable = table;
+
+        for (size_t i = 0; i < estimates.size(); i++) {
+            const Estimate &est = estimates[i];
+            double values[] = {est.mean, est.halfWidth, est.mean - est.halfWidth, est.mean + est.halfWidth};
+            std::vector<std::string> row(1, est.name), csvRow(1, est.name);
+            row.push_back(est.method);
+            csvRow.push_back(est.method);
+            for (int j = 0; j < 4; j++) {
+                row.push_back(std::isfinite(values[j]) ? smpl::Engine::toString(values[j]) : "-");
+                csvRow.push_back(std::isfinite(values[j]) ? toCSVString(values[j]) : "-");
+            }
+            row.push_back(smpl::Engine::toString(est.replications));
+            csvRow.push_back(row.back());
+            row.push_back(est.reached ? "да" : "нет");
+            csvRow.push_back(row.back());
+            table.push_back(row);
+            csvTable.push_back(csvRow);
+        }
+
+        if (fileOutputStream != nullptr) {
+            *fileOutputStream << "Доверительные интервалы (" << confidence * 100 << "%):" << std::endl;
+            *fileOutputStream << smpl::Engine::printTable(table) << std::endl;
+        }
+        if (csvOutputStream != nullptr) {
+            *csvOutputStream << "Доверительные интервалы: " << std::endl;
+            *csvOutputStream << printCSVTable(csvTable) << std::endl;
+        }
+    }
+
+    smpl::Engine *MultiSMPL::workerEngine(int worker, std::ostream *out) {
+        if (engines.size() <= (size_t)worker)
+            engines.resize(worker + 1);
+        std::unique_ptr<smpl::Engine> &engine = engines[worker];
+        if (!engine) {
+            engine.reset(new smpl::Engine(out, eventListType));
+            for (size_t i = 0; i < meta.queues.size(); i++) {
+                engine->createQueue(meta.queues[i], i < meta.queueDisciplines.size() ? meta.queueDisciplines[i] : smpl::QueueOrdered);
+            }
+
+            for (int i = 0; i < meta.devices.size(); i++) {
+                engine->createDevice(meta.devices[i]);
+            }
+
+            assert(meta.storageCapacities.size() == meta.storages.size());
+            for (size_t i = 0; i < meta.storages.size(); i++) {
+                engine->createStorage(meta.storages[i], meta.storageCapacities[i]);
+            }
+
+            for (size_t i = 0; i < meta.variables.size(); i++) {
+                engine->createVariable(meta.variables[i]);
+            }
+        } else {
+            engine->restart();
+            engine->setOutputStream(out);
+        }
+        if (!tracePrefix.empty()) {
+            if (traces.size() <= (size_t)worker)
+                traces.resize(worker + 1);
+            if (!traces[worker])
+                traces[worker].reset(new smpl::TraceWriter(tracePrefix + "." + std::to_string(worker),
+                        traceCapacity, traceRing));
+            engine->setTrace(traces[worker].get());
+        }
+        return engine.get();
+    }
+
+    void MultiSMPL::runWarmup(int number, ReplicationResult &result, smpl::Engine::Snapshot &snapshot,
+            std::pair<smpl::u64, smpl::transact_t> startEvent, time_t startTime, time_t warmupTime,
+            time_t (*monitorTime)(smpl::transact_t)) {
+        result.queuesInformation.resize(meta.queues.size());
+        result.devicesInformation.resize(devicesCount());
+
+        if (fileOutputStream != nullptr)
+            *fileOutputStream << std::endl << "Разгон до момента " << warmupTime << std::endl << std::endl;
+        smpl::Engine * e = workerEngine(0, fileOutputStream);
+        e->setSeed(seed, number);
+        e->setAntithetic(false);
+        if (e->getTrace() != nullptr)
+            e->getTrace()->record(smpl::TraceReplication, e->getTime(), 0, number, number, 0);
+
+        e->schedule(startEvent.first, startTime, startEvent.second);
+        if (monitorTime != nullptr)
+            e->schedule(SystemEventMonitor, monitorTime(0), 0);
+        e->schedule(SystemEventWarmupEnd, warmupTime, 0);
+
+        while (true) {
+            std::pair<smpl::u64, smpl::transact_t> top = e->cause();
+            if (top.first == SystemEventWarmupEnd)
+                break;
+            // Модель завершилась раньше конца разгона
+            assert(top.first != SystemEventEnd);
+
+            if (top.first == SystemEventMonitor) {
+                recordSnapshot(result, e, (int)top.second);
+                e->schedule(SystemEventMonitor, monitorTime(top.second + 1), top.second + 1);
+            }
+            handlers.dispatch(top, number, e);
+        }
+
+        e->resetStatistics();
+        e->save(snapshot);
+    }
+
+    void MultiSMPL::recordSnapshot(ReplicationResult &result, smpl::Engine *e, int number) {
+        updateDevicesInformation(result.devicesInformation, e->getDevices(), e->getStatisticsTime(), number);
+        for (size_t i = 0; i < meta.storages.size(); i++) {
+            updateStorageInformation(result.devicesInformation[meta.devices.size() + i], e->getStorages()[i],
+                    e->getStatisticsTime(), number);
+        }
+        updateQueuesInformation(result.queuesInformation, e->getQueues(), e->getStatisticsTime(), number);
+        if (result.monitoringTimes.size() <= number)
+            result.monitoringTimes.push_back(e->getTime());
+    }
+
+    void MultiSMPL::runReplication(int number, int worker, ReplicationResult &result, std::ostream *out,
+            std::pair<smpl::u64, smpl::transact_t> startEvent, time_t startTime,
+            time_t (*monitorTime)(smpl::transact_t), const Fork *fork, int replication) {
+        result.queuesInformation.resize(meta.queues.size());
+        result.devicesInformation.resize(devicesCount());
+        if (replication < 0)
+            replication = number;
+
+        if (out != nullptr)
+            *out << std::endl << "Прогон номер " << number + 1 << std::endl << std::endl;
+        smpl::Engine * e = workerEngine(worker, out);
+        if (e->getTrace() != nullptr)
+            e->getTrace()->record(smpl::TraceReplication, 0, worker, number, replication, 0);
+
+        if (fork == nullptr) {
+            // Антитетическая пара разделяет номер потоков случайных чисел
+            e->setSeed(seed, antithetic ? replication / 2 : replication);
+            e->setAntithetic(antithetic && replication % 2 == 1);
+            e->schedule(startEvent.first, startTime, startEvent.second);
+            if (monitorTime != nullptr)
+                e->schedule(SystemEventMonitor, monitorTime(0), 0);
+        } else {
+            e->restore(*fork->snapshot);
+            // Подпоток 0 израсходован разгоном
+            e->setSubstream((antithetic ? replication / 2 : replication) + 1);
+            e->setAntithetic(antithetic && replication % 2 == 1);
+            result.devicesInformation = fork->warmup->devicesInformation;
+            result.queuesInformation = fork->warmup->queuesInformation;
+            result.monitoringTimes = fork->warmup->monitoringTimes;
+            forkHandler(fork->warmupTest, number, e);
+        }
+
+        SMPL_PROFILE(std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now());
+        result.warmupTime = -1;
+        WarmupDetector detector;
+        double lastSum = 0, lastWeight = 0;
+
+        int event = SystemEventEnd;
+
+        do {
+
+            std::pair<smpl::u64, smpl::transact_t> top = e->cause();
+
+            event = top.first;
+            smpl::transact_t transact = top.second;
+
+            if (event == SystemEventMonitor) {
+
+                recordSnapshot(result, e, (int)transact);
+
+                if (warmupMetric >= 0 && result.warmupTime < 0) {
+                    const Metric &metric = metrics[warmupMetric];
+                    double sum, weight;
+                    metricTotals(metric, number, e, sum, weight);
+                    if (metric.type == MetricUser) {
+                        detector.add(sum);
+                    } else {
+                        // Значение на интервале между срезами, а не накопленное среднее
+                        detector.add(weight > lastWeight ? (sum - lastSum) / (weight - lastWeight) : 0);
+                    }
+                    lastSum = sum;
+                    lastWeight = weight;
+                    if (detector.settled(warmupMinBatches)) {
+                        // Накопленные счетчики нельзя откатить к точке отсечения, поэтому
+                        // статистика сбрасывается в момент обнаружения (с запасом)
+                        e->resetStatistics();
+                        result.warmupTime = e->getTime();
+                        if (observationTime > 0)
+                            e->schedule(SystemEventEnd, observationTime, 0);
+                    }
+                }
+
+                e->schedule(SystemEventMonitor, monitorTime(transact + 1), transact + 1);
             }
+            SMPL_PROFILE(unsigned long long handlerStart = smpl::Profile::cycles());
+            handlers.dispatch(top, number, e);
+            SMPL_PROFILE(e->getProfile().handlerTime(top.first, smpl::Profile::cycles() - handlerStart));
+
+        } while (event != SystemEventEnd);
+
+#ifdef SMPL_INSTRUMENT
+        result.profile = e->getProfile();
+        result.profile.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+#endif
+
+        result.metrics.resize(metrics.size());
+        for (size_t i = 0; i < metrics.size(); i++) {
+            result.metrics[i] = metricValue(metrics[i], number, e);
+        }
+
+        if (out != nullptr) e->monitor();
+        if (out != nullptr) e->report();
+
+        if (out != nullptr) {
+            for (int i = 0; i < 1000; i++)
+                *out << "-";
+            *out << std::endl;
+        }
+    }
+
+    void MultiSMPL::mergeReplication(const ReplicationResult &result, Accumulated &accumulated) {
+        std::vector<DeviceInformation> &devicesInformation = accumulated.devicesInformation;
+        std::vector<QueueInformation> &queuesInformation = accumulated.queuesInformation;
+        std::vector<double> &monitoringTimes = accumulated.monitoringTimes;
 
-            if (csvOutputStream != nullptr) {
-                *csvOutputStream << "Длина очереди: " << std::endl;
-                *csvOutputStream << printCSVTable(
-                        toStringTable(makeTable(monitoringTimes, division(queuesInformation[i].length,
-                                (double)testsCount)), toCSVString)) << std::endl;
+        for (int i = 0; i < devicesInformation.size(); i++) {
+            const DeviceInformation &d = result.devicesInformation[i];
+            for (int j = 0; j < d.avgReserveTime.size(); j++) {
+                addToVector(devicesInformation[i].avgReserveTime, d.avgReserveTime[j], j);
+                addToVector(devicesInformation[i].avgPercentTime, d.avgPercentTime[j], j);
+            }
+        }
+        for (int i = 0; i < queuesInformation.size(); i++) {
+            const QueueInformation &q = result.queuesInformation[i];
+            for (int j = 0; j < q.avgLength.size(); j++) {
+                addToVector(queuesInformation[i].avgLength, q.avgLength[j], j);
+                addToVector(queuesInformation[i].avgWaitTime, q.avgWaitTime[j], j);
+                addToVector(queuesInformation[i].length, q.length[j], j);
             }
         }
+        for (size_t j = monitoringTimes.size(); j < result.monitoringTimes.size(); j++) {
+            monitoringTimes.push_back(result.monitoringTimes[j]);
+        }
+        for (size_t j = 0; j < result.metrics.size(); j++) {
+            accumulated.metrics[j].add(result.metrics[j]);
+            accumulated.values[j].push_back(result.metrics[j]);
+        }
+        accumulated.warmupTimes.push_back(result.warmupTime);
+#ifdef SMPL_INSTRUMENT
+        accumulated.profile.merge(result.profile);
+        accumulated.eventsPerSecond.push_back(result.profile.seconds > 0 ?
+                result.profile.events / result.profile.seconds : 0);
+#endif
+        if (accumulated.snapshots)
+            writeSnapshots(result, accumulated.replications, *accumulated.snapshots);
+        accumulated.replications++;
     }
 
     std::string MultiSMPL::printCSVTable(const std::vector<std::vector<std::string>> &table) {
-        std::string result = "";
-        for (int i = 0; i < table.size(); i++) {
-            for (int j = 0; j < table[i].size(); j++) {
-                result += table[i][j] + ";";
+        size_t size = 0;
+        for (size_t i = 0; i < table.size(); i++) {
+            for (size_t j = 0; j < table[i].size(); j++) {
+                size += table[i][j].size() + 1;
             }
-            result += "\n";
+            size++;
+        }
+
+        std::string result;
+        result.reserve(size);
+        for (size_t i = 0; i < table.size(); i++) {
+            for (size_t j = 0; j < table[i].size(); j++) {
+                result += table[i][j];
+                result += ';';
+            }
+            result += '\n';
         }
         return result;
     }
 
     template<typename T>
     std::string MultiSMPL::toCSVString(T x) {
-        std::stringstream ss;
-        ss.imbue(std::locale(ss.getloc(), new DecPoint(',')));
-        ss << std::fixed << std::setprecision(5) << x;
-        return ss.str();
+        std::string s;
+        smpl::format::append(s, x, ',');
+        return s;
     }
 
     void MultiSMPL::updateDevicesInformation(std::vector<DeviceInformation> &devicesInformation,
@@ -285,13 +1993,21 @@ namespace multiSMPL {
                                             time_t time, int number) {
         addToVector(deviceInformation.avgReserveTime, device->transactCount?
                                                       device->timeUsedSum * 1.0 / device->transactCount:0, number);
-        addToVector(deviceInformation.avgPercentTime, device->timeUsedSum * 1.0 / time * 100, number);
+        addToVector(deviceInformation.avgPercentTime, device->busyTime() * 1.0 / time * 100, number);
+    }
+
+    void MultiSMPL::updateStorageInformation(MultiSMPL::DeviceInformation &deviceInformation, smpl::Storage *storage,
+            time_t time, int number) {
+        smpl::u64 occupancy = storage->occupancyTimeSum();
+        addToVector(deviceInformation.avgReserveTime, storage->unitCount ? occupancy * 1.0 / storage->unitCount : 0,
+                number);
+        addToVector(deviceInformation.avgPercentTime, occupancy * 100.0 / time / storage->capacity, number);
     }
 
     void
     MultiSMPL::updateQueueInformation(MultiSMPL::QueueInformation &queueInformation, smpl::Queue *queue, time_t time,
                                       int number) {
-        addToVector(queueInformation.avgLength, queue->timeQueueSum*1.0 / time, number);
+        addToVector(queueInformation.avgLength, queue->lengthTimeSum() * 1.0 / time, number);
         addToVector(queueInformation.avgWaitTime, queue->count?
                                                   queue->waitTimeSum * 1.0 / queue->count:0, number);
         addToVector(queueInformation.length, (double)queue->length(), number);
@@ -356,19 +2072,21 @@ namespace multiSMPL {
     }
 
     std::vector<double> MultiSMPL::welch(const std::vector<double> &values, int w) {
-        std::vector<double> result(values.size() - w);
-        for (int i = 0; i < (int)values.size() - w; i++) {
-            result[i] = avgSum(values, i - std::min(w, i), i + std::min(w, i));
+        assert(w >= 0);
+        int n = (int)values.size();
+        if (n <= w)
+            return std::vector<double>();
+        // Префиксные суммы в повышенной точности: каждое окно за O(1) без накопления ошибки вычитания
+        std::vector<long double> prefix(n + 1, 0);
+        for (int i = 0; i < n; i++) {
+            prefix[i + 1] = prefix[i] + values[i];
         }
-        return result;
-    }
-
-    double MultiSMPL::avgSum(const std::vector<double> &values, int l, int r) {
-        double res = 0;
-        for (int i = l; i <= r; i++) {
-            res += values[i];
+        std::vector<double> result(n - w);
+        for (int i = 0; i < n - w; i++) {
+            int half = std::min(w, i);
+            result[i] = (double)((prefix[i + half + 1] - prefix[i - half]) / (2 * half + 1));
         }
-        return res / (r - l + 1);
+        return result;
     }
 }
 
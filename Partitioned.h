@@ -0,0 +1,376 @@
+#ifndef SMPL_PARTITIONED_H
+#define SMPL_PARTITIONED_H
+
+#include <vector>
+#include <string>
+#include <limits>
+#include <algorithm>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+
+#include "smpl.h"
+
+namespace smpl
+{
+    class PartitionedEngine;
+
+    /**
+     * Сообщение между логическими процессами: событие eventId транзакта transactId в момент time
+     */
+    struct ProcessMessage {
+        time_t time;
+        /** Момент отправки и номер процесса-отправителя - порядок доставки одновременных сообщений */
+        time_t sendTime;
+        uint source;
+        u64 eventId;
+        transact_t transactId;
+    };
+
+    /**
+     * Логический процесс - слабо связанная часть модели со своими устройствами, очередями и списком событий.
+     * С другими процессами взаимодействует только сообщениями send с задержкой не меньше lookahead.
+     * Устройства, очереди, накопители и переменные создаются через процесс; номера событий - свои в каждом
+     * процессе
+     */
+    class LogicalProcess {
+    private:
+        friend class PartitionedEngine;
+
+        PartitionedEngine *owner;
+        Engine *engine;
+        uint index;
+        /** Исходящие сообщения окна по процессам-получателям */
+        std::vector<std::vector<ProcessMessage> > outbox;
+
+        u64 encode(u64 eventId) const;
+
+    public:
+        LogicalProcess(PartitionedEngine *owner, Engine *engine, uint index) : owner(owner), engine(engine), index(index) {}
+
+        uint getIndex() const {
+            return index;
+        }
+
+        /**
+         * Движок процесса. В последовательном режиме он общий для всех процессов, поэтому события
+         * планируются только через schedule и send процесса
+         */
+        Engine &getEngine() {
+            return *engine;
+        }
+
+        time_t getTime() {
+            return engine->getTime();
+        }
+
+        Device *createDevice(const std::string &name);
+        Queue *createQueue(const std::string &name, QueueDiscipline discipline = QueueOrdered, uint priorities = 16);
+        Storage *createStorage(const std::string &name, uint capacity);
+        uint createVariable(const std::string &name, double value = 0);
+        /**
+         * Поток случайных чисел процесса. Ключ потока не зависит от режима, поэтому последовательный
+         * и параллельный прогоны получают одинаковые числа
+         */
+        RandomStream &stream(const std::string &name);
+
+        /**
+         * Планирование события процесса
+         */
+        event_handle_t schedule(u64 eventId, time_t delay, transact_t transactId) {
+            return engine->schedule(encode(eventId), delay, transactId);
+        }
+
+        time_t cancel(event_handle_t handle) {
+            return engine->cancel(handle);
+        }
+
+        /**
+         * Сообщение процессу target: его событие eventId наступит через delay
+         * @param delay Не меньше lookahead движка
+         */
+        void send(uint target, u64 eventId, time_t delay, transact_t transactId);
+    };
+
+    /**
+     * Модель из логических процессов, исполняемая консервативно по окнам YAWNS: нижняя граница T времени
+     * ближайших событий всех процессов дает окно [T; T + lookahead), события которого процессы обрабатывают
+     * параллельно - сообщение, отправленное в окне, не может наступить раньше его конца. На границе окна
+     * сообщения доставляются в порядке (момент отправки, отправитель), поэтому результат не зависит
+     * от числа потоков.
+     * В последовательном режиме все процессы работают в одном Engine по тем же окнам, и сообщения доставляются
+     * на их границах так же, поэтому порядок событий каждого процесса и результаты совпадают с параллельным
+     * прогоном
+     */
+    class PartitionedEngine {
+    public:
+        typedef std::function<void(LogicalProcess &, std::pair<u64, transact_t>)> Handler;
+
+    private:
+        friend class LogicalProcess;
+
+        /**
+         * Барьер на мьютексе: потоков может быть больше, чем ядер
+         */
+        class Barrier {
+        private:
+            std::mutex mutex;
+            std::condition_variable released;
+            uint count, waiting;
+            u64 generation;
+
+        public:
+            explicit Barrier(uint count) : count(count), waiting(0), generation(0) {}
+
+            void wait() {
+                std::unique_lock<std::mutex> lock(mutex);
+                u64 g = generation;
+                if (++waiting == count) {
+                    waiting = 0;
+                    generation++;
+                    released.notify_all();
+                } else {
+                    released.wait(lock, [this, g] { return generation != g; });
+                }
+            }
+        };
+
+        /** Минимум времени ближайших событий процессов потока, по строке кэша на поток */
+        struct alignas(64) ThreadBound {
+            time_t next;
+            u64 events;
+        };
+
+        /**
+         * Служебное событие конца окна: наступает после всех событий последнего момента окна
+         */
+        static const u64 WindowEvent = ~0ull;
+
+        bool sequential;
+        time_t lookahead;
+        std::vector<std::unique_ptr<Engine> > engines;
+        std::vector<std::unique_ptr<LogicalProcess> > processes;
+        Handler handler;
+        u64 eventsCount;
+
+        static time_t never() {
+            return std::numeric_limits<time_t>::max();
+        }
+
+        /**
+         * Окна YAWNS; в последовательном режиме - те же окна в одном потоке над общим движком
+         */
+        void runWindows(time_t until, uint threadsCount);
+        /**
+         * Обработка событий движка раньше end. Процесс lp, если не NULL, получает все события,
+         * иначе процесс определяется по номеру события
+         */
+        u64 processWindow(Engine &e, LogicalProcess *lp, time_t end);
+        void deliver(LogicalProcess &lp);
+
+    public:
+        /**
+         * @param processesCount Количество логических процессов
+         * @param lookahead Наименьшая задержка сообщения между процессами, больше нуля
+         * @param sequential Все процессы в одном Engine, для сравнения и отладки
+         */
+        PartitionedEngine(uint processesCount, time_t lookahead, bool sequential = false,
+                          EventListType eventListType = EventListHeap);
+
+        uint processesCount() const {
+            return (uint)processes.size();
+        }
+
+        LogicalProcess &process(uint i) {
+            assert(i < processes.size());
+            return *processes[i];
+        }
+
+        time_t getLookahead() const {
+            return lookahead;
+        }
+
+        /**
+         * Обработчик событий всех процессов: получает процесс и (номер события процесса, транзакт)
+         */
+        void setHandler(const Handler &handler) {
+            this->handler = handler;
+        }
+
+        void setSeed(u64 seed, u64 replication = 0);
+
+        /**
+         * Обработка всех событий до момента until включительно, затем часы всех процессов переводятся на until
+         * @param threadsCount Количество потоков, 0 - по числу ядер; в последовательном режиме не используется
+         * @return Количество обработанных событий
+         */
+        u64 run(time_t until, int threadsCount = 0);
+    };
+
+    u64 LogicalProcess::encode(u64 eventId) const {
+        // В общем движке номер события несет номер процесса; порядок событий одного процесса не меняется
+        return owner->sequential ? eventId * owner->processes.size() + index : eventId;
+    }
+
+    Device *LogicalProcess::createDevice(const std::string &name) {
+        engine->createDevice(name);
+        return engine->getDevices().back();
+    }
+
+    Queue *LogicalProcess::createQueue(const std::string &name, QueueDiscipline discipline, uint priorities) {
+        engine->createQueue(name, discipline, priorities);
+        return engine->getQueues().back();
+    }
+
+    Storage *LogicalProcess::createStorage(const std::string &name, uint capacity) {
+        engine->createStorage(name, capacity);
+        return engine->getStorages().back();
+    }
+
+    uint LogicalProcess::createVariable(const std::string &name, double value) {
+        return engine->createVariable(name, value);
+    }
+
+    RandomStream &LogicalProcess::stream(const std::string &name) {
+        return engine->stream(name + "@" + Engine::toString(index));
+    }
+
+    void LogicalProcess::send(uint target, u64 eventId, time_t delay, transact_t transactId) {
+        assert(target < owner->processes.size() && delay >= owner->lookahead);
+        ProcessMessage m;
+        m.time = engine->getTime() + delay;
+        m.sendTime = engine->getTime();
+        m.source = index;
+        m.eventId = eventId;
+        m.transactId = transactId;
+        outbox[target].push_back(m);
+    }
+
+    PartitionedEngine::PartitionedEngine(uint processesCount, time_t lookahead, bool sequential,
+                                         EventListType eventListType)
+            : sequential(sequential), lookahead(lookahead), eventsCount(0) {
+        assert(processesCount > 0 && lookahead > 0);
+        uint enginesCount = sequential ? 1 : processesCount;
+        for (uint i = 0; i < enginesCount; i++) {
+            engines.emplace_back(new Engine(nullptr, eventListType));
+        }
+        for (uint i = 0; i < processesCount; i++) {
+            processes.emplace_back(new LogicalProcess(this, engines[sequential ? 0 : i].get(), i));
+            processes.back()->outbox.resize(processesCount);
+        }
+    }
+
+    void PartitionedEngine::setSeed(u64 seed, u64 replication) {
+        for (size_t i = 0; i < engines.size(); i++) {
+            engines[i]->setSeed(seed, replication);
+        }
+    }
+
+    u64 PartitionedEngine::run(time_t until, int threadsCount) {
+        assert(handler);
+        eventsCount = 0;
+        if (sequential) {
+            threadsCount = 1;
+        } else if (threadsCount <= 0) {
+            threadsCount = (int)std::max(1u, std::thread::hardware_concurrency());
+        }
+        runWindows(until, std::min((uint)threadsCount, (uint)engines.size()));
+        for (size_t i = 0; i < engines.size(); i++) {
+            if (engines[i]->getTime() < until)
+                engines[i]->advance(until);
+        }
+        return eventsCount;
+    }
+
+    u64 PartitionedEngine::processWindow(Engine &e, LogicalProcess *lp, time_t end) {
+        if (e.eventsCount() == 0 || e.nextTime() >= end)
+            return 0;
+        // Конец окна отмечается событием, а не проверкой времени перед каждым событием
+        e.schedule(WindowEvent, end - 1 - e.getTime(), 0);
+        u64 count = 0;
+        u64 processesCount = processes.size();
+        while (true) {
+            std::pair<u64, transact_t> ev = e.cause();
+            if (ev.first == WindowEvent)
+                break;
+            if (lp != NULL) {
+                handler(*lp, ev);
+            } else {
+                handler(*processes[ev.first % processesCount], std::make_pair(ev.first / processesCount, ev.second));
+            }
+            count++;
+        }
+        return count;
+    }
+
+    void PartitionedEngine::deliver(LogicalProcess &lp) {
+        std::vector<ProcessMessage> inbox;
+        for (size_t i = 0; i < processes.size(); i++) {
+            std::vector<ProcessMessage> &box = processes[i]->outbox[lp.index];
+            inbox.insert(inbox.end(), box.begin(), box.end());
+            box.clear();
+        }
+        // Отправители перебраны по порядку, сообщения одного отправителя - в порядке отправки
+        std::stable_sort(inbox.begin(), inbox.end(), [](const ProcessMessage &a, const ProcessMessage &b) {
+            return a.sendTime < b.sendTime;
+        });
+        Engine &e = *lp.engine;
+        for (size_t i = 0; i < inbox.size(); i++) {
+            e.schedule(lp.encode(inbox[i].eventId), inbox[i].time - e.getTime(), inbox[i].transactId);
+        }
+    }
+
+    void PartitionedEngine::runWindows(time_t until, uint threadsCount) {
+        // Стандартный распределитель C++11 не обязан соблюдать выравнивание больше alignof(max_align_t)
+        std::vector<ThreadBound, CacheLineAllocator<ThreadBound> > bounds(threadsCount);
+        Barrier barrier(threadsCount);
+
+        auto worker = [&](uint thread) {
+            while (true) {
+                // Граница окна: ближайшее событие по всем процессам, сообщения прошлого окна уже доставлены
+                time_t next = never();
+                for (size_t i = thread; i < engines.size(); i += threadsCount) {
+                    if (engines[i]->eventsCount() != 0)
+                        next = std::min(next, engines[i]->nextTime());
+                }
+                bounds[thread].next = next;
+                barrier.wait();
+
+                time_t lower = never();
+                for (uint t = 0; t < threadsCount; t++) {
+                    lower = std::min(lower, bounds[t].next);
+                }
+                if (lower == never() || lower > until)
+                    break;
+                time_t end = lower <= until - lookahead ? lower + lookahead : until + 1;
+                for (size_t i = thread; i < engines.size(); i += threadsCount) {
+                    bounds[thread].events += processWindow(*engines[i], sequential ? NULL : processes[i].get(), end);
+                }
+                barrier.wait();
+
+                for (size_t i = thread; i < processes.size(); i += threadsCount) {
+                    deliver(*processes[i]);
+                }
+            }
+        };
+
+        for (uint t = 0; t < threadsCount; t++) {
+            bounds[t].events = 0;
+        }
+        std::vector<std::thread> threads;
+        for (uint t = 1; t < threadsCount; t++) {
+            threads.push_back(std::thread(worker, t));
+        }
+        worker(0);
+        for (size_t t = 0; t < threads.size(); t++) {
+            threads[t].join();
+        }
+        for (uint t = 0; t < threadsCount; t++) {
+            eventsCount += bounds[t].events;
+        }
+    }
+}
+
+#endif //SMPL_PARTITIONED_H
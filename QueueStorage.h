@@ -0,0 +1,325 @@
+#ifndef SMPL_QUEUESTORAGE_H
+#define SMPL_QUEUESTORAGE_H
+
+#include <vector>
+#include <set>
+#include <algorithm>
+
+#include <ctime>
+#include <cassert>
+
+#include "Arena.h"
+
+namespace smpl
+{
+    typedef unsigned int uint;
+    typedef unsigned long long u64;
+    typedef u64 transact_t;
+
+    /**
+     * Элемент очереди
+     */
+    class QueueItem {
+    public:
+        /** I, приоритет элемента очереди */
+        u64 priority;
+        /** J, идентификатор транзакта */
+        transact_t transactId;
+        /** T, время поступления элемента */
+        time_t time;
+        /** S, стадия обработки заявки */
+        u64 stage;
+
+        QueueItem() : priority(0), transactId(0), time(0), stage(0) {}
+
+        QueueItem(time_t time, transact_t transactId, u64 priority, u64 stage)
+                : priority(priority), transactId(transactId), time(time), stage(stage) {}
+
+        /**
+         * Оператор сравнения двух элементов очереди.
+         * Нужен для работы контейнеров стандартной библиотеки C++
+         * @param a
+         * @param b
+         * @return
+         */
+        friend bool operator<(const QueueItem &a, const QueueItem &b) {
+            return a.time < b.time || (a.time == b.time && a.priority < b.priority);
+        }
+    };
+
+    /**
+     * Дисциплина обслуживания очереди
+     */
+    enum QueueDiscipline {
+        /** По времени поступления, при равном времени - по возрастанию приоритета (std::multiset) */
+        QueueOrdered,
+        /** Первым пришел - первым обслужен, кольцевой буфер */
+        QueueFIFO,
+        /** Последним пришел - первым обслужен, стек */
+        QueueLIFO,
+        /** По возрастанию приоритета, внутри приоритета FIFO; корзина на каждое значение приоритета */
+        QueuePriority
+    };
+
+    /**
+     * Кольцевой буфер, емкость - степень двойки
+     */
+    template<typename T>
+    class RingBuffer {
+    private:
+        std::vector<T> data;
+        size_t first;
+        size_t count;
+
+        void grow() {
+            std::vector<T> bigger(data.empty() ? 8 : data.size() * 2);
+            for (size_t i = 0; i < count; i++) {
+                bigger[i] = (*this)[i];
+            }
+            data.swap(bigger);
+            first = 0;
+        }
+
+    public:
+        RingBuffer() : first(0), count(0) {}
+
+        void push_back(const T &x) {
+            if (count == data.size())
+                grow();
+            data[(first + count) & (data.size() - 1)] = x;
+            count++;
+        }
+
+        T pop_front() {
+            assert(count > 0);
+            T x = data[first];
+            first = (first + 1) & (data.size() - 1);
+            count--;
+            return x;
+        }
+
+        T pop_back() {
+            assert(count > 0);
+            count--;
+            return data[(first + count) & (data.size() - 1)];
+        }
+
+        /**
+         * i-й элемент от начала
+         */
+        const T &operator[](size_t i) const {
+            return data[(first + i) & (data.size() - 1)];
+        }
+
+        size_t size() const {
+            return count;
+        }
+
+        bool empty() const {
+            return count == 0;
+        }
+
+        void clear() {
+            first = count = 0;
+        }
+    };
+
+    /**
+     * Контейнер элементов очереди
+     */
+    class QueueStorage {
+    public:
+        virtual ~QueueStorage() {}
+        virtual void push(const QueueItem &item) = 0;
+        /**
+         * Извлечение следующего обслуживаемого элемента. Контейнер не должен быть пуст
+         */
+        virtual QueueItem pop() = 0;
+        virtual size_t size() const = 0;
+        virtual void clear() = 0;
+        /**
+         * Добавляет в out все элементы в порядке обслуживания
+         */
+        virtual void collect(std::vector<QueueItem> &out) const = 0;
+        /**
+         * Заполнение пустого контейнера элементами, перечисленными в порядке обслуживания (как в collect)
+         */
+        virtual void assign(const std::vector<QueueItem> &items) {
+            assert(size() == 0);
+            for (size_t i = 0; i < items.size(); i++) {
+                push(items[i]);
+            }
+        }
+    };
+
+    class OrderedQueueStorage : public QueueStorage {
+    private:
+        std::multiset<QueueItem, std::less<QueueItem>, PoolAllocator<QueueItem> > items;
+
+    public:
+        explicit OrderedQueueStorage(Arena &arena)
+                : items(std::less<QueueItem>(), PoolAllocator<QueueItem>(&arena)) {}
+
+        void push(const QueueItem &item) {
+            items.insert(item);
+        }
+
+        QueueItem pop() {
+            assert(!items.empty());
+            QueueItem item = *items.begin();
+            items.erase(items.begin());
+            return item;
+        }
+
+        size_t size() const {
+            return items.size();
+        }
+
+        void clear() {
+            items.clear();
+        }
+
+        void collect(std::vector<QueueItem> &out) const {
+            out.insert(out.end(), items.begin(), items.end());
+        }
+    };
+
+    class FifoQueueStorage : public QueueStorage {
+    private:
+        RingBuffer<QueueItem> items;
+
+    public:
+        void push(const QueueItem &item) {
+            items.push_back(item);
+        }
+
+        QueueItem pop() {
+            return items.pop_front();
+        }
+
+        size_t size() const {
+            return items.size();
+        }
+
+        void clear() {
+            items.clear();
+        }
+
+        void collect(std::vector<QueueItem> &out) const {
+            for (size_t i = 0; i < items.size(); i++) {
+                out.push_back(items[i]);
+            }
+        }
+    };
+
+    class LifoQueueStorage : public QueueStorage {
+    private:
+        std::vector<QueueItem> items;
+
+    public:
+        void push(const QueueItem &item) {
+            items.push_back(item);
+        }
+
+        QueueItem pop() {
+            assert(!items.empty());
+            QueueItem item = items.back();
+            items.pop_back();
+            return item;
+        }
+
+        size_t size() const {
+            return items.size();
+        }
+
+        void clear() {
+            items.clear();
+        }
+
+        void collect(std::vector<QueueItem> &out) const {
+            out.insert(out.end(), items.rbegin(), items.rend());
+        }
+
+        void assign(const std::vector<QueueItem> &items) {
+            assert(this->items.empty());
+            this->items.assign(items.rbegin(), items.rend());
+        }
+    };
+
+    /**
+     * Корзины по значениям приоритета 0..levels-1 и битовая маска непустых корзин.
+     * Приоритет levels и больше попадает в последнюю корзину
+     */
+    class PriorityQueueStorage : public QueueStorage {
+    private:
+        std::vector< RingBuffer<QueueItem> > buckets;
+        std::vector<u64> nonEmpty;
+        size_t count;
+
+    public:
+        explicit PriorityQueueStorage(uint levels)
+                : buckets(levels), nonEmpty((levels + 63) / 64, 0), count(0) {
+            assert(levels > 0);
+        }
+
+        void push(const QueueItem &item) {
+            size_t p = std::min<u64>(item.priority, buckets.size() - 1);
+            buckets[p].push_back(item);
+            nonEmpty[p / 64] |= 1ULL << (p % 64);
+            count++;
+        }
+
+        QueueItem pop() {
+            assert(count > 0);
+            size_t word = 0;
+            while (nonEmpty[word] == 0)
+                word++;
+            size_t p = word * 64 + __builtin_ctzll(nonEmpty[word]);
+            QueueItem item = buckets[p].pop_front();
+            if (buckets[p].empty())
+                nonEmpty[word] &= ~(1ULL << (p % 64));
+            count--;
+            return item;
+        }
+
+        size_t size() const {
+            return count;
+        }
+
+        void clear() {
+            for (size_t i = 0; i < buckets.size(); i++) {
+                buckets[i].clear();
+            }
+            nonEmpty.assign(nonEmpty.size(), 0);
+            count = 0;
+        }
+
+        void collect(std::vector<QueueItem> &out) const {
+            for (size_t p = 0; p < buckets.size(); p++) {
+                for (size_t i = 0; i < buckets[p].size(); i++) {
+                    out.push_back(buckets[p][i]);
+                }
+            }
+        }
+    };
+
+    /**
+     * Создание контейнера очереди в арене
+     * @param priorities Количество значений приоритета для QueuePriority
+     */
+    inline QueueStorage *createQueueStorage(QueueDiscipline discipline, uint priorities, Arena &arena) {
+        switch (discipline) {
+            case QueueFIFO:
+                return arena.create<FifoQueueStorage>();
+            case QueueLIFO:
+                return arena.create<LifoQueueStorage>();
+            case QueuePriority:
+                return arena.create<PriorityQueueStorage>(priorities);
+            case QueueOrdered:
+            default:
+                return arena.create<OrderedQueueStorage>(arena);
+        }
+    }
+}
+
+#endif //SMPL_QUEUESTORAGE_H
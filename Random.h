@@ -0,0 +1,369 @@
+#ifndef SMPL_RANDOM_H
+#define SMPL_RANDOM_H
+
+#include <string>
+#include <cmath>
+
+// Ядра AVX2 и AVX-512 компилируются атрибутом target и выбираются при выполнении по возможностям процессора,
+// поэтому работают и в сборке без -mavx2/-march=native
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SMPL_PHILOX_SIMD
+#include <immintrin.h>
+#endif
+
+namespace smpl
+{
+    typedef unsigned int uint;
+    typedef unsigned long long u64;
+
+    /**
+     * Поток случайных чисел на основе счетчикового генератора Philox4x32-10
+     * (J. Salmon et al., "Parallel Random Numbers: As Easy as 1, 2, 3", 2011).
+     * Очередное значение - шифр номера блока, поэтому поток можно перемотать
+     * на любую позицию за O(1), а потоки с разными ключами независимы
+     */
+    class RandomStream {
+    private:
+        /** Ключ потока */
+        u64 key;
+        /** Номер подпотока, старшая половина счетчика */
+        u64 substream;
+        /** Номер следующего блока из четырех 32-битных значений */
+        u64 block;
+        uint buffer[4];
+        /** Количество использованных значений текущего блока */
+        uint used;
+        /** Маска, применяемая ко всем значениям: 0 или все единицы для антитетического потока */
+        uint mask;
+
+        void generate() {
+            uint ctr[4] = {(uint)block, (uint)(block >> 32), (uint)substream, (uint)(substream >> 32)};
+            philox(ctr, key, buffer);
+            for (int i = 0; i < 4; i++) {
+                buffer[i] ^= mask;
+            }
+            block++;
+            used = 0;
+        }
+
+    public:
+        explicit RandomStream(u64 key = 0, u64 substream = 0)
+                : key(key), substream(substream), block(0), used(4), mask(0) {}
+
+        /**
+         * Philox4x32-10: шифрование счетчика ctr ключом key
+         */
+        static void philox(const uint ctr[4], u64 key, uint out[4]) {
+            const u64 M0 = 0xD2511F53, M1 = 0xCD9E8D57;
+            uint c0 = ctr[0], c1 = ctr[1], c2 = ctr[2], c3 = ctr[3];
+            uint k0 = (uint)key, k1 = (uint)(key >> 32);
+            for (int round = 0; round < 10; round++) {
+                u64 p0 = M0 * c0;
+                u64 p1 = M1 * c2;
+                uint n0 = (uint)(p1 >> 32) ^ c1 ^ k0;
+                uint n2 = (uint)(p0 >> 32) ^ c3 ^ k1;
+                c1 = (uint)p1;
+                c3 = (uint)p0;
+                c0 = n0;
+                c2 = n2;
+                k0 += 0x9E3779B9;
+                k1 += 0xBB67AE85;
+            }
+            out[0] = c0; out[1] = c1; out[2] = c2; out[3] = c3;
+        }
+
+#ifdef SMPL_PHILOX_SIMD
+        enum SimdLevel {
+            SimdNone,
+            SimdAvx2,
+            SimdAvx512
+        };
+
+        /**
+         * Лучший набор команд процессора, определяется один раз
+         */
+        static SimdLevel simdLevel() {
+            static const SimdLevel level = []() {
+                __builtin_cpu_init();
+                return __builtin_cpu_supports("avx512f") ? SimdAvx512 :
+                       __builtin_cpu_supports("avx2") ? SimdAvx2 : SimdNone;
+            }();
+            return level;
+        }
+
+        // Заголовки GCC с AVX-512 дают ложные предупреждения о неинициализированных значениях
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+        /**
+         * Шифрование блоков по 16 одновременно
+         * @return Количество зашифрованных блоков, кратное 16
+         */
+        __attribute__((target("avx512f")))
+        static size_t philoxBlocksAvx512(u64 key, u64 substream, u64 first, size_t count, uint *out) {
+            size_t b = 0;
+            const size_t Lanes = 16;
+            for (; b + Lanes <= count; b += Lanes) {
+                alignas(64) uint c[4][Lanes];
+                for (size_t l = 0; l < Lanes; l++) {
+                    c[0][l] = (uint)(first + b + l);
+                    c[1][l] = (uint)((first + b + l) >> 32);
+                }
+                __m512i c0 = _mm512_load_si512(c[0]), c1 = _mm512_load_si512(c[1]);
+                __m512i c2 = _mm512_set1_epi32((int)(uint)substream);
+                __m512i c3 = _mm512_set1_epi32((int)(uint)(substream >> 32));
+                __m512i k0 = _mm512_set1_epi32((int)(uint)key), k1 = _mm512_set1_epi32((int)(uint)(key >> 32));
+                const __m512i m0 = _mm512_set1_epi64(0xD2511F53), m1 = _mm512_set1_epi64(0xCD9E8D57);
+                const __m512i w0 = _mm512_set1_epi32((int)0x9E3779B9), w1 = _mm512_set1_epi32((int)0xBB67AE85);
+                for (int round = 0; round < 10; round++) {
+                    __m512i e0 = _mm512_mul_epu32(c0, m0), o0 = _mm512_mul_epu32(_mm512_srli_epi64(c0, 32), m0);
+                    __m512i e1 = _mm512_mul_epu32(c2, m1), o1 = _mm512_mul_epu32(_mm512_srli_epi64(c2, 32), m1);
+                    __m512i hi0 = _mm512_mask_blend_epi32(0xAAAA, _mm512_srli_epi64(e0, 32), o0);
+                    __m512i lo0 = _mm512_mask_blend_epi32(0xAAAA, e0, _mm512_slli_epi64(o0, 32));
+                    __m512i hi1 = _mm512_mask_blend_epi32(0xAAAA, _mm512_srli_epi64(e1, 32), o1);
+                    __m512i lo1 = _mm512_mask_blend_epi32(0xAAAA, e1, _mm512_slli_epi64(o1, 32));
+                    c0 = _mm512_xor_si512(_mm512_xor_si512(hi1, c1), k0);
+                    c2 = _mm512_xor_si512(_mm512_xor_si512(hi0, c3), k1);
+                    c1 = lo1;
+                    c3 = lo0;
+                    k0 = _mm512_add_epi32(k0, w0);
+                    k1 = _mm512_add_epi32(k1, w1);
+                }
+                _mm512_store_si512(c[0], c0);
+                _mm512_store_si512(c[1], c1);
+                _mm512_store_si512(c[2], c2);
+                _mm512_store_si512(c[3], c3);
+                for (size_t l = 0; l < Lanes; l++) {
+                    uint *o = out + 4 * (b + l);
+                    o[0] = c[0][l]; o[1] = c[1][l]; o[2] = c[2][l]; o[3] = c[3][l];
+                }
+            }
+            return b;
+        }
+#pragma GCC diagnostic pop
+
+        /**
+         * Шифрование блоков по 8 одновременно
+         * @return Количество зашифрованных блоков, кратное 8
+         */
+        __attribute__((target("avx2")))
+        static size_t philoxBlocksAvx2(u64 key, u64 substream, u64 first, size_t count, uint *out) {
+            size_t b = 0;
+            const size_t Lanes = 8;
+            for (; b + Lanes <= count; b += Lanes) {
+                alignas(32) uint c[4][Lanes];
+                for (size_t l = 0; l < Lanes; l++) {
+                    c[0][l] = (uint)(first + b + l);
+                    c[1][l] = (uint)((first + b + l) >> 32);
+                }
+                __m256i c0 = _mm256_load_si256((const __m256i *)c[0]), c1 = _mm256_load_si256((const __m256i *)c[1]);
+                __m256i c2 = _mm256_set1_epi32((int)(uint)substream);
+                __m256i c3 = _mm256_set1_epi32((int)(uint)(substream >> 32));
+                __m256i k0 = _mm256_set1_epi32((int)(uint)key), k1 = _mm256_set1_epi32((int)(uint)(key >> 32));
+                const __m256i m0 = _mm256_set1_epi64x(0xD2511F53), m1 = _mm256_set1_epi64x(0xCD9E8D57);
+                const __m256i w0 = _mm256_set1_epi32((int)0x9E3779B9), w1 = _mm256_set1_epi32((int)0xBB67AE85);
+                for (int round = 0; round < 10; round++) {
+                    __m256i e0 = _mm256_mul_epu32(c0, m0), o0 = _mm256_mul_epu32(_mm256_srli_epi64(c0, 32), m0);
+                    __m256i e1 = _mm256_mul_epu32(c2, m1), o1 = _mm256_mul_epu32(_mm256_srli_epi64(c2, 32), m1);
+                    __m256i hi0 = _mm256_blend_epi32(_mm256_srli_epi64(e0, 32), o0, 0xAA);
+                    __m256i lo0 = _mm256_blend_epi32(e0, _mm256_slli_epi64(o0, 32), 0xAA);
+                    __m256i hi1 = _mm256_blend_epi32(_mm256_srli_epi64(e1, 32), o1, 0xAA);
+                    __m256i lo1 = _mm256_blend_epi32(e1, _mm256_slli_epi64(o1, 32), 0xAA);
+                    c0 = _mm256_xor_si256(_mm256_xor_si256(hi1, c1), k0);
+                    c2 = _mm256_xor_si256(_mm256_xor_si256(hi0, c3), k1);
+                    c1 = lo1;
+                    c3 = lo0;
+                    k0 = _mm256_add_epi32(k0, w0);
+                    k1 = _mm256_add_epi32(k1, w1);
+                }
+                _mm256_store_si256((__m256i *)c[0], c0);
+                _mm256_store_si256((__m256i *)c[1], c1);
+                _mm256_store_si256((__m256i *)c[2], c2);
+                _mm256_store_si256((__m256i *)c[3], c3);
+                for (size_t l = 0; l < Lanes; l++) {
+                    uint *o = out + 4 * (b + l);
+                    o[0] = c[0][l]; o[1] = c[1][l]; o[2] = c[2][l]; o[3] = c[3][l];
+                }
+            }
+            return b;
+        }
+#endif
+
+        /**
+         * Шифрование count блоков подряд, начиная с блока first.
+         * Результат совпадает с последовательными вызовами philox; на процессорах с AVX-512 или AVX2
+         * блоки шифруются по 16 или 8 одновременно
+         * @param out Массив из 4 * count значений
+         */
+        static void philoxBlocks(u64 key, u64 substream, u64 first, size_t count, uint *out) {
+            size_t b = 0;
+#ifdef SMPL_PHILOX_SIMD
+            switch (simdLevel()) {
+                case SimdAvx512:
+                    b = philoxBlocksAvx512(key, substream, first, count, out);
+                    break;
+                case SimdAvx2:
+                    b = philoxBlocksAvx2(key, substream, first, count, out);
+                    break;
+                default:
+                    break;
+            }
+#endif
+            for (; b < count; b++) {
+                uint ctr[4] = {(uint)(first + b), (uint)((first + b) >> 32), (uint)substream, (uint)(substream >> 32)};
+                philox(ctr, key, out + 4 * b);
+            }
+        }
+
+        /**
+         * Перемешивание 64-битного значения (финализатор SplitMix64)
+         */
+        static u64 mix(u64 x) {
+            x += 0x9E3779B97F4A7C15ULL;
+            x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+            return x ^ (x >> 31);
+        }
+
+        /**
+         * Хеш имени источника случайности (FNV-1a)
+         */
+        static u64 hash(const std::string &name) {
+            u64 h = 0xCBF29CE484222325ULL;
+            for (size_t i = 0; i < name.size(); i++) {
+                h = (h ^ (unsigned char)name[i]) * 0x100000001B3ULL;
+            }
+            return h;
+        }
+
+        /**
+         * Ключ потока для источника name в прогоне replication эксперимента с зерном seed
+         */
+        static u64 makeKey(u64 seed, u64 replication, const std::string &name) {
+            return mix(mix(mix(seed) ^ replication) ^ hash(name));
+        }
+
+        uint nextU32() {
+            if (used == 4)
+                generate();
+            return buffer[used++];
+        }
+
+        u64 nextU64() {
+            u64 hi = nextU32();
+            return (hi << 32) | nextU32();
+        }
+
+        /**
+         * Заполнение массива очередными n значениями потока.
+         * Эквивалентно n вызовам nextU32, но целые блоки шифруются пачкой
+         */
+        void fill(uint *out, size_t n) {
+            size_t i = 0;
+            while (i < n && used < 4)
+                out[i++] = buffer[used++];
+            size_t blocks = (n - i) / 4;
+            if (blocks > 0) {
+                philoxBlocks(key, substream, block, blocks, out + i);
+                if (mask != 0) {
+                    for (size_t j = i; j < i + blocks * 4; j++) {
+                        out[j] ^= mask;
+                    }
+                }
+                block += blocks;
+                i += blocks * 4;
+            }
+            while (i < n)
+                out[i++] = nextU32();
+        }
+
+        /**
+         * Преобразование двух 32-битных значений в число из [0; 1), как в uniform
+         */
+        static double toUniform(uint hi, uint lo) {
+            return ((double)hi * 2097152.0 + (double)(lo >> 11)) * (1.0 / 9007199254740992.0);
+        }
+
+        /**
+         * Равномерно распределенное число в [0; 1) с 53 значащими битами
+         */
+        double uniform() {
+            return (nextU64() >> 11) * (1.0 / 9007199254740992.0);
+        }
+
+        /**
+         * Равномерно распределенное целое в [L; R) без смещения (метод Лемира).
+         * При L == R возвращает L
+         */
+        uint uniformInt(uint L, uint R) {
+            if (L > R)
+                std::swap(L, R);
+            uint range = R - L;
+            if (range == 0)
+                return L;
+            u64 m = (u64)nextU32() * range;
+            uint low = (uint)m;
+            if (low < range) {
+                uint threshold = (0u - range) % range;
+                while (low < threshold) {
+                    m = (u64)nextU32() * range;
+                    low = (uint)m;
+                }
+            }
+            return L + (uint)(m >> 32);
+        }
+
+        /**
+         * Экспоненциально распределенная величина со средним mean
+         */
+        double exponential(double mean) {
+            return -log(1 - uniform()) * mean;
+        }
+
+        /**
+         * Позиция потока - количество выданных 32-битных значений
+         */
+        u64 tell() const {
+            return block * 4 - (4 - used);
+        }
+
+        /**
+         * Перемотка потока на позицию position
+         */
+        void seek(u64 position) {
+            block = position / 4;
+            generate();
+            used = (uint)(position % 4);
+        }
+
+        u64 getKey() const {
+            return key;
+        }
+
+        u64 getSubstream() const {
+            return substream;
+        }
+
+        /**
+         * Антитетический поток выдает дополнения значений обычного потока с тем же ключом:
+         * uniform() дает 1 - u - 2^-53 вместо u. Действует на значения, вырабатываемые после вызова
+         */
+        void setAntithetic(bool antithetic) {
+            mask = antithetic ? ~0u : 0u;
+        }
+
+        bool isAntithetic() const {
+            return mask != 0;
+        }
+
+        /**
+         * Переход на подпоток с начала
+         */
+        void setSubstream(u64 substream) {
+            this->substream = substream;
+            block = 0;
+            used = 4;
+        }
+    };
+}
+
+#endif //SMPL_RANDOM_H
@@ -0,0 +1,252 @@
+#ifndef PROJECT_SNAPSHOTSTORE_H
+#define PROJECT_SNAPSHOTSTORE_H
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <cassert>
+#include <stdexcept>
+
+#include "MappedFile.h"
+
+namespace multiSMPL {
+
+    /**
+     * Формат файла срезов (все числа little-endian):
+     *   заголовок: "SMPLSNAP", u32 версия, u32 число столбцов, для каждого столбца u32 длина имени и имя,
+     *              выравнивание нулями до 8 байт;
+     *   группы строк: u64 число строк n, затем каждый столбец подряд - n значений double.
+     * Группы дописываются в конец файла по мере заполнения, поэтому внутри группы данные
+     * хранятся по столбцам, а файл можно читать отображением в память без разбора
+     */
+    const char SnapshotMagic[8] = {'S', 'M', 'P', 'L', 'S', 'N', 'A', 'P'};
+    const unsigned int SnapshotVersion = 1;
+
+    /**
+     * Запись срезов в файл: строки накапливаются в буфере и сбрасываются группами.
+     * Деструктор дописывает неполную группу, но ошибку записи не сообщает - для ее проверки flush
+     * вызывается явно
+     */
+    class SnapshotWriter {
+    private:
+        FILE *file;
+        size_t columnsCount;
+        size_t groupSize;
+        /** Буфер группы по столбцам: столбец c, строка r - buffer[c * groupSize + r] */
+        std::vector<double> buffer;
+        size_t buffered;
+        size_t written;
+
+        SnapshotWriter(const SnapshotWriter &);
+        SnapshotWriter &operator=(const SnapshotWriter &);
+
+        void writeRaw(const void *data, size_t size) {
+            if (size && fwrite(data, 1, size, file) != size)
+                throw std::runtime_error("Ошибка записи файла срезов");
+        }
+
+    public:
+        /**
+         * @param path Путь к файлу, существующий файл перезаписывается
+         * @param columns Имена столбцов
+         * @param groupSize Число строк в группе
+         */
+        SnapshotWriter(const std::string &path, const std::vector<std::string> &columns, size_t groupSize = 4096);
+        ~SnapshotWriter();
+
+        /**
+         * Добавление строки из columns() значений
+         */
+        void append(const double *row) {
+            for (size_t c = 0; c < columnsCount; c++) {
+                buffer[c * groupSize + buffered] = row[c];
+            }
+            if (++buffered == groupSize)
+                flush();
+        }
+
+        void append(const std::vector<double> &row) {
+            assert(row.size() == columnsCount);
+            append(row.data());
+        }
+
+        /**
+         * Запись неполной группы строк
+         */
+        void flush();
+
+        size_t columns() const {
+            return columnsCount;
+        }
+
+        size_t rows() const {
+            return written + buffered;
+        }
+    };
+
+    SnapshotWriter::SnapshotWriter(const std::string &path, const std::vector<std::string> &columns, size_t groupSize)
+            : columnsCount(columns.size()), groupSize(groupSize), buffer(columns.size() * groupSize),
+              buffered(0), written(0) {
+        assert(groupSize > 0);
+        file = fopen(path.c_str(), "wb");
+        if (file == NULL)
+            throw std::runtime_error("Не удалось открыть файл срезов " + path);
+
+        writeRaw(SnapshotMagic, sizeof(SnapshotMagic));
+        unsigned int header[2] = {SnapshotVersion, (unsigned int)columnsCount};
+        writeRaw(header, sizeof(header));
+        size_t size = sizeof(SnapshotMagic) + sizeof(header);
+        for (size_t c = 0; c < columns.size(); c++) {
+            unsigned int length = (unsigned int)columns[c].size();
+            writeRaw(&length, sizeof(length));
+            writeRaw(columns[c].data(), length);
+            size += sizeof(length) + length;
+        }
+        const char zeros[8] = {0};
+        writeRaw(zeros, (8 - size % 8) % 8);
+    }
+
+    SnapshotWriter::~SnapshotWriter() {
+        try {
+            flush();
+        } catch (const std::runtime_error &) {
+            // Исключение из деструктора завершило бы программу
+        }
+        fclose(file);
+    }
+
+    void SnapshotWriter::flush() {
+        if (buffered == 0)
+            return;
+        unsigned long long n = buffered;
+        writeRaw(&n, sizeof(n));
+        for (size_t c = 0; c < columnsCount; c++) {
+            writeRaw(&buffer[c * groupSize], buffered * sizeof(double));
+        }
+        fflush(file);
+        written += buffered;
+        buffered = 0;
+    }
+
+    /**
+     * Чтение файла срезов через отображение в память. Значения не копируются,
+     * кроме сборки столбца целиком в column
+     */
+    class SnapshotReader {
+    private:
+        smpl::MappedFile file;
+        std::vector<std::string> names;
+
+        struct Group {
+            size_t rows;
+            /** Номер первой строки группы */
+            size_t first;
+            /** Начало первого столбца группы */
+            const double *values;
+        };
+
+        std::vector<Group> groups;
+        size_t rowsCount;
+
+        SnapshotReader(const SnapshotReader &);
+        SnapshotReader &operator=(const SnapshotReader &);
+
+    public:
+        explicit SnapshotReader(const std::string &path);
+
+        size_t columns() const {
+            return names.size();
+        }
+
+        size_t rows() const {
+            return rowsCount;
+        }
+
+        const std::string &name(size_t column) const {
+            return names[column];
+        }
+
+        /**
+         * Номер столбца по имени, -1 - нет такого столбца
+         */
+        int find(const std::string &name) const {
+            for (size_t c = 0; c < names.size(); c++) {
+                if (names[c] == name)
+                    return (int)c;
+            }
+            return -1;
+        }
+
+        double value(size_t row, size_t column) const;
+
+        /**
+         * Все значения столбца по порядку строк
+         */
+        void column(size_t column, std::vector<double> &out) const;
+    };
+
+    SnapshotReader::SnapshotReader(const std::string &path) : file(path, "срезов"), rowsCount(0) {
+        const char *data = file.bytes();
+        size_t size = file.length();
+        unsigned int header[2];
+        if (size < sizeof(SnapshotMagic) + sizeof(header) || memcmp(data, SnapshotMagic, sizeof(SnapshotMagic)) != 0)
+            throw std::runtime_error("Неверный формат файла срезов " + path);
+        memcpy(header, data + sizeof(SnapshotMagic), sizeof(header));
+        if (header[0] != SnapshotVersion)
+            throw std::runtime_error("Неподдерживаемая версия файла срезов " + path);
+
+        size_t offset = sizeof(SnapshotMagic) + sizeof(header);
+        for (unsigned int c = 0; c < header[1]; c++) {
+            unsigned int length;
+            if (offset + sizeof(length) > size)
+                throw std::runtime_error("Файл срезов поврежден " + path);
+            memcpy(&length, data + offset, sizeof(length));
+            offset += sizeof(length);
+            if (offset + length > size)
+                throw std::runtime_error("Файл срезов поврежден " + path);
+            names.push_back(std::string(data + offset, length));
+            offset += length;
+        }
+        offset += (8 - offset % 8) % 8;
+
+        // Неполная последняя группа (прогон прерван во время записи) отбрасывается
+        while (offset + sizeof(unsigned long long) <= size) {
+            unsigned long long n;
+            memcpy(&n, data + offset, sizeof(n));
+            size_t bytes = (size_t)n * names.size() * sizeof(double);
+            if (n == 0 || offset + sizeof(n) + bytes > size)
+                break;
+            Group g = {(size_t)n, rowsCount, reinterpret_cast<const double *>(data + offset + sizeof(n))};
+            groups.push_back(g);
+            rowsCount += (size_t)n;
+            offset += sizeof(n) + bytes;
+        }
+    }
+
+    double SnapshotReader::value(size_t row, size_t column) const {
+        assert(row < rowsCount && column < names.size());
+        size_t l = 0, r = groups.size();
+        while (r - l > 1) {
+            size_t m = (l + r) / 2;
+            if (groups[m].first <= row) {
+                l = m;
+            } else {
+                r = m;
+            }
+        }
+        const Group &g = groups[l];
+        return g.values[column * g.rows + (row - g.first)];
+    }
+
+    void SnapshotReader::column(size_t column, std::vector<double> &out) const {
+        assert(column < names.size());
+        out.resize(rowsCount);
+        for (size_t i = 0; i < groups.size(); i++) {
+            const Group &g = groups[i];
+            memcpy(&out[g.first], g.values + column * g.rows, g.rows * sizeof(double));
+        }
+    }
+}
+
+#endif //PROJECT_SNAPSHOTSTORE_H
@@ -0,0 +1,416 @@
+#ifndef SMPL_STATIC_ENGINE_H
+#define SMPL_STATIC_ENGINE_H
+
+#include <vector>
+#include <array>
+#include <deque>
+#include <map>
+#include <string>
+#include <algorithm>
+#include <type_traits>
+#include <new>
+#include <cassert>
+#include <cmath>
+#include <ctime>
+
+#include "Random.h"
+
+namespace smpl
+{
+    typedef unsigned int uint;
+    typedef unsigned long long u64;
+    typedef u64 transact_t;
+
+    /**
+     * Список типов событий модели для StaticEngine. Порядок типов задает порядок одновременных событий,
+     * как номер события в Engine
+     */
+    template<typename... Events>
+    struct EventTypes {};
+
+    namespace detail {
+        /** Номер типа T в списке Ts */
+        template<typename T, typename... Ts>
+        struct TypeIndex;
+
+        template<typename T, typename... Ts>
+        struct TypeIndex<T, T, Ts...> : std::integral_constant<uint, 0> {};
+
+        template<typename T, typename U, typename... Ts>
+        struct TypeIndex<T, U, Ts...> : std::integral_constant<uint, 1 + TypeIndex<T, Ts...>::value> {};
+
+        template<typename... Ts>
+        struct MaxSize : std::integral_constant<size_t, 1> {};
+
+        template<typename T, typename... Ts>
+        struct MaxSize<T, Ts...> : std::integral_constant<size_t,
+                (sizeof(T) > MaxSize<Ts...>::value ? sizeof(T) : MaxSize<Ts...>::value)> {};
+
+        template<typename... Ts>
+        struct MaxAlign : std::integral_constant<size_t, 1> {};
+
+        template<typename T, typename... Ts>
+        struct MaxAlign<T, Ts...> : std::integral_constant<size_t,
+                (alignof(T) > MaxAlign<Ts...>::value ? alignof(T) : MaxAlign<Ts...>::value)> {};
+
+        template<typename... Ts>
+        struct AllTrivial : std::true_type {};
+
+        template<typename T, typename... Ts>
+        struct AllTrivial<T, Ts...> : std::integral_constant<bool,
+                std::is_trivially_copyable<T>::value && AllTrivial<Ts...>::value> {};
+
+        /**
+         * Вызов обработчика по номеру типа: цепочка сравнений разворачивается при компиляции,
+         * и обработчики модели встраиваются в цикл событий
+         */
+        template<uint I, typename... Ts>
+        struct Dispatch {
+            template<typename Model, typename Engine>
+            static void call(uint, const void *, Model &, Engine &) {
+                assert(false);
+            }
+        };
+
+        template<uint I, typename T, typename... Ts>
+        struct Dispatch<I, T, Ts...> {
+            template<typename Model, typename Engine>
+            static void call(uint type, const void *payload, Model &model, Engine &e) {
+                if (type == I) {
+                    model.handle(*static_cast<const T *>(payload), e);
+                } else {
+                    Dispatch<I + 1, Ts...>::call(type, payload, model, e);
+                }
+            }
+        };
+    }
+
+    /**
+     * Устройство StaticEngine, статистика - как у Device
+     */
+    struct StaticDevice {
+        /** J, номер обрабатываемого транзакта. Если =0, то устройство свободно */
+        transact_t currentTransactId;
+        /** B, время последнего обращения */
+        time_t lastTimeUsed;
+        /** Z, счетчик запросов */
+        size_t transactCount;
+        /** SB, сумма периодов занятого состояния */
+        time_t timeUsedSum;
+
+        StaticDevice() : currentTransactId(0), lastTimeUsed(0), transactCount(0), timeUsedSum(0) {}
+    };
+
+    /**
+     * Очередь StaticEngine с дисциплиной FIFO, статистика - как у Queue
+     */
+    struct StaticQueue {
+        struct Item {
+            transact_t transactId;
+            time_t enqueued;
+        };
+
+        std::deque<Item> items;
+        /** Max, максимальная длина очереди */
+        size_t maxLength;
+        /** STQ, сумма произведений времени на длину очереди */
+        u64 timeQueueSum;
+        /** SW, сумма времен ожиданий */
+        u64 waitTimeSum;
+        /** TLast, время последнего изменения длины очереди*/
+        time_t lastTimeChanged;
+        /** Count, счетчик элементов */
+        size_t count;
+
+        StaticQueue() : maxLength(0), timeQueueSum(0), waitTimeSum(0), lastTimeChanged(0), count(0) {}
+    };
+
+    template<typename Model, typename Events, uint DevicesCount = 0, uint QueuesCount = 0>
+    class StaticEngine;
+
+    /**
+     * Движок с разрешаемой при компиляции диспетчеризацией. Модель объявляет события типами
+     * (тривиально копируемыми структурами с данными события) и обработчики - перегрузками
+     * void Model::handle(const Event &, StaticEngine &). Событие хранится в списке вместе с данными,
+     * без номеров событий, таблиц обработчиков и косвенных вызовов; отсутствие обработчика - ошибка
+     * компиляции. Устройства и очереди задаются количеством в параметрах шаблона, модель без них
+     * не хранит и не обновляет их статистику.
+     * Порядок событий совпадает с Engine: по времени, затем по номеру типа в EventTypes, затем
+     * в порядке планирования. Потоки случайных чисел те же, что у Engine с тем же зерном и прогоном,
+     * поэтому модель, перенесенная с Engine, дает те же результаты.
+     * Отмены событий и отчетов нет: для них и для событий, известных только во время выполнения,
+     * остается Engine
+     */
+    template<typename Model, typename... Events, uint DevicesCount, uint QueuesCount>
+    class StaticEngine<Model, EventTypes<Events...>, DevicesCount, QueuesCount> {
+        static_assert(sizeof...(Events) > 0, "Модель без событий");
+        static_assert(detail::AllTrivial<Events...>::value, "События должны быть тривиально копируемыми");
+
+    private:
+        typedef typename std::aligned_storage<detail::MaxSize<Events...>::value,
+                detail::MaxAlign<Events...>::value>::type Payload;
+
+        struct Entry {
+            time_t time;
+            u64 seq;
+            uint type;
+            Payload payload;
+        };
+
+        /** Обратный порядок для кучи std::push_heap: на вершине - самое раннее событие */
+        struct Later {
+            bool operator()(const Entry &a, const Entry &b) const {
+                return a.time > b.time || (a.time == b.time && (a.type > b.type ||
+                        (a.type == b.type && a.seq > b.seq)));
+            }
+        };
+
+        std::vector<Entry> events;
+        u64 nextSeq;
+        time_t _time;
+        bool stopped;
+        std::array<StaticDevice, DevicesCount> devices;
+        std::array<StaticQueue, QueuesCount> queues;
+        /** Дек, чтобы ссылки на потоки (VariateBuffer) не менялись при создании новых */
+        std::deque<RandomStream> streams;
+        std::map<std::string, uint> streamIds;
+        u64 seed, replication;
+
+    public:
+        StaticEngine() : nextSeq(0), _time(0), stopped(false), seed(0), replication(0) {
+            streamId("");
+        }
+
+        /**
+         * Номер типа события в EventTypes
+         */
+        template<typename E>
+        static constexpr uint typeOf() {
+            return detail::TypeIndex<E, Events...>::value;
+        }
+
+        time_t getTime() const {
+            return _time;
+        }
+
+        size_t pending() const {
+            return events.size();
+        }
+
+        /**
+         * Планирование события
+         * @param time Через сколько наступит
+         */
+        template<typename E>
+        void schedule(const E &event, time_t time) {
+            assert(time >= 0);
+            Entry entry;
+            entry.time = _time + time;
+            entry.seq = nextSeq++;
+            entry.type = typeOf<E>();
+            new(&entry.payload) E(event);
+            events.push_back(entry);
+            std::push_heap(events.begin(), events.end(), Later());
+        }
+
+        /**
+         * Наступление и обработка ближайшего события
+         * @return false - список событий пуст
+         */
+        bool step(Model &model) {
+            if (events.empty())
+                return false;
+            std::pop_heap(events.begin(), events.end(), Later());
+            Entry entry = events.back();
+            events.pop_back();
+            _time = entry.time;
+            detail::Dispatch<0, Events...>::call(entry.type, &entry.payload, model, *this);
+            return true;
+        }
+
+        /**
+         * Обработка событий до вызова stop или опустошения списка
+         * @return Обработано событий
+         */
+        u64 run(Model &model) {
+            stopped = false;
+            u64 count = 0;
+            while (!stopped && step(model))
+                count++;
+            return count;
+        }
+
+        /**
+         * Остановка run после текущего обработчика
+         */
+        void stop() {
+            stopped = true;
+        }
+
+        /**
+         * Очистка списка событий, времени и статистики для нового прогона. Потоки случайных чисел
+         * перезапускаются вызовом setSeed
+         */
+        void restart();
+
+        StaticDevice &device(uint i) {
+            static_assert(DevicesCount > 0, "Модель без устройств");
+            assert(i < DevicesCount);
+            return devices[i];
+        }
+
+        StaticQueue &queue(uint i) {
+            static_assert(QueuesCount > 0, "Модель без очередей");
+            assert(i < QueuesCount);
+            return queues[i];
+        }
+
+        void reserve(uint device, transact_t transactId);
+        void release(uint device);
+
+        /**
+         * Состояние устройства: 0 - свободно, иначе номер транзакта
+         */
+        transact_t status(uint device) {
+            return this->device(device).currentTransactId;
+        }
+
+        void enqueue(uint queue, transact_t transactId);
+        /**
+         * Извлечение первого транзакта очереди
+         */
+        transact_t head(uint queue);
+
+        size_t length(uint queue) {
+            return this->queue(queue).items.size();
+        }
+
+        /**
+         * Коэффициент использования устройства с начала прогона
+         */
+        double utilization(uint device);
+        /**
+         * Средняя длина очереди с начала прогона
+         */
+        double meanLength(uint queue);
+
+        /**
+         * Зерно эксперимента и номер прогона, как Engine::setSeed
+         */
+        void setSeed(u64 seed, u64 replication = 0);
+        uint streamId(const std::string &name);
+
+        RandomStream &stream(const std::string &name) {
+            return streams[streamId(name)];
+        }
+
+        RandomStream &stream(uint id) {
+            assert(id < streams.size());
+            return streams[id];
+        }
+
+        uint iRandom(uint L, uint R) {
+            return streams[0].uniformInt(L, R);
+        }
+
+        double fRandom() {
+            return streams[0].uniform();
+        }
+
+        uint negExp(uint x) {
+            return (uint) round(streams[0].exponential(x));
+        }
+    };
+
+    template<typename Model, typename... Events, uint DevicesCount, uint QueuesCount>
+    void StaticEngine<Model, EventTypes<Events...>, DevicesCount, QueuesCount>::restart() {
+        events.clear();
+        nextSeq = 0;
+        _time = 0;
+        stopped = false;
+        for (uint i = 0; i < DevicesCount; i++) {
+            devices[i] = StaticDevice();
+        }
+        for (uint i = 0; i < QueuesCount; i++) {
+            queues[i] = StaticQueue();
+        }
+    }
+
+    template<typename Model, typename... Events, uint DevicesCount, uint QueuesCount>
+    void StaticEngine<Model, EventTypes<Events...>, DevicesCount, QueuesCount>::reserve(uint device,
+            transact_t transactId) {
+        StaticDevice &d = this->device(device);
+        assert(d.currentTransactId == 0);
+        d.currentTransactId = transactId;
+        d.lastTimeUsed = _time;
+    }
+
+    template<typename Model, typename... Events, uint DevicesCount, uint QueuesCount>
+    void StaticEngine<Model, EventTypes<Events...>, DevicesCount, QueuesCount>::release(uint device) {
+        StaticDevice &d = this->device(device);
+        assert(d.currentTransactId != 0);
+        d.timeUsedSum += _time - d.lastTimeUsed;
+        d.transactCount++;
+        d.currentTransactId = 0;
+    }
+
+    template<typename Model, typename... Events, uint DevicesCount, uint QueuesCount>
+    void StaticEngine<Model, EventTypes<Events...>, DevicesCount, QueuesCount>::enqueue(uint queue,
+            transact_t transactId) {
+        StaticQueue &q = this->queue(queue);
+        q.timeQueueSum += (u64)(_time - q.lastTimeChanged) * q.items.size();
+        StaticQueue::Item item = {transactId, _time};
+        q.items.push_back(item);
+        q.count++;
+        q.maxLength = std::max(q.maxLength, q.items.size());
+        q.lastTimeChanged = _time;
+    }
+
+    template<typename Model, typename... Events, uint DevicesCount, uint QueuesCount>
+    transact_t StaticEngine<Model, EventTypes<Events...>, DevicesCount, QueuesCount>::head(uint queue) {
+        StaticQueue &q = this->queue(queue);
+        assert(!q.items.empty());
+        q.timeQueueSum += (u64)(_time - q.lastTimeChanged) * q.items.size();
+        StaticQueue::Item item = q.items.front();
+        q.items.pop_front();
+        q.waitTimeSum += _time - item.enqueued;
+        q.lastTimeChanged = _time;
+        return item.transactId;
+    }
+
+    template<typename Model, typename... Events, uint DevicesCount, uint QueuesCount>
+    double StaticEngine<Model, EventTypes<Events...>, DevicesCount, QueuesCount>::utilization(uint device) {
+        StaticDevice &d = this->device(device);
+        time_t busy = d.timeUsedSum + (d.currentTransactId != 0 ? _time - d.lastTimeUsed : 0);
+        return _time > 0 ? (double)busy / _time : 0;
+    }
+
+    template<typename Model, typename... Events, uint DevicesCount, uint QueuesCount>
+    double StaticEngine<Model, EventTypes<Events...>, DevicesCount, QueuesCount>::meanLength(uint queue) {
+        StaticQueue &q = this->queue(queue);
+        u64 sum = q.timeQueueSum + (u64)(_time - q.lastTimeChanged) * q.items.size();
+        return _time > 0 ? (double)sum / _time : 0;
+    }
+
+    template<typename Model, typename... Events, uint DevicesCount, uint QueuesCount>
+    void StaticEngine<Model, EventTypes<Events...>, DevicesCount, QueuesCount>::setSeed(u64 seed, u64 replication) {
+        this->seed = seed;
+        this->replication = replication;
+        for (std::map<std::string, uint>::iterator it = streamIds.begin(); it != streamIds.end(); it++) {
+            streams[it->second] = RandomStream(RandomStream::makeKey(seed, replication, it->first));
+        }
+    }
+
+    template<typename Model, typename... Events, uint DevicesCount, uint QueuesCount>
+    uint StaticEngine<Model, EventTypes<Events...>, DevicesCount, QueuesCount>::streamId(const std::string &name) {
+        std::map<std::string, uint>::iterator it = streamIds.find(name);
+        if (it != streamIds.end())
+            return it->second;
+        uint id = (uint)streams.size();
+        streams.push_back(RandomStream(RandomStream::makeKey(seed, replication, name)));
+        streamIds[name] = id;
+        return id;
+    }
+}
+
+#endif //SMPL_STATIC_ENGINE_H
@@ -0,0 +1,285 @@
+#ifndef PROJECT_STATISTICS_H
+#define PROJECT_STATISTICS_H
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cassert>
+
+namespace multiSMPL {
+
+    /**
+     * Выборочные характеристики по прогонам: среднее и дисперсия накапливаются
+     * методом Уэлфорда, доверительный интервал строится по распределению Стьюдента
+     */
+    class Summary {
+    private:
+        int n;
+        double mean;
+        /** Сумма квадратов отклонений от среднего */
+        double m2;
+
+    public:
+        Summary() : n(0), mean(0), m2(0) {}
+
+        void add(double x) {
+            n++;
+            double delta = x - mean;
+            mean += delta / n;
+            m2 += delta * (x - mean);
+        }
+
+        int count() const {
+            return n;
+        }
+
+        double getMean() const {
+            return mean;
+        }
+
+        /**
+         * Несмещенная выборочная дисперсия
+         */
+        double variance() const {
+            return n > 1 ? m2 / (n - 1) : 0;
+        }
+
+        /**
+         * Полуширина доверительного интервала для среднего
+         * @param confidence Доверительная вероятность, например 0.95
+         * @param estimated Число параметров, оцененных по тем же данным (уменьшает число степеней свободы)
+         */
+        double halfWidth(double confidence, int estimated = 0) const;
+
+        /**
+         * Характеристики средних соседних пар (x[0], x[1]), (x[2], x[3]), ... - оценка по антитетическим парам.
+         * Непарный последний элемент не учитывается
+         */
+        static Summary ofPairs(const std::vector<double> &x);
+        /**
+         * Характеристики разностей a[i] - b[i] - сравнение конфигураций на общих случайных числах
+         */
+        static Summary ofDifferences(const std::vector<double> &a, const std::vector<double> &b);
+        /**
+         * Оценка с контрольной переменной: Z_i = Y_i - beta (C_i - controlMean), где beta = cov(Y, C) / var(C)
+         * оценивается по тем же данным (для интервала следует передать estimated = 1)
+         * @param beta Оцененный коэффициент, если не nullptr
+         */
+        static Summary ofControlled(const std::vector<double> &y, const std::vector<double> &c, double controlMean,
+                double *beta = nullptr);
+
+        static double studentQuantile(double p, int df);
+        static double studentCDF(double t, int df);
+        static double incompleteBeta(double a, double b, double x);
+    };
+
+    double Summary::halfWidth(double confidence, int estimated) const {
+        if (n < 2 + estimated)
+            return INFINITY;
+        // Дисперсия остатков с учетом оцененных параметров
+        double s2 = m2 / (n - 1 - estimated);
+        return studentQuantile(1 - (1 - confidence) / 2, n - 1 - estimated) * sqrt(s2 / n);
+    }
+
+    Summary Summary::ofPairs(const std::vector<double> &x) {
+        Summary result;
+        for (size_t i = 0; i + 1 < x.size(); i += 2) {
+            result.add((x[i] + x[i + 1]) / 2);
+        }
+        return result;
+    }
+
+    Summary Summary::ofDifferences(const std::vector<double> &a, const std::vector<double> &b) {
+        Summary result;
+        for (size_t i = 0; i < a.size() && i < b.size(); i++) {
+            result.add(a[i] - b[i]);
+        }
+        return result;
+    }
+
+    Summary Summary::ofControlled(const std::vector<double> &y, const std::vector<double> &c, double controlMean,
+            double *beta) {
+        assert(y.size() == c.size());
+        Summary ys, cs;
+        for (size_t i = 0; i < y.size(); i++) {
+            ys.add(y[i]);
+            cs.add(c[i]);
+        }
+        double cov = 0;
+        for (size_t i = 0; i < y.size(); i++) {
+            cov += (y[i] - ys.mean) * (c[i] - cs.mean);
+        }
+        double b = cs.m2 > 0 ? cov / cs.m2 : 0;
+        if (beta != nullptr)
+            *beta = b;
+
+        Summary result;
+        for (size_t i = 0; i < y.size(); i++) {
+            result.add(y[i] - b * (c[i] - controlMean));
+        }
+        return result;
+    }
+
+    /**
+     * Регуляризованная неполная бета-функция I_x(a, b), цепная дробь Лентца
+     */
+    double Summary::incompleteBeta(double a, double b, double x) {
+        if (x <= 0)
+            return 0;
+        if (x >= 1)
+            return 1;
+        if (x > (a + 1) / (a + b + 2))
+            return 1 - incompleteBeta(b, a, 1 - x);
+
+        const double Tiny = 1e-300, Eps = 1e-15;
+        double front = exp(lgamma(a + b) - lgamma(a) - lgamma(b) + a * log(x) + b * log(1 - x)) / a;
+        double c = 1, d = 1 - (a + b) * x / (a + 1);
+        if (fabs(d) < Tiny)
+            d = Tiny;
+        d = 1 / d;
+        double f = d;
+        for (int m = 1; m <= 300; m++) {
+            double num = m * (b - m) * x / ((a + 2 * m - 1) * (a + 2 * m));
+            d = 1 + num * d;
+            c = 1 + num / c;
+            if (fabs(d) < Tiny) d = Tiny;
+            if (fabs(c) < Tiny) c = Tiny;
+            d = 1 / d;
+            f *= d * c;
+
+            num = -(a + m) * (a + b + m) * x / ((a + 2 * m) * (a + 2 * m + 1));
+            d = 1 + num * d;
+            c = 1 + num / c;
+            if (fabs(d) < Tiny) d = Tiny;
+            if (fabs(c) < Tiny) c = Tiny;
+            d = 1 / d;
+            double delta = d * c;
+            f *= delta;
+            if (fabs(delta - 1) < Eps)
+                break;
+        }
+        return front * f;
+    }
+
+    /**
+     * Функция распределения Стьюдента с df степенями свободы
+     */
+    double Summary::studentCDF(double t, int df) {
+        double tail = 0.5 * incompleteBeta(df / 2.0, 0.5, df / (df + t * t));
+        return t >= 0 ? 1 - tail : tail;
+    }
+
+    /**
+     * Квантиль уровня p распределения Стьюдента (бисекция по функции распределения)
+     */
+    double Summary::studentQuantile(double p, int df) {
+        assert(p > 0 && p < 1 && df > 0);
+        double lo = -1, hi = 1;
+        while (studentCDF(lo, df) > p)
+            lo *= 2;
+        while (studentCDF(hi, df) < p)
+            hi *= 2;
+        for (int i = 0; i < 100 && hi - lo > 1e-12 * (1 + fabs(hi)); i++) {
+            double mid = (lo + hi) / 2;
+            if (studentCDF(mid, df) < p) {
+                lo = mid;
+            } else {
+                hi = mid;
+            }
+        }
+        return (lo + hi) / 2;
+    }
+
+    /**
+     * Определение длины периода разгона правилом MSER-m (Marginal Standard Error Rule) по последовательности
+     * наблюдений: наблюдения объединяются в пачки по m, точка отсечения d выбирается по минимуму
+     * MSER(d) = sum_{j>=d} (z_j - z_d)^2 / (k - d)^2, где z_j - среднее j-й пачки, z_d - среднее пачек с d-й.
+     * Префиксные суммы пачек позволяют пересчитывать точку отсечения за O(k) после каждого наблюдения
+     */
+    class WarmupDetector {
+    private:
+        int batchSize;
+        /** Сумма наблюдений незаполненной пачки и их количество */
+        double partial;
+        int partialCount;
+        /** Префиксные суммы средних пачек и их квадратов, нулевой элемент - 0 */
+        std::vector<double> sums, squares;
+
+    public:
+        explicit WarmupDetector(int batchSize = 5) : batchSize(batchSize), partial(0), partialCount(0),
+                sums(1, 0.0), squares(1, 0.0) {
+            assert(batchSize > 0);
+        }
+
+        void add(double x) {
+            partial += x;
+            if (++partialCount < batchSize)
+                return;
+            double z = partial / batchSize;
+            sums.push_back(sums.back() + z);
+            squares.push_back(squares.back() + z * z);
+            partial = 0;
+            partialCount = 0;
+        }
+
+        /**
+         * Количество полных пачек
+         */
+        int batches() const {
+            return (int)sums.size() - 1;
+        }
+
+        /**
+         * Точка отсечения в пачках. Рассматривается только первая половина последовательности,
+         * так как на коротком хвосте MSER вырождается
+         */
+        int truncationBatch() const;
+
+        /**
+         * Точка отсечения в наблюдениях
+         */
+        int truncation() const {
+            return truncationBatch() * batchSize;
+        }
+
+        /**
+         * Разгон завершен: набрано не меньше minBatches пачек и точка отсечения лежит в первой половине
+         */
+        bool settled(int minBatches) const {
+            int k = batches();
+            return k >= minBatches && k >= 2 && truncationBatch() < k / 2;
+        }
+
+        /**
+         * Точка отсечения MSER-m для готовой последовательности, в наблюдениях
+         */
+        static int mser(const std::vector<double> &values, int batchSize = 5);
+    };
+
+    int WarmupDetector::truncationBatch() const {
+        int k = batches();
+        int best = 0;
+        double bestValue = INFINITY;
+        for (int d = 0; d <= k / 2 && d < k; d++) {
+            double m = k - d;
+            double s1 = sums[k] - sums[d];
+            double s2 = squares[k] - squares[d];
+            double value = std::max(s2 - s1 * s1 / m, 0.0) / (m * m);
+            if (value < bestValue) {
+                bestValue = value;
+                best = d;
+            }
+        }
+        return best;
+    }
+
+    int WarmupDetector::mser(const std::vector<double> &values, int batchSize) {
+        WarmupDetector detector(batchSize);
+        for (size_t i = 0; i < values.size(); i++) {
+            detector.add(values[i]);
+        }
+        return detector.truncation();
+    }
+}
+
+#endif //PROJECT_STATISTICS_H
@@ -0,0 +1,401 @@
+#ifndef PROJECT_SWEEP_H
+#define PROJECT_SWEEP_H
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cassert>
+
+#include "MultiSMPL.h"
+
+namespace multiSMPL {
+
+    /**
+     * Пространство параметров модели: полный факторный план или латинский гиперкуб
+     */
+    class ParameterSpace {
+    private:
+        struct Parameter {
+            std::string name;
+            /** Уровни для полного перебора */
+            std::vector<double> levels;
+            /** Уровни заданы перечислением, иначе латинский гиперкуб берет значения из диапазона */
+            bool enumerated;
+            double low, high;
+            bool integer;
+        };
+
+        std::vector<Parameter> parameters;
+
+    public:
+        /**
+         * Параметр с перечисленными уровнями. Латинский гиперкуб выбирает уровни равномерно по слоям
+         * @return Номер параметра
+         */
+        int addParameter(const std::string &name, const std::vector<double> &levels);
+        /**
+         * Параметр на отрезке [low; high]. Для полного перебора отрезок делится на levels равноотстоящих уровней
+         * @param integer Значения округляются до целых
+         * @return Номер параметра
+         */
+        int addParameter(const std::string &name, double low, double high, int levels = 2, bool integer = false);
+
+        std::vector<std::string> names() const;
+
+        size_t size() const {
+            return parameters.size();
+        }
+
+        /**
+         * Все сочетания уровней, последний параметр меняется быстрее всех
+         */
+        std::vector<std::vector<double>> grid() const;
+        /**
+         * Латинский гиперкуб из samples точек: диапазон каждого параметра делится на samples равновероятных слоев,
+         * в каждый слой попадает ровно одна точка, сочетание слоев разных параметров случайно
+         * @param seed Зерно выбора, одинаковое зерно дает одинаковый план
+         */
+        std::vector<std::vector<double>> latinHypercube(int samples, smpl::u64 seed = 0) const;
+    };
+
+    int ParameterSpace::addParameter(const std::string &name, const std::vector<double> &levels) {
+        assert(!levels.empty());
+        Parameter p;
+        p.name = name;
+        p.levels = levels;
+        p.low = *std::min_element(levels.begin(), levels.end());
+        p.high = *std::max_element(levels.begin(), levels.end());
+        p.enumerated = true;
+        p.integer = false;
+        parameters.push_back(p);
+        return (int)parameters.size() - 1;
+    }
+
+    int ParameterSpace::addParameter(const std::string &name, double low, double high, int levels, bool integer) {
+        assert(low <= high && levels >= 1);
+        Parameter p;
+        p.name = name;
+        p.low = low;
+        p.high = high;
+        p.enumerated = false;
+        p.integer = integer;
+        for (int i = 0; i < levels; i++) {
+            double x = levels == 1 ? low : low + (high - low) * i / (levels - 1);
+            p.levels.push_back(integer ? round(x) : x);
+        }
+        p.levels.erase(std::unique(p.levels.begin(), p.levels.end()), p.levels.end());
+        parameters.push_back(p);
+        return (int)parameters.size() - 1;
+    }
+
+    std::vector<std::string> ParameterSpace::names() const {
+        std::vector<std::string> result;
+        for (size_t i = 0; i < parameters.size(); i++) {
+            result.push_back(parameters[i].name);
+        }
+        return result;
+    }
+
+    std::vector<std::vector<double>> ParameterSpace::grid() const {
+        std::vector<std::vector<double>> result;
+        if (parameters.empty())
+            return result;
+        std::vector<size_t> index(parameters.size(), 0);
+        while (true) {
+            std::vector<double> point(parameters.size());
+            for (size_t i = 0; i < parameters.size(); i++) {
+                point[i] = parameters[i].levels[index[i]];
+            }
+            result.push_back(point);
+
+            size_t i = parameters.size();
+            while (i > 0 && ++index[i - 1] == parameters[i - 1].levels.size()) {
+                index[i - 1] = 0;
+                i--;
+            }
+            if (i == 0)
+                return result;
+        }
+    }
+
+    std::vector<std::vector<double>> ParameterSpace::latinHypercube(int samples, smpl::u64 seed) const {
+        assert(samples > 0);
+        std::vector<std::vector<double>> result(samples, std::vector<double>(parameters.size()));
+        smpl::RandomStream random(smpl::RandomStream::makeKey(seed, 0, "latinHypercube"));
+        std::vector<int> strata(samples);
+        for (size_t j = 0; j < parameters.size(); j++) {
+            const Parameter &p = parameters[j];
+            for (int i = 0; i < samples; i++) {
+                strata[i] = i;
+            }
+            // Перестановка Фишера - Йетса
+            for (int i = samples - 1; i > 0; i--) {
+                std::swap(strata[i], strata[random.uniformInt(0, i + 1)]);
+            }
+            for (int i = 0; i < samples; i++) {
+                double u = (strata[i] + random.uniform()) / samples;
+                double x;
+                if (p.enumerated) {
+                    // Перечисленные уровни: слой выбирает уровень
+                    x = p.levels[std::min((size_t)(u * p.levels.size()), p.levels.size() - 1)];
+                } else if (p.integer) {
+                    x = std::min(floor(p.low + u * (p.high - p.low + 1)), p.high);
+                } else {
+                    x = p.low + u * (p.high - p.low);
+                }
+                result[i][j] = x;
+            }
+        }
+        return result;
+    }
+
+    /**
+     * Прогон модели по набору конфигураций параметров. Все прогоны всех конфигураций - независимые задачи
+     * пула с захватом работы, поэтому конфигурации с долгими прогонами не задерживают остальные.
+     * Прогон r конфигурации c получает номер testNumber = c * replications + r, по которому обработчики
+     * находят значения параметров (value) и хранят состояние модели; число таких номеров - testsCount().
+     * Потоки случайных чисел выводятся из (seed, r), то есть конфигурации сравниваются на общих случайных числах.
+     * Устройства и очереди, показатели, зерно, число потоков и понижение дисперсии берутся из модели MultiSMPL
+     */
+    class Sweep {
+    private:
+        MultiSMPL &model;
+        std::vector<std::string> names;
+        std::vector<std::vector<double>> configurations;
+        int replications;
+        /** Оценки показателей по конфигурациям (как MultiSMPL::getEstimates) */
+        std::vector<std::vector<Estimate>> estimates;
+
+        /**
+         * Объединение результатов прогонов по конфигурациям, оценки и вывод таблицы
+         */
+        void finish(std::vector<MultiSMPL::ReplicationResult> &results);
+        void printResults();
+        static std::string toString(double x);
+
+    public:
+        /**
+         * @param names Имена параметров
+         */
+        Sweep(MultiSMPL &model, const std::vector<std::string> &names);
+
+        /**
+         * @return Номер конфигурации
+         */
+        int addConfiguration(const std::vector<double> &values);
+        void addConfigurations(const std::vector<std::vector<double>> &configurations);
+
+        /**
+         * Выполнение replications прогонов каждой конфигурации и вывод таблицы оценок по конфигурациям
+         * в текстовый и csv потоки модели. Отчеты отдельных прогонов не выводятся
+         */
+        void run(int replications, std::pair<smpl::u64, smpl::transact_t> startEvent, time_t startTime,
+                time_t (*monitorTime)(smpl::transact_t));
+        /**
+         * То же, что run, но прогоны выполняются рабочими процессами (MultiSMPL::runDistributed)
+         */
+        void runDistributed(int replications, int port, int localWorkers, int unitSize,
+                std::pair<smpl::u64, smpl::transact_t> startEvent, time_t startTime,
+                time_t (*monitorTime)(smpl::transact_t));
+        /**
+         * Рабочий процесс для runDistributed. Конфигурации и replications должны совпадать с координатором
+         * @return Количество выполненных порций
+         */
+        int runWorker(int replications, const std::string &host, int port,
+                std::pair<smpl::u64, smpl::transact_t> startEvent, time_t startTime,
+                time_t (*monitorTime)(smpl::transact_t));
+
+        int configurationsCount() const {
+            return (int)configurations.size();
+        }
+
+        /**
+         * Количество номеров прогонов для хранения состояния модели
+         */
+        int testsCount() const {
+            return (int)configurations.size() * replications;
+        }
+
+        int configurationOf(int testNumber) const {
+            return testNumber / replications;
+        }
+
+        /**
+         * Номер параметра по имени, -1 - нет такого параметра
+         */
+        int parameter(const std::string &name) const;
+
+        /**
+         * Значение параметра в конфигурации прогона testNumber
+         */
+        double value(int testNumber, int parameter) const {
+            return configurations[configurationOf(testNumber)][parameter];
+        }
+
+        double value(int testNumber, const std::string &name) const;
+
+        const std::vector<double> &getConfiguration(int configuration) const;
+        const std::vector<Estimate> &getEstimates(int configuration) const;
+    };
+
+    Sweep::Sweep(MultiSMPL &model, const std::vector<std::string> &names)
+            : model(model), names(names), replications(1) {}
+
+    int Sweep::addConfiguration(const std::vector<double> &values) {
+        assert(values.size() == names.size());
+        configurations.push_back(values);
+        return (int)configurations.size() - 1;
+    }
+
+    void Sweep::addConfigurations(const std::vector<std::vector<double>> &configurations) {
+        for (size_t i = 0; i < configurations.size(); i++) {
+            addConfiguration(configurations[i]);
+        }
+    }
+
+    int Sweep::parameter(const std::string &name) const {
+        for (size_t i = 0; i < names.size(); i++) {
+            if (names[i] == name)
+                return (int)i;
+        }
+        return -1;
+    }
+
+    double Sweep::value(int testNumber, const std::string &name) const {
+        int i = parameter(name);
+        assert(i >= 0);
+        return value(testNumber, i);
+    }
+
+    const std::vector<double> &Sweep::getConfiguration(int configuration) const {
+        assert(configuration >= 0 && configuration < (int)configurations.size());
+        return configurations[configuration];
+    }
+
+    const std::vector<Estimate> &Sweep::getEstimates(int configuration) const {
+        assert(configuration >= 0 && configuration < (int)estimates.size());
+        return estimates[configuration];
+    }
+
+    void Sweep::run(int replications, std::pair<smpl::u64, smpl::transact_t> startEvent, time_t startTime,
+            time_t (*monitorTime)(smpl::transact_t)) {
+        assert(replications > 0 && !configurations.empty());
+        assert(startTime >= 0);
+        assert(monitorTime == nullptr || model.handlers.has(SystemEventMonitor));
+        assert(model.handlers.has(startEvent.first));
+        assert(model.warmupMetric < 0 || monitorTime != nullptr);
+        this->replications = replications;
+
+        int tasks = testsCount();
+        std::vector<MultiSMPL::ReplicationResult> results(tasks);
+        int threads = model.threadsCount ? model.threadsCount : ThreadPool::defaultThreadsCount();
+        if (threads <= 1 || tasks <= 1) {
+            for (int i = 0; i < tasks; i++) {
+                model.runReplication(i, 0, results[i], nullptr, startEvent, startTime, monitorTime, nullptr,
+                        i % replications);
+            }
+        } else {
+            WorkStealingPool pool(std::min(threads, tasks));
+            model.reserveWorkers(pool.size());
+            for (int i = 0; i < tasks; i++) {
+                pool.submit([this, i, &results, startEvent, startTime, monitorTime](int worker) {
+                    model.runReplication(i, worker, results[i], nullptr, startEvent, startTime, monitorTime,
+                            nullptr, i % this->replications);
+                });
+            }
+            pool.wait();
+        }
+        model.flushTraces();
+        finish(results);
+    }
+
+    void Sweep::runDistributed(int replications, int port, int localWorkers, int unitSize,
+            std::pair<smpl::u64, smpl::transact_t> startEvent, time_t startTime,
+            time_t (*monitorTime)(smpl::transact_t)) {
+        assert(replications > 0 && !configurations.empty());
+        assert(startTime >= 0);
+        assert(monitorTime == nullptr || model.handlers.has(SystemEventMonitor));
+        assert(model.handlers.has(startEvent.first));
+        assert(model.warmupMetric < 0 || monitorTime != nullptr);
+        this->replications = replications;
+
+        std::vector<MultiSMPL::ReplicationResult> results(testsCount());
+        model.distribute(testsCount(), replications, false, port, localWorkers, unitSize, startEvent, startTime,
+                monitorTime, [&results](int number, MultiSMPL::ReplicationResult &result) {
+                    results[number] = std::move(result);
+                });
+        finish(results);
+    }
+
+    int Sweep::runWorker(int replications, const std::string &host, int port,
+            std::pair<smpl::u64, smpl::transact_t> startEvent, time_t startTime,
+            time_t (*monitorTime)(smpl::transact_t)) {
+        assert(replications > 0);
+        this->replications = replications;
+        return model.runWorker(host, port, startEvent, startTime, monitorTime);
+    }
+
+    void Sweep::finish(std::vector<MultiSMPL::ReplicationResult> &results) {
+        estimates.assign(configurations.size(), std::vector<Estimate>());
+        for (size_t c = 0; c < configurations.size(); c++) {
+            MultiSMPL::Accumulated accumulated;
+            model.startAccumulation(accumulated);
+            // Срезы отдельных конфигураций в файл не записываются
+            accumulated.snapshots.reset();
+            for (int r = 0; r < replications; r++) {
+                MultiSMPL::mergeReplication(results[c * replications + r], accumulated);
+            }
+            model.updateEstimates(accumulated);
+            estimates[c] = model.estimates;
+        }
+        printResults();
+    }
+
+    std::string Sweep::toString(double x) {
+        if (x == floor(x) && fabs(x) < 1e15)
+            return smpl::Engine::toString((long long)x);
+        return smpl::Engine::toString(x);
+    }
+
+    void Sweep::printResults() {
+        size_t metricsCount = model.metrics.size();
+        std::vector<std::vector<std::string>> table(1);
+        table[0] = names;
+        for (size_t m = 0; m < metricsCount; m++) {
+            table[0].push_back(model.metrics[m].name);
+            table[0].push_back("Полуширина");
+        }
+        std::vector<std::vector<std::string>> csvTable = table;
+
+        for (size_t c = 0; c < configurations.size(); c++) {
+            std::vector<std::string> row, csvRow;
+            for (size_t j = 0; j < names.size(); j++) {
+                row.push_back(toString(configurations[c][j]));
+                csvRow.push_back(MultiSMPL::toCSVString(configurations[c][j]));
+            }
+            for (size_t m = 0; m < metricsCount; m++) {
+                const Estimate &est = estimates[c][m];
+                double values[] = {est.mean, est.halfWidth};
+                for (int j = 0; j < 2; j++) {
+                    row.push_back(std::isfinite(values[j]) ? smpl::Engine::toString(values[j]) : "-");
+                    csvRow.push_back(std::isfinite(values[j]) ? MultiSMPL::toCSVString(values[j]) : "-");
+                }
+            }
+            table.push_back(row);
+            csvTable.push_back(csvRow);
+        }
+
+        if (model.fileOutputStream != nullptr) {
+            *model.fileOutputStream << "Оценки по конфигурациям (" << replications << " прогонов, "
+                                    << model.confidence * 100 << "%):" << std::endl;
+            *model.fileOutputStream << smpl::Engine::printTable(table) << std::endl;
+        }
+        if (model.csvOutputStream != nullptr) {
+            *model.csvOutputStream << "Оценки по конфигурациям: " << std::endl;
+            *model.csvOutputStream << MultiSMPL::printCSVTable(csvTable) << std::endl;
+        }
+    }
+}
+
+#endif //PROJECT_SWEEP_H
@@ -0,0 +1,289 @@
+#ifndef SMPL_TABLEWRITER_H
+#define SMPL_TABLEWRITER_H
+
+#include <string>
+#include <vector>
+#include <ostream>
+#include <algorithm>
+#include <type_traits>
+#include <cstdio>
+#include <cstring>
+#include <cassert>
+
+#if __cplusplus >= 201703L
+#include <charconv>
+#endif
+
+namespace smpl
+{
+    /**
+     * Буферизованный вывод в поток или в строку. Данные передаются приемнику
+     * крупными порциями при заполнении буфера, вызове flush и в деструкторе
+     */
+    class OutputBuffer {
+    public:
+        static const size_t BufferSize = 16 * 1024;
+
+    private:
+        std::ostream *stream;
+        std::string *text;
+        char data[BufferSize];
+        size_t used;
+
+        OutputBuffer(const OutputBuffer &);
+        OutputBuffer &operator=(const OutputBuffer &);
+
+    public:
+        explicit OutputBuffer(std::ostream &stream) : stream(&stream), text(NULL), used(0) {}
+        explicit OutputBuffer(std::string &text) : stream(NULL), text(&text), used(0) {}
+
+        ~OutputBuffer() {
+            flush();
+        }
+
+        void write(const char *s, size_t n) {
+            if (n > BufferSize - used) {
+                flush();
+                if (n >= BufferSize) {
+                    if (stream != NULL) {
+                        stream->write(s, n);
+                    } else {
+                        text->append(s, n);
+                    }
+                    return;
+                }
+            }
+            memcpy(data + used, s, n);
+            used += n;
+        }
+
+        void write(const std::string &s) {
+            write(s.data(), s.size());
+        }
+
+        void put(char c) {
+            if (used == BufferSize)
+                flush();
+            data[used++] = c;
+        }
+
+        /**
+         * n символов c
+         */
+        void fill(char c, size_t n) {
+            while (n > 0) {
+                if (used == BufferSize)
+                    flush();
+                size_t m = std::min(n, BufferSize - used);
+                memset(data + used, c, m);
+                used += m;
+                n -= m;
+            }
+        }
+
+        void flush() {
+            if (used == 0)
+                return;
+            if (stream != NULL) {
+                stream->write(data, used);
+            } else {
+                text->append(data, used);
+            }
+            used = 0;
+        }
+    };
+
+    /**
+     * Форматирование чисел без std::stringstream и без зависимости от локали.
+     * Результат совпадает с выводом потока с std::fixed и std::setprecision(precision)
+     */
+    namespace format {
+        /** Достаточно для любого double в фиксированной записи с точностью до 17 знаков */
+        const size_t MaxFixedLength = 352;
+
+        /**
+         * Запись x в buf (не менее MaxFixedLength байт), возвращает длину
+         * @param point Символ десятичного разделителя
+         */
+        inline size_t fixed(char *buf, double x, int precision = 5, char point = '.') {
+            assert(precision >= 0 && precision <= 17);
+#if __cplusplus >= 201703L
+            size_t n = std::to_chars(buf, buf + MaxFixedLength, x, std::chars_format::fixed, precision).ptr - buf;
+#else
+            int written = snprintf(buf, MaxFixedLength, "%.*f", precision, x);
+            if (written < 0)
+                return 0;
+            size_t n = std::min((size_t)written, MaxFixedLength - 1);
+#endif
+            if (precision == 0)
+                return n;
+            // Разделитель стоит перед последними precision цифрами; snprintf использует
+            // разделитель текущей локали C, поэтому он заменяется целиком
+            size_t p = 0;
+            while (p < n && ((buf[p] >= '0' && buf[p] <= '9') || buf[p] == '-'))
+                p++;
+            if (p == n || buf[p] == 'i' || buf[p] == 'n' || n < p + 1 + precision)
+                return n;
+            size_t fraction = n - precision;
+            buf[p] = point;
+            if (fraction > p + 1) {
+                for (size_t k = 0; k < (size_t)precision; k++) {
+                    buf[p + 1 + k] = buf[fraction + k];
+                }
+                n = p + 1 + precision;
+            }
+            return n;
+        }
+
+        inline size_t integer(char *buf, unsigned long long x, bool negative = false) {
+            char tmp[24];
+            size_t n = 0;
+            do {
+                tmp[n++] = (char)('0' + x % 10);
+                x /= 10;
+            } while (x != 0);
+            size_t len = 0;
+            if (negative)
+                buf[len++] = '-';
+            while (n > 0)
+                buf[len++] = tmp[--n];
+            return len;
+        }
+
+        template<typename T>
+        typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type
+        append(std::string &s, T x, char = '.') {
+            char buf[24];
+            unsigned long long magnitude = x < 0 ? 0ULL - (unsigned long long)x : (unsigned long long)x;
+            s.append(buf, integer(buf, magnitude, x < 0));
+        }
+
+        template<typename T>
+        typename std::enable_if<std::is_integral<T>::value && !std::is_signed<T>::value>::type
+        append(std::string &s, T x, char = '.') {
+            char buf[24];
+            s.append(buf, integer(buf, (unsigned long long)x));
+        }
+
+        template<typename T>
+        typename std::enable_if<std::is_floating_point<T>::value>::type
+        append(std::string &s, T x, char point = '.') {
+            char buf[MaxFixedLength];
+            s.append(buf, fixed(buf, (double)x, 5, point));
+        }
+
+        inline void append(std::string &s, const std::string &x, char = '.') {
+            s.append(x);
+        }
+
+        inline void append(std::string &s, const char *x, char = '.') {
+            s.append(x);
+        }
+    }
+
+    /**
+     * Строка таблицы. Ячейки сохраняют выделенную память между строками,
+     * поэтому заполнение очередной строки обычно не обращается к распределителю
+     */
+    class TableRow {
+    private:
+        std::vector<std::string> cells;
+
+    public:
+        explicit TableRow(size_t columns) : cells(columns) {}
+
+        size_t size() const {
+            return cells.size();
+        }
+
+        void clear() {
+            for (size_t i = 0; i < cells.size(); i++) {
+                cells[i].clear();
+            }
+        }
+
+        template<typename T>
+        void set(size_t column, const T &x) {
+            cells[column].clear();
+            format::append(cells[column], x);
+        }
+
+        std::string &operator[](size_t column) {
+            return cells[column];
+        }
+
+        const std::string &operator[](size_t column) const {
+            return cells[column];
+        }
+    };
+
+    /**
+     * Длина UTF-8 строки в символах
+     */
+    inline size_t utf8Length(const std::string &s) {
+        size_t len = 0;
+        for (size_t i = 0; i < s.size(); i++) {
+            len += (s[i] & 0xc0) != 0x80;
+        }
+        return len;
+    }
+
+    /**
+     * Вывод таблицы с рамкой и выравниванием по центру без построения таблицы в памяти.
+     * Строки запрашиваются у fill(i, row) дважды: первый проход определяет ширину столбцов,
+     * второй выводит. Нулевая строка - заголовок
+     * @param columns Число столбцов
+     * @param rows Число строк вместе с заголовком
+     */
+    template<typename F>
+    void writeTable(OutputBuffer &out, size_t columns, size_t rows, F fill) {
+        assert(rows > 0);
+        const size_t MinColumnWidth = 5;
+
+        TableRow row(columns);
+        std::vector<size_t> widths(columns, MinColumnWidth);
+        for (size_t i = 0; i < rows; i++) {
+            row.clear();
+            fill(i, row);
+            for (size_t j = 0; j < columns; j++) {
+                widths[j] = std::max(widths[j], utf8Length(row[j]));
+            }
+        }
+
+        std::string separator(1, '+');
+        for (size_t j = 0; j < columns; j++) {
+            separator.append(widths[j], '-');
+            separator.append(1, '+');
+        }
+        separator.append(1, '\n');
+
+        out.write(separator);
+        for (size_t i = 0; i < rows; i++) {
+            row.clear();
+            fill(i, row);
+            out.put('|');
+            for (size_t j = 0; j < columns; j++) {
+                size_t pad = widths[j] - std::min(widths[j], utf8Length(row[j]));
+                out.fill(' ', pad / 2);
+                out.write(row[j]);
+                out.fill(' ', pad - pad / 2);
+                out.put('|');
+            }
+            out.put('\n');
+            out.write(separator);
+        }
+    }
+
+    /**
+     * Строка CSV: каждая ячейка завершается разделителем ';'
+     */
+    inline void writeCSVRow(OutputBuffer &out, const TableRow &row) {
+        for (size_t j = 0; j < row.size(); j++) {
+            out.write(row[j]);
+            out.put(';');
+        }
+        out.put('\n');
+    }
+}
+
+#endif //SMPL_TABLEWRITER_H
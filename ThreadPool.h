@@ -0,0 +1,297 @@
+#ifndef PROJECT_THREADPOOL_H
+#define PROJECT_THREADPOOL_H
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cassert>
+
+namespace multiSMPL {
+
+    /**
+     * Пул потоков фиксированного размера
+     */
+    class ThreadPool {
+    private:
+        std::vector<std::thread> workers;
+        std::deque<std::function<void(int)>> tasks;
+        std::mutex mutex;
+        std::condition_variable hasTask, allDone;
+        /** Количество задач в очереди и в работе */
+        size_t unfinished;
+        bool stopping;
+
+        void workerLoop(int worker);
+
+    public:
+        /**
+         * @param threadsCount Количество потоков, 0 - по числу ядер
+         */
+        explicit ThreadPool(int threadsCount);
+        ~ThreadPool();
+
+        /**
+         * Постановка задачи в очередь
+         */
+        void submit(const std::function<void()> &task);
+        /**
+         * Постановка задачи, получающей номер выполняющего ее потока из [0; size()).
+         * Позволяет задачам одного потока использовать общие ресурсы без блокировок
+         */
+        void submitWithWorker(const std::function<void(int)> &task);
+        /**
+         * Ожидание завершения всех поставленных задач
+         */
+        void wait();
+        int size() const;
+
+        static int defaultThreadsCount();
+    };
+
+    ThreadPool::ThreadPool(int threadsCount) : unfinished(0), stopping(false) {
+        if (threadsCount <= 0)
+            threadsCount = defaultThreadsCount();
+        for (int i = 0; i < threadsCount; i++) {
+            workers.push_back(std::thread(&ThreadPool::workerLoop, this, i));
+        }
+    }
+
+    ThreadPool::~ThreadPool() {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        hasTask.notify_all();
+        for (size_t i = 0; i < workers.size(); i++) {
+            workers[i].join();
+        }
+    }
+
+    void ThreadPool::submit(const std::function<void()> &task) {
+        submitWithWorker([task](int) { task(); });
+    }
+
+    void ThreadPool::submitWithWorker(const std::function<void(int)> &task) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            tasks.push_back(task);
+            unfinished++;
+        }
+        hasTask.notify_one();
+    }
+
+    void ThreadPool::wait() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (unfinished > 0)
+            allDone.wait(lock);
+    }
+
+    int ThreadPool::size() const {
+        return (int)workers.size();
+    }
+
+    int ThreadPool::defaultThreadsCount() {
+        int n = (int)std::thread::hardware_concurrency();
+        return n > 0 ? n : 1;
+    }
+
+    void ThreadPool::workerLoop(int worker) {
+        while (true) {
+            std::function<void(int)> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                while (!stopping && tasks.empty())
+                    hasTask.wait(lock);
+                if (tasks.empty())
+                    return;
+                task = tasks.front();
+                tasks.pop_front();
+            }
+
+            task(worker);
+
+            std::unique_lock<std::mutex> lock(mutex);
+            if (--unfinished == 0)
+                allDone.notify_all();
+        }
+    }
+
+    /**
+     * Пул потоков с захватом работы: у каждого потока своя очередь задач. Поток берет задачи из конца
+     * своей очереди, а опустев - забирает задачи из начала очередей других потоков. Задачи сильно
+     * различающейся длительности распределяются между потоками без центральной очереди
+     */
+    class WorkStealingPool {
+    private:
+        struct Queue {
+            std::mutex mutex;
+            std::deque<std::function<void(int)>> tasks;
+        };
+
+        std::vector<std::thread> workers;
+        std::vector<std::unique_ptr<Queue>> queues;
+        /** Защищает ожидание на hasTask и allDone */
+        std::mutex mutex;
+        std::condition_variable hasTask, allDone;
+        /** Количество задач в очередях, еще не закрепленных за потоками */
+        std::atomic<size_t> queued;
+        /** Количество задач в очередях и в работе */
+        std::atomic<size_t> unfinished;
+        /** Очередь для следующей задачи submit */
+        std::atomic<size_t> next;
+        bool stopping;
+
+        void workerLoop(int worker);
+        /**
+         * Закрепление за потоком одной задачи из очередей: после успеха задача гарантированно
+         * есть в какой-то очереди
+         */
+        bool claim();
+        /**
+         * Извлечение задачи из своей очереди или из чужой
+         */
+        bool take(int worker, std::function<void(int)> &task);
+
+    public:
+        /**
+         * @param threadsCount Количество потоков, 0 - по числу ядер
+         */
+        explicit WorkStealingPool(int threadsCount);
+        ~WorkStealingPool();
+
+        /**
+         * Постановка задачи в очереди потоков по кругу. Задача получает номер выполняющего ее потока
+         */
+        void submit(const std::function<void(int)> &task);
+        /**
+         * Постановка задачи в очередь потока worker
+         */
+        void submit(int worker, const std::function<void(int)> &task);
+        /**
+         * Ожидание завершения всех поставленных задач
+         */
+        void wait();
+        int size() const;
+    };
+
+    WorkStealingPool::WorkStealingPool(int threadsCount) : queued(0), unfinished(0), next(0), stopping(false) {
+        if (threadsCount <= 0)
+            threadsCount = ThreadPool::defaultThreadsCount();
+        for (int i = 0; i < threadsCount; i++) {
+            queues.push_back(std::unique_ptr<Queue>(new Queue()));
+        }
+        for (int i = 0; i < threadsCount; i++) {
+            workers.push_back(std::thread(&WorkStealingPool::workerLoop, this, i));
+        }
+    }
+
+    WorkStealingPool::~WorkStealingPool() {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        hasTask.notify_all();
+        for (size_t i = 0; i < workers.size(); i++) {
+            workers[i].join();
+        }
+    }
+
+    void WorkStealingPool::submit(const std::function<void(int)> &task) {
+        submit((int)(next++ % queues.size()), task);
+    }
+
+    void WorkStealingPool::submit(int worker, const std::function<void(int)> &task) {
+        assert(worker >= 0 && worker < (int)queues.size());
+        // unfinished увеличивается раньше, чем задача становится доступна, иначе ее выполнение могло бы
+        // завершиться до учета и wait вернулся бы преждевременно; queued - после, чтобы закрепленная
+        // задача уже была в очереди
+        unfinished++;
+        {
+            std::unique_lock<std::mutex> lock(queues[worker]->mutex);
+            queues[worker]->tasks.push_back(task);
+        }
+        {
+            // Под мьютексом, чтобы поток между проверкой и hasTask.wait не пропустил уведомление
+            std::unique_lock<std::mutex> lock(mutex);
+            queued++;
+        }
+        hasTask.notify_one();
+    }
+
+    void WorkStealingPool::wait() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (unfinished > 0)
+            allDone.wait(lock);
+    }
+
+    int WorkStealingPool::size() const {
+        return (int)workers.size();
+    }
+
+    bool WorkStealingPool::claim() {
+        size_t n = queued.load();
+        while (n > 0) {
+            if (queued.compare_exchange_weak(n, n - 1))
+                return true;
+        }
+        return false;
+    }
+
+    bool WorkStealingPool::take(int worker, std::function<void(int)> &task) {
+        // Свои задачи выполняются в порядке постановки, как прогоны по номерам; чужие забираются с конца,
+        // где лежат задачи, до которых владелец дошел бы последними
+        {
+            Queue &own = *queues[worker];
+            std::unique_lock<std::mutex> lock(own.mutex);
+            if (!own.tasks.empty()) {
+                task = own.tasks.front();
+                own.tasks.pop_front();
+                return true;
+            }
+        }
+        for (size_t k = 1; k < queues.size(); k++) {
+            Queue &victim = *queues[(worker + k) % queues.size()];
+            std::unique_lock<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty()) {
+                task = victim.tasks.back();
+                victim.tasks.pop_back();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void WorkStealingPool::workerLoop(int worker) {
+        while (true) {
+            if (!claim()) {
+                std::unique_lock<std::mutex> lock(mutex);
+                while (!claim()) {
+                    // Оставшиеся задачи выполняются и после начала остановки
+                    if (stopping)
+                        return;
+                    hasTask.wait(lock);
+                }
+            }
+
+            std::function<void(int)> task;
+            // Закрепленная задача есть в очередях, но просмотр мог разминуться с ней, пока другие потоки
+            // забирали свои; повторный просмотр ее найдет
+            while (!take(worker, task))
+                std::this_thread::yield();
+
+            task(worker);
+
+            if (--unfinished == 0) {
+                std::unique_lock<std::mutex> lock(mutex);
+                allDone.notify_all();
+            }
+        }
+    }
+}
+
+#endif //PROJECT_THREADPOOL_H
@@ -0,0 +1,120 @@
+#ifndef SMPL_TIME_VARIABLE_H
+#define SMPL_TIME_VARIABLE_H
+
+#include <cstdlib>
+#include <cmath>
+#include <ctime>
+#include <new>
+#include <algorithm>
+
+namespace smpl
+{
+    /**
+     * Переменная модели с интегральной по времени статистикой (уровень запаса, число занятых мест).
+     * Интегралы досчитываются лениво - при изменении значения и при чтении статистики, поэтому между
+     * изменениями переменная ничего не стоит. Все поля занимают ровно одну строку кэша
+     */
+    struct TimeVariable {
+        /** Текущее значение */
+        double value;
+        /** Время, до которого досчитаны интегралы */
+        time_t last;
+        /** Интегралы значения, его квадрата, положительной и отрицательной части */
+        double integral, squares, positive, negative;
+        double min, max;
+
+        void reset(time_t now, double value) {
+            this->value = min = max = value;
+            last = now;
+            integral = squares = positive = negative = 0;
+        }
+
+        /**
+         * Досчет интегралов до момента now
+         */
+        void accumulate(time_t now) {
+            double dt = (double)(now - last);
+            if (dt == 0)
+                return;
+            double v = value * dt;
+            integral += v;
+            squares += v * value;
+            if (value > 0) {
+                positive += v;
+            } else {
+                negative -= v;
+            }
+            last = now;
+        }
+
+        void set(time_t now, double value) {
+            accumulate(now);
+            this->value = value;
+            if (value < min)
+                min = value;
+            if (value > max)
+                max = value;
+        }
+
+        /**
+         * Среднее по времени за duration (интегралы должны быть досчитаны)
+         */
+        double mean(time_t duration) const {
+            return duration > 0 ? integral / duration : value;
+        }
+
+        double positiveMean(time_t duration) const {
+            return duration > 0 ? positive / duration : std::max(value, 0.0);
+        }
+
+        double negativeMean(time_t duration) const {
+            return duration > 0 ? negative / duration : std::max(-value, 0.0);
+        }
+
+        double variance(time_t duration) const {
+            if (duration <= 0)
+                return 0;
+            double m = integral / duration;
+            return std::max(squares / duration - m * m, 0.0);
+        }
+    };
+
+    static_assert(sizeof(TimeVariable) == 64, "TimeVariable должна занимать одну строку кэша");
+
+    /**
+     * Распределитель с выравниванием по строке кэша: элемент TimeVariable не пересекает границу строк
+     */
+    template<typename T>
+    struct CacheLineAllocator {
+        typedef T value_type;
+        static const size_t Line = 64;
+
+        CacheLineAllocator() {}
+
+        template<typename U>
+        CacheLineAllocator(const CacheLineAllocator<U> &) {}
+
+        T *allocate(size_t n) {
+            void *p = nullptr;
+            if (posix_memalign(&p, Line, n * sizeof(T)) != 0)
+                throw std::bad_alloc();
+            return static_cast<T *>(p);
+        }
+
+        void deallocate(T *p, size_t) {
+            free(p);
+        }
+
+        template<typename U>
+        bool operator==(const CacheLineAllocator<U> &) const {
+            return true;
+        }
+
+        template<typename U>
+        bool operator!=(const CacheLineAllocator<U> &) const {
+            return false;
+        }
+    };
+}
+
+#endif //SMPL_TIME_VARIABLE_H
@@ -0,0 +1,221 @@
+#ifndef SMPL_TRACE_H
+#define SMPL_TRACE_H
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <cassert>
+#include <stdexcept>
+
+#include <unistd.h>
+
+#include "MappedFile.h"
+
+namespace smpl
+{
+    typedef unsigned int uint;
+    typedef unsigned long long u64;
+
+    /**
+     * Тип записи трассы
+     */
+    enum TraceKind {
+        /** Начало прогона: a - номер прогона, b - зерно */
+        TraceReplication = 1,
+        /** Планирование: a - событие, b - время наступления, object - запись таблицы событий */
+        TraceSchedule,
+        /** Наступление: a - событие, object - запись таблицы событий */
+        TraceCause,
+        /** Отмена: a - событие, b - время наступления, object - запись таблицы событий */
+        TraceCancel,
+        /** Занятие устройства object */
+        TraceReserve,
+        /** Освобождение устройства object */
+        TraceRelease,
+        /** Постановка в очередь object: a - приоритет, b - стадия */
+        TraceEnqueue,
+        /** Извлечение из очереди object: b - стадия */
+        TraceHead,
+        TraceKindsEnd
+    };
+
+    /**
+     * Запись трассы фиксированного размера
+     */
+    struct TraceRecord {
+        /** Модельное время */
+        long long time;
+        uint kind;
+        /** Номер устройства, очереди или записи таблицы событий */
+        uint object;
+        u64 a, b;
+        u64 transactId;
+
+        bool operator==(const TraceRecord &other) const {
+            return time == other.time && kind == other.kind && object == other.object && a == other.a &&
+                   b == other.b && transactId == other.transactId;
+        }
+
+        bool operator!=(const TraceRecord &other) const {
+            return !(*this == other);
+        }
+    };
+
+    /**
+     * Формат файла трассы: "SMPLTRAC", u32 версия, u32 размер записи, затем записи TraceRecord подряд
+     */
+    const char TraceMagic[8] = {'S', 'M', 'P', 'L', 'T', 'R', 'A', 'C'};
+    const uint TraceVersion = 1;
+
+    /**
+     * Запись трассы движка. Записи накапливаются в кольцевом буфере; в файловом режиме заполненный буфер
+     * целиком дописывается в файл, в режиме самописца старые записи затираются, и в файл при flush
+     * попадают только последние capacity записей. Трасса принадлежит одному движку (одному потоку).
+     * Деструктор дописывает оставшиеся записи, но ошибку записи не сообщает - для ее проверки flush
+     * вызывается явно
+     */
+    class TraceWriter {
+    private:
+        FILE *file;
+        std::vector<TraceRecord> buffer;
+        /** Начало и количество записей в буфере */
+        size_t first, count;
+        bool ring;
+        u64 written;
+
+        TraceWriter(const TraceWriter &);
+        TraceWriter &operator=(const TraceWriter &);
+
+        void writeRaw(const void *data, size_t size) {
+            if (size && fwrite(data, 1, size, file) != size)
+                throw std::runtime_error("Ошибка записи трассы");
+        }
+
+    public:
+        /**
+         * @param path Файл трассы, существующий файл перезаписывается
+         * @param capacity Размер буфера в записях
+         * @param ring Режим самописца: в файле остаются только последние capacity записей
+         */
+        explicit TraceWriter(const std::string &path, size_t capacity = 64 * 1024, bool ring = false);
+        ~TraceWriter();
+
+        void record(uint kind, long long time, uint object, u64 a, u64 b, u64 transactId) {
+            TraceRecord &r = buffer[(first + count) % buffer.size()];
+            r.time = time;
+            r.kind = kind;
+            r.object = object;
+            r.a = a;
+            r.b = b;
+            r.transactId = transactId;
+            if (count < buffer.size()) {
+                if (++count == buffer.size() && !ring)
+                    flush();
+            } else {
+                first = (first + 1) % buffer.size();
+            }
+        }
+
+        /**
+         * Запись накопленных записей в файл. В режиме самописца файл перезаписывается последними записями
+         */
+        void flush();
+
+        /**
+         * Количество записей, переданных в файл
+         */
+        u64 records() const {
+            return written;
+        }
+    };
+
+    TraceWriter::TraceWriter(const std::string &path, size_t capacity, bool ring)
+            : buffer(capacity), first(0), count(0), ring(ring), written(0) {
+        assert(capacity > 0);
+        file = fopen(path.c_str(), "wb");
+        if (file == NULL)
+            throw std::runtime_error("Не удалось открыть файл трассы " + path);
+        writeRaw(TraceMagic, sizeof(TraceMagic));
+        uint header[2] = {TraceVersion, (uint)sizeof(TraceRecord)};
+        writeRaw(header, sizeof(header));
+        fflush(file);
+    }
+
+    TraceWriter::~TraceWriter() {
+        try {
+            flush();
+        } catch (const std::runtime_error &) {
+            // Исключение из деструктора завершило бы программу
+        }
+        fclose(file);
+    }
+
+    void TraceWriter::flush() {
+        if (ring) {
+            // Файл содержит только последние записи
+            if (fseek(file, sizeof(TraceMagic) + 2 * sizeof(uint), SEEK_SET) != 0 ||
+                    ftruncate(fileno(file), sizeof(TraceMagic) + 2 * sizeof(uint)) != 0)
+                throw std::runtime_error("Ошибка записи трассы");
+            written = 0;
+        }
+        size_t tail = std::min(count, buffer.size() - first);
+        writeRaw(&buffer[first], tail * sizeof(TraceRecord));
+        writeRaw(&buffer[0], (count - tail) * sizeof(TraceRecord));
+        fflush(file);
+        written += count;
+        if (!ring)
+            first = count = 0;
+    }
+
+    /**
+     * Чтение файла трассы через отображение в память
+     */
+    class TraceReader {
+    private:
+        MappedFile file;
+        const TraceRecord *records;
+        size_t count;
+
+        TraceReader(const TraceReader &);
+        TraceReader &operator=(const TraceReader &);
+
+    public:
+        explicit TraceReader(const std::string &path);
+
+        size_t length() const {
+            return count;
+        }
+
+        const TraceRecord &operator[](size_t i) const {
+            assert(i < count);
+            return records[i];
+        }
+
+        static const char *kindName(uint kind);
+    };
+
+    TraceReader::TraceReader(const std::string &path) : file(path, "трассы"), records(NULL), count(0) {
+        const char *data = file.bytes();
+        size_t size = file.length();
+        uint header[2];
+        size_t offset = sizeof(TraceMagic) + sizeof(header);
+        if (size < offset || memcmp(data, TraceMagic, sizeof(TraceMagic)) != 0)
+            throw std::runtime_error("Неверный формат файла трассы " + path);
+        memcpy(header, data + sizeof(TraceMagic), sizeof(header));
+        if (header[0] != TraceVersion || header[1] != sizeof(TraceRecord))
+            throw std::runtime_error("Неподдерживаемая версия файла трассы " + path);
+        // Неполная последняя запись (запись прервана) отбрасывается
+        count = (size - offset) / sizeof(TraceRecord);
+        records = reinterpret_cast<const TraceRecord *>(data + offset);
+    }
+
+    const char *TraceReader::kindName(uint kind) {
+        static const char *names[] = {"?", "replication", "schedule", "cause", "cancel", "reserve", "release",
+                                      "enqueue", "head"};
+        return kind < TraceKindsEnd ? names[kind] : names[0];
+    }
+}
+
+#endif //SMPL_TRACE_H
@@ -0,0 +1,234 @@
+#ifndef SMPL_TRANSACT_TABLE_H
+#define SMPL_TRANSACT_TABLE_H
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <typeinfo>
+#include <cassert>
+#include <ctime>
+
+namespace smpl
+{
+    typedef unsigned int uint;
+    typedef unsigned long long u64;
+    typedef u64 transact_t;
+
+    /**
+     * Номер столбца атрибута типа T в TransactTable
+     */
+    template<typename T>
+    struct Attribute {
+        uint column;
+    };
+
+    /**
+     * Таблица транзактов: атрибуты хранятся по столбцам (структура массивов), номер транзакта -
+     * поколение в старших 32 битах и номер строки в младших. Строки удаленных транзактов используются
+     * повторно, а поколение строки увеличивается, поэтому устаревший номер не совпадает с новым
+     * транзактом и обнаруживается проверкой alive. Нулевой номер недействителен, как у Device
+     */
+    class TransactTable {
+    private:
+        struct ColumnBase {
+            std::string name;
+            const std::type_info *type;
+
+            virtual ~ColumnBase() {}
+            virtual void resize(size_t rows) = 0;
+            virtual void clear(uint row) = 0;
+            virtual ColumnBase *clone() const = 0;
+        };
+
+        template<typename T>
+        struct Column : ColumnBase {
+            std::vector<T> values;
+            T initial;
+
+            void resize(size_t rows) {
+                values.resize(rows, initial);
+            }
+
+            void clear(uint row) {
+                values[row] = initial;
+            }
+
+            ColumnBase *clone() const {
+                return new Column<T>(*this);
+            }
+        };
+
+        /** Поколение строки; строка занята, если ее номер не в freeRows */
+        std::vector<uint> generations;
+        /** Время создания транзакта строки */
+        std::vector<time_t> created;
+        std::vector<uint> freeRows;
+        std::vector<std::unique_ptr<ColumnBase>> columns;
+
+    public:
+        /** Живых транзактов сейчас и наибольшее их число */
+        size_t live, maxLive;
+        /** Создано и удалено транзактов */
+        u64 createdCount, destroyedCount;
+        /** Сумма времен жизни удаленных транзактов */
+        u64 lifetimeSum;
+
+        TransactTable() : live(0), maxLive(0), createdCount(0), destroyedCount(0), lifetimeSum(0) {}
+
+        TransactTable(const TransactTable &other);
+        TransactTable &operator=(const TransactTable &other);
+
+        static uint rowOf(transact_t id) {
+            return (uint)(id & 0xffffffffu);
+        }
+
+        static uint generationOf(transact_t id) {
+            return (uint)(id >> 32);
+        }
+
+        /**
+         * Регистрация атрибута; повторная регистрация с тем же именем возвращает тот же столбец
+         * @param initial Значение атрибута нового транзакта
+         */
+        template<typename T>
+        Attribute<T> addAttribute(const std::string &name, const T &initial = T());
+
+        /**
+         * Создание транзакта в момент now
+         */
+        transact_t create(time_t now);
+        /**
+         * Удаление транзакта, строка освобождается для повторного использования
+         */
+        void destroy(transact_t id, time_t now);
+
+        bool alive(transact_t id) const {
+            uint row = rowOf(id);
+            return row < generations.size() && generations[row] == generationOf(id) && (generations[row] & 1);
+        }
+
+        /**
+         * Атрибут транзакта: прямое обращение к строке столбца
+         */
+        template<typename T>
+        T &get(Attribute<T> attribute, transact_t id) {
+            assert(alive(id) && attribute.column < columns.size());
+            return static_cast<Column<T> *>(columns[attribute.column].get())->values[rowOf(id)];
+        }
+
+        time_t createdAt(transact_t id) const {
+            assert(alive(id));
+            return created[rowOf(id)];
+        }
+
+        /**
+         * Удаление всех транзактов; атрибуты остаются зарегистрированными
+         */
+        void clear();
+        /**
+         * Сброс счетчиков, живые транзакты остаются
+         */
+        void resetStatistics();
+    };
+
+    TransactTable::TransactTable(const TransactTable &other)
+            : generations(other.generations), created(other.created), freeRows(other.freeRows), live(other.live),
+            maxLive(other.maxLive), createdCount(other.createdCount), destroyedCount(other.destroyedCount),
+            lifetimeSum(other.lifetimeSum) {
+        for (size_t i = 0; i < other.columns.size(); i++) {
+            columns.emplace_back(other.columns[i]->clone());
+        }
+    }
+
+    TransactTable &TransactTable::operator=(const TransactTable &other) {
+        if (this == &other)
+            return *this;
+        generations = other.generations;
+        created = other.created;
+        freeRows = other.freeRows;
+        columns.clear();
+        for (size_t i = 0; i < other.columns.size(); i++) {
+            columns.emplace_back(other.columns[i]->clone());
+        }
+        live = other.live;
+        maxLive = other.maxLive;
+        createdCount = other.createdCount;
+        destroyedCount = other.destroyedCount;
+        lifetimeSum = other.lifetimeSum;
+        return *this;
+    }
+
+    template<typename T>
+    Attribute<T> TransactTable::addAttribute(const std::string &name, const T &initial) {
+        Attribute<T> attribute;
+        for (size_t i = 0; i < columns.size(); i++) {
+            if (columns[i]->name == name) {
+                assert(*columns[i]->type == typeid(T));
+                attribute.column = (uint)i;
+                return attribute;
+            }
+        }
+        Column<T> *column = new Column<T>();
+        column->name = name;
+        column->type = &typeid(T);
+        column->initial = initial;
+        column->resize(generations.size());
+        columns.emplace_back(column);
+        attribute.column = (uint)columns.size() - 1;
+        return attribute;
+    }
+
+    transact_t TransactTable::create(time_t now) {
+        uint row;
+        if (freeRows.empty()) {
+            row = (uint)generations.size();
+            // Нечетное поколение - строка занята, четное - свободна
+            generations.push_back(0);
+            created.push_back(0);
+            for (size_t i = 0; i < columns.size(); i++) {
+                columns[i]->resize(generations.size());
+            }
+        } else {
+            row = freeRows.back();
+            freeRows.pop_back();
+        }
+        generations[row]++;
+        created[row] = now;
+        live++;
+        if (live > maxLive)
+            maxLive = live;
+        createdCount++;
+        return ((transact_t)generations[row] << 32) | row;
+    }
+
+    void TransactTable::destroy(transact_t id, time_t now) {
+        assert(alive(id));
+        uint row = rowOf(id);
+        generations[row]++;
+        for (size_t i = 0; i < columns.size(); i++) {
+            columns[i]->clear(row);
+        }
+        freeRows.push_back(row);
+        live--;
+        destroyedCount++;
+        lifetimeSum += (u64)(now - created[row]);
+    }
+
+    void TransactTable::clear() {
+        generations.clear();
+        created.clear();
+        freeRows.clear();
+        for (size_t i = 0; i < columns.size(); i++) {
+            columns[i]->resize(0);
+        }
+        live = maxLive = 0;
+        createdCount = destroyedCount = lifetimeSum = 0;
+    }
+
+    void TransactTable::resetStatistics() {
+        maxLive = live;
+        createdCount = destroyedCount = lifetimeSum = 0;
+    }
+}
+
+#endif //SMPL_TRANSACT_TABLE_H
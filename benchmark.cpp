@@ -0,0 +1,359 @@
+#include <iostream>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include "smpl.h"
+#include "MultiSMPL.h"
+#include "StaticEngine.h"
+#include "Partitioned.h"
+
+using namespace std;
+using namespace smpl;
+
+// Классический hold-тест: в списке постоянно находится size событий,
+// каждое извлеченное событие заменяется новым со случайной задержкой
+struct HoldResult {
+    double eventsPerSecond;
+    u64 checksum;
+};
+
+HoldResult holdBenchmark(EventListType type, size_t size, size_t steps, time_t meanDelay) {
+    Engine e(nullptr, type);
+    mt19937_64 gen(12345);
+    exponential_distribution<double> delay(1.0 / meanDelay);
+
+    for (size_t i = 0; i < size; i++) {
+        e.schedule(i % 7, (time_t)delay(gen), i);
+    }
+
+    u64 checksum = 0;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (size_t i = 0; i < steps; i++) {
+        pair<u64, transact_t> top = e.cause();
+        checksum = checksum * 31 + top.second;
+        e.schedule(top.first, (time_t)delay(gen), top.second);
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    HoldResult res = {steps / seconds, checksum};
+    return res;
+}
+
+// Генерация экспоненциальных величин: поштучно через Engine::negExp и пачкой через VariateBuffer
+void variatesBenchmark(size_t count) {
+    Engine e(nullptr);
+    e.setSeed(1);
+    u64 sum = 0;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (size_t i = 0; i < count; i++) {
+        sum += e.negExp(10);
+    }
+    double scalar = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    VariateBuffer buffer(e.stream("batch"), Distribution::exponential(10));
+    start = chrono::steady_clock::now();
+    for (size_t i = 0; i < count; i++) {
+        sum += (u64)round(buffer.next());
+    }
+    double batch = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    cout << "variates;scalar negExp/sec;batch/sec" << endl;
+    cout << "exponential;" << (u64)(count / scalar) << ';' << (u64)(count / batch) << " (" << sum % 10 << ')' << endl;
+}
+
+// Модель склада из main.cpp без срезов: на Engine с таблицей обработчиков и на StaticEngine
+namespace inventory {
+    const time_t SCALE = 100, END_TIME = 120 * SCALE, GENERATE_TIME = 10;
+    const int LEVEL = 10, MAX_SIZE = 50, K = 30, N = 3;
+
+    struct State {
+        time_t last;
+        double I, IPosAcc, INegAcc, money;
+        VariateBuffer arrivals, demand;
+
+        template<typename E>
+        void start(E &e) {
+            last = 0;
+            I = 50;
+            IPosAcc = INegAcc = money = 0;
+            arrivals = VariateBuffer(e.stream("arrivals"), Distribution::exponential(GENERATE_TIME));
+            demand = VariateBuffer(e.stream("demand"), Distribution::uniform(0, 1));
+        }
+
+        void change(time_t now, double delta) {
+            IPosAcc += max(0.0, I) * (int)(now - last);
+            INegAcc += max(0.0, -I) * (int)(now - last);
+            I += delta;
+            last = now;
+        }
+
+        int demandSize() {
+            double value = demand.next();
+            return value <= 0.1 ? 1 : value <= 0.4 ? 2 : value <= 0.8 ? 3 : 4;
+        }
+
+        double checksum() const {
+            return money + IPosAcc + INegAcc + I;
+        }
+    };
+
+    enum { EventStart = 1, EventGenerate, EventGetOrder, EventCheck };
+
+    State runtimeState;
+
+    void startHandler(pair<u64, transact_t>, int, Engine *e) {
+        runtimeState.start(*e);
+        e->schedule(EventGenerate, (time_t)round(runtimeState.arrivals.next()), 1);
+        e->schedule(EventCheck, 0, 1);
+        e->schedule(multiSMPL::SystemEventEnd, END_TIME, 1);
+    }
+
+    void generateHandler(pair<u64, transact_t> event, int, Engine *e) {
+        runtimeState.change(e->getTime(), -runtimeState.demandSize());
+        e->schedule(EventGenerate, (time_t)round(runtimeState.arrivals.next()), event.second + 1);
+    }
+
+    void getOrderHandler(pair<u64, transact_t> event, int, Engine *e) {
+        runtimeState.money += K + N * event.second;
+        runtimeState.change(e->getTime(), (double)event.second);
+    }
+
+    void checkHandler(pair<u64, transact_t>, int, Engine *e) {
+        if (runtimeState.I < LEVEL)
+            e->schedule(EventGetOrder, e->iRandom(SCALE / 2, SCALE), (transact_t)(MAX_SIZE - runtimeState.I));
+        e->schedule(EventCheck, SCALE, 1);
+    }
+
+    void endHandler(pair<u64, transact_t>, int, Engine *) {}
+
+    // Та же модель на типах событий
+    struct Start {};
+    struct Generate { transact_t number; };
+    struct GetOrder { int size; };
+    struct Check {};
+    struct End {};
+
+    struct Model {
+        typedef StaticEngine<Model, EventTypes<Start, Generate, GetOrder, Check, End>> Engine;
+        State s;
+
+        void handle(const Start &, Engine &e) {
+            s.start(e);
+            e.schedule(Generate{1}, (time_t)round(s.arrivals.next()));
+            e.schedule(Check(), 0);
+            e.schedule(End(), END_TIME);
+        }
+
+        void handle(const Generate &event, Engine &e) {
+            s.change(e.getTime(), -s.demandSize());
+            e.schedule(Generate{event.number + 1}, (time_t)round(s.arrivals.next()));
+        }
+
+        void handle(const GetOrder &event, Engine &e) {
+            s.money += K + N * event.size;
+            s.change(e.getTime(), event.size);
+        }
+
+        void handle(const Check &, Engine &e) {
+            if (s.I < LEVEL)
+                e.schedule(GetOrder{(int)(MAX_SIZE - s.I)}, e.iRandom(SCALE / 2, SCALE));
+            e.schedule(Check(), SCALE);
+        }
+
+        void handle(const End &, Engine &e) {
+            e.stop();
+        }
+    };
+}
+
+// Прогоны модели склада на обоих движках: число событий в секунду и совпадение результатов
+void inventoryBenchmark(int replications) {
+    using namespace inventory;
+    multiSMPL::HandlerTable handlers;
+    handlers.add(EventStart, startHandler);
+    handlers.add(EventGenerate, generateHandler);
+    handlers.add(EventGetOrder, getOrderHandler);
+    handlers.add(EventCheck, checkHandler);
+    handlers.add(multiSMPL::SystemEventEnd, endHandler);
+
+    Engine e(nullptr);
+    u64 runtimeEvents = 0;
+    double runtimeSum = 0;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (int r = 0; r < replications; r++) {
+        e.restart();
+        e.setSeed(456987, r);
+        e.schedule(EventStart, 0, 0);
+        pair<u64, transact_t> top;
+        do {
+            top = e.cause();
+            handlers.dispatch(top, r, &e);
+            runtimeEvents++;
+        } while (top.first != multiSMPL::SystemEventEnd);
+        runtimeSum += runtimeState.checksum();
+    }
+    double runtime = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    Model model;
+    Model::Engine s;
+    u64 staticEvents = 0;
+    double staticSum = 0;
+    start = chrono::steady_clock::now();
+    for (int r = 0; r < replications; r++) {
+        s.restart();
+        s.setSeed(456987, r);
+        s.schedule(Start(), 0);
+        staticEvents += s.run(model);
+        staticSum += model.s.checksum();
+    }
+    double compiled = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    cout << "inventory;engine events/sec;static events/sec;results match" << endl;
+    cout << replications << ';' << (u64)(runtimeEvents / runtime) << ';' << (u64)(staticEvents / compiled) << ';'
+         << (runtimeEvents == staticEvents && runtimeSum == staticSum ? "yes" : "no") << endl;
+}
+
+// Сеть слабо связанных систем массового обслуживания: у каждого узла свои источник, устройство и очередь,
+// обслуженная заявка с вероятностью ROUTE уходит в случайный другой узел с задержкой не меньше LOOKAHEAD
+namespace network {
+    const time_t ARRIVAL = 1000, SERVICE = 800, LOOKAHEAD = 500, TRANSPORT = 2000;
+    const double ROUTE = 0.3;
+
+    enum Events {
+        EventGenerate,
+        EventArrive,
+        EventRelease
+    };
+
+    struct Node {
+        Device *device;
+        Queue *queue;
+        RandomStream *arrivals, *service, *routing;
+        u64 created, served, checksum;
+    };
+
+    void arrive(LogicalProcess &lp, Node &node, transact_t transactId) {
+        if (node.device->status() == 0) {
+            node.device->reserve(transactId);
+            lp.schedule(EventRelease, (time_t)node.service->exponential(SERVICE), transactId);
+        } else {
+            node.queue->enqueue(transactId, 0, 0);
+        }
+    }
+
+    void handle(vector<Node> &nodes, LogicalProcess &lp, pair<u64, transact_t> ev) {
+        Node &node = nodes[lp.getIndex()];
+        switch (ev.first) {
+            case EventGenerate:
+                arrive(lp, node, ((transact_t)lp.getIndex() << 40) | ++node.created);
+                lp.schedule(EventGenerate, (time_t)node.arrivals->exponential(ARRIVAL), 0);
+                break;
+            case EventArrive:
+                arrive(lp, node, ev.second);
+                break;
+            case EventRelease: {
+                node.device->release();
+                node.served++;
+                node.checksum = node.checksum * 31 + ev.second + (u64)lp.getTime();
+                if (node.routing->uniform() < ROUTE) {
+                    uint target = (uint)(node.routing->uniform() * nodes.size());
+                    lp.send(target, EventArrive, LOOKAHEAD + (time_t)node.routing->exponential(TRANSPORT), ev.second);
+                }
+                if (node.queue->length() > 0) {
+                    u64 stage;
+                    transact_t next = node.queue->head(stage);
+                    node.device->reserve(next);
+                    lp.schedule(EventRelease, (time_t)node.service->exponential(SERVICE), next);
+                }
+                break;
+            }
+        }
+    }
+
+    // Прогон сети; результат - свертка статистики всех узлов для сравнения режимов
+    u64 run(uint nodesCount, time_t until, bool sequential, int threadsCount, u64 &events, double &seconds) {
+        PartitionedEngine model(nodesCount, LOOKAHEAD, sequential);
+        vector<Node> nodes(nodesCount);
+        for (uint i = 0; i < nodesCount; i++) {
+            LogicalProcess &lp = model.process(i);
+            Node &node = nodes[i];
+            node.device = lp.createDevice("узел " + Engine::toString(i));
+            node.queue = lp.createQueue("очередь " + Engine::toString(i));
+            node.created = node.served = node.checksum = 0;
+        }
+        model.setSeed(2024);
+        for (uint i = 0; i < nodesCount; i++) {
+            LogicalProcess &lp = model.process(i);
+            nodes[i].arrivals = &lp.stream("arrivals");
+            nodes[i].service = &lp.stream("service");
+            nodes[i].routing = &lp.stream("routing");
+            lp.schedule(EventGenerate, 0, 0);
+        }
+        model.setHandler([&nodes](LogicalProcess &lp, pair<u64, transact_t> ev) {
+            handle(nodes, lp, ev);
+        });
+
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        events = model.run(until, threadsCount);
+        seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        u64 res = 0;
+        for (uint i = 0; i < nodesCount; i++) {
+            res = res * 1000003 + nodes[i].checksum + nodes[i].served;
+            res = res * 1000003 + (u64)nodes[i].device->busyTime() + nodes[i].queue->lengthTimeSum();
+            res = res * 1000003 + nodes[i].queue->waitTimeSum + nodes[i].queue->length();
+        }
+        return res;
+    }
+}
+
+// Один большой прогон по потокам в сравнении с последовательным Engine. Отношение времени показывает
+// масштабирование, только пока потоков не больше ядер; для остальных строк оно не выводится,
+// эти строки проверяют лишь совпадение результатов
+void partitionedBenchmark(uint nodesCount, time_t until) {
+    u64 events;
+    double seconds;
+    u64 reference = network::run(nodesCount, until, true, 1, events, seconds);
+    double sequential = seconds;
+
+    uint cores = max(1u, thread::hardware_concurrency());
+    cout << "partitioned (" << cores << " cores);threads;events;events/sec;sequential time / time;results match"
+         << endl;
+    cout << nodesCount << ";sequential;" << events << ';' << (u64)(events / seconds) << ";1;yes" << endl;
+    for (int threads = 1; threads <= 64; threads *= 2) {
+        u64 res = network::run(nodesCount, until, false, threads, events, seconds);
+        cout << nodesCount << ';' << threads << ';' << events << ';' << (u64)(events / seconds) << ';';
+        if ((uint)threads <= cores) {
+            cout << sequential / seconds;
+        } else {
+            cout << '-';
+        }
+        cout << ';' << (res == reference ? "yes" : "no") << endl;
+    }
+}
+
+int main(int argc, char **argv) {
+    size_t steps = argc > 1 ? stoul(argv[1]) : 2000000;
+    const EventListType types[] = {EventListMultiset, EventListHeap, EventListCalendar, EventListLadder};
+    const char *names[] = {"multiset", "heap", "calendar", "ladder"};
+    const size_t sizes[] = {100, 10000, 300000};
+    const time_t delays[] = {10, 100000};
+
+    cout << "event list;pending;mean delay;events/sec;checksum" << endl;
+    for (size_t d = 0; d < sizeof(delays) / sizeof(delays[0]); d++) {
+        for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+            for (size_t t = 0; t < sizeof(types) / sizeof(types[0]); t++) {
+                HoldResult r = holdBenchmark(types[t], sizes[s], steps, delays[d]);
+                cout << names[t] << ';' << sizes[s] << ';' << delays[d] << ';'
+                     << (u64)r.eventsPerSecond << ';' << r.checksum << endl;
+            }
+        }
+    }
+    variatesBenchmark(steps * 10);
+    inventoryBenchmark((int)(steps / 1000));
+    partitionedBenchmark(64, (time_t)(steps / 64) * network::ARRIVAL);
+    return 0;
+}
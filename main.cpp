@@ -27,10 +27,16 @@ int testCount = 20;
 vector<double> C = {1, 1, 1, 7, 10, 30, 30, 20, 20};
 vector<vector<double>> values(testCount, vector<double>(9));
 
-time_t last;
+// Состояние модели отдельно для каждого прогона, чтобы прогоны могли выполняться параллельно
+struct Inventory {
+    time_t last;
+    double I, IPos, INeg, IPosAcc, IAcc, INegAcc;
+    double money;
+    VariateBuffer arrivals; // Интервалы между заявками
+    VariateBuffer demand; // Размер заявки
+};
 
-double I, IPos, INeg, IPosAcc, IAcc, INegAcc;
-double money = 0;
+vector<Inventory> state(testCount);
 
 enum events {
     EventStart = 1, // Начало моделирования
@@ -63,45 +69,51 @@ int count(double value) {
  * которые используются в обработчиках и валидны в течении одного прогона.
 */
 void EventStartHandler(pair<u64, transact_t> event, int testNumber, Engine * e) {
-    last = 0;
-    I = IPos = INeg = IPosAcc = IAcc = INegAcc = 0;
-    I = IPos = 50;
-    money = 0;
-    e->schedule(EventGenerate, e->negExp(GENERATE_TIME), 1);
+    Inventory &s = state[testNumber];
+    s.last = 0;
+    s.I = s.IPos = s.INeg = s.IPosAcc = s.IAcc = s.INegAcc = 0;
+    s.I = s.IPos = 50;
+    s.money = 0;
+    s.arrivals = VariateBuffer(e->stream("arrivals"), Distribution::exponential(GENERATE_TIME));
+    s.demand = VariateBuffer(e->stream("demand"), Distribution::uniform(0, 1));
+    e->schedule(EventGenerate, (time_t)round(s.arrivals.next()), 1);
     e->schedule(EventCheck, 0, 1);
     e->schedule(SystemEventEnd, MONTH * SCALE,1);
 }
 
 // Обработчик события "Приход заявки"
 void EventGenerateHandler(pair<u64, transact_t> event, int testNumber, Engine * e) {
-    int cnt = count(e->fRandom());
-    IPosAcc += IPos * (int)(e->getTime() - last);
-    INegAcc += INeg * (int)(e->getTime() - last);
-    I -= cnt;
-    IPos = max(0.0, I);
-    INeg = max(0.0, -I);
-    last = e->getTime();
-    int t = e->negExp(GENERATE_TIME);
+    Inventory &s = state[testNumber];
+    int cnt = count(s.demand.next());
+    s.IPosAcc += s.IPos * (int)(e->getTime() - s.last);
+    s.INegAcc += s.INeg * (int)(e->getTime() - s.last);
+    s.I -= cnt;
+    s.IPos = max(0.0, s.I);
+    s.INeg = max(0.0, -s.I);
+    s.last = e->getTime();
+    int t = (int)round(s.arrivals.next());
     e->schedule(EventGenerate, t, event.second + 1);
 //    cerr << "Pay " << I << ' ' << IPosAcc / e->getTime() << ' ' << INegAcc / e->getTime() << ' ' << e->getTime() * 1. / SCALE << endl;
 }
 
 // Обработчик события "Поступление заказа"
 void EventGetOrderHandler(pair<u64, transact_t> event, int testNumber, Engine * e) {
-    money += K + N * event.second;
-    IPosAcc += IPos * (int)(e->getTime() - last);
-    INegAcc += INeg * (int)(e->getTime() - last);
-    I += event.second;
-    IPos = max(0.0, I);
-    INeg = max(0.0, -I);
-    last = e->getTime();
+    Inventory &s = state[testNumber];
+    s.money += K + N * event.second;
+    s.IPosAcc += s.IPos * (int)(e->getTime() - s.last);
+    s.INegAcc += s.INeg * (int)(e->getTime() - s.last);
+    s.I += event.second;
+    s.IPos = max(0.0, s.I);
+    s.INeg = max(0.0, -s.I);
+    s.last = e->getTime();
 //    cerr << "Get " << I << ' ' << IPosAcc / e->getTime() << ' ' << INegAcc / e->getTime() << ' ' << e->getTime() * 1. / SCALE << endl;
 }
 
 // Обработчик события "Проверка состояния склада"
 void EventCheckHandler(pair<u64, transact_t> event, int testNumber, Engine * e) {
-    if (I < LEVEL) {
-        e->schedule(EventGetOrder, e->iRandom(MIN_TIME_ORDER, MAX_TIME_ORDER), MAX_SIZE - I);
+    Inventory &s = state[testNumber];
+    if (s.I < LEVEL) {
+        e->schedule(EventGetOrder, e->iRandom(MIN_TIME_ORDER, MAX_TIME_ORDER), MAX_SIZE - s.I);
 //        cerr << "Order " << I << ' ' << e->getTime() * 1. / SCALE << endl;
     }
     e->schedule(EventCheck, SCALE, 1);
@@ -109,7 +121,8 @@ void EventCheckHandler(pair<u64, transact_t> event, int testNumber, Engine * e)
 
 // Обработчик события "Монитор для срезов" определен в модуле MultiSMPL.h обязателен
 void EventMonitorHandler(pair<u64, transact_t> event, int testNumber, Engine * e) {
-    values[testNumber][event.second] = money * SCALE / e->getTime() + IPosAcc / e->getTime() * H + INegAcc / e->getTime() * P;
+    Inventory &s = state[testNumber];
+    values[testNumber][event.second] = s.money * SCALE / e->getTime() + s.IPosAcc / e->getTime() * H + s.INegAcc / e->getTime() * P;
 }
 
 // Обработчик события "Окончание моделирования" определен в модуле MultiSMPL.h обязателен
@@ -118,28 +131,29 @@ void EventEndHandler(pair<u64, transact_t> event, int testNumber, Engine * e) {
 }
 
 int main() {
-    srand(456987);
-    map<u64, void(*)(pair<u64, transact_t >, int, Engine *)> handlers;  // Задает соответствие Событие - функция,
-                                                                        // которая его обрабатывает
-    handlers[EventStart] = EventStartHandler;
-    handlers[EventGenerate] = EventGenerateHandler;
-    handlers[EventGetOrder] = EventGetOrderHandler;
-    handlers[EventCheck] = EventCheckHandler;
-    handlers[SystemEventEnd] = EventEndHandler;
-    handlers[SystemEventMonitor] = EventMonitorHandler;
+    HandlerTable handlers;  // Задает соответствие Событие - функция, которая его обрабатывает
+    handlers.add(EventStart, EventStartHandler);
+    handlers.add(EventGenerate, EventGenerateHandler);
+    handlers.add(EventGetOrder, EventGetOrderHandler);
+    handlers.add(EventCheck, EventCheckHandler);
+    handlers.add(SystemEventEnd, EventEndHandler);
+    handlers.add(SystemEventMonitor, EventMonitorHandler);
     Meta buf = {}; // Структура с именами устройств и очередей соответственно
     ofstream out("test.txt"); // Вывод в текстовый файл
     ofstream csvOut("test.csv"); // Вывод в файл csv (для открытия в Exeд, Open office, Libre Office) структура файла
                                     // (разделитель ";", целая часть от дробной отделена ",", Кодировка UTF-8)
     MultiSMPL * test = new MultiSMPL(handlers, buf, nullptr, nullptr);
+    test->setSeed(456987); // Каждый прогон получает собственные потоки случайных чисел
+    test->setThreadsCount(0); // Прогоны выполняются параллельно на всех ядрах
     test->run(testCount, {EventStart, 0}, 0, deltaTime); // Передаем количество прогонов,
                                                                                    // начальное событие, время,
                                                                                    // через которое оно произойдет,
                                                                                    // а также функцию, которая отображает
                                                                                    // номер вызова монитора на время,
                                                                                    // через которое оно произойдет
-    cout << money / MONTH << ' ' << (double)I << ' ' << (double)IPosAcc / END_TIME << ' ' << (double)INegAcc / END_TIME << ' '
-         << money / MONTH + IPosAcc / END_TIME * H + INegAcc / END_TIME * P << endl;
+    Inventory &s = state[testCount - 1];
+    cout << s.money / MONTH << ' ' << (double)s.I << ' ' << (double)s.IPosAcc / END_TIME << ' ' << (double)s.INegAcc / END_TIME << ' '
+         << s.money / MONTH + s.IPosAcc / END_TIME * H + s.INegAcc / END_TIME * P << endl;
     vector<double> avg(values[0].size());
     for (auto i : values) {
         csvOut << MultiSMPL::printCSVTable({MultiSMPL::toStringVector(i, MultiSMPL::toCSVString)});
@@ -6,6 +6,9 @@
 #include <vector>
 #include <set>
 #include <list>
+#include <deque>
+#include <map>
+#include <unordered_map>
 
 #include <ctime>
 #include <cstdlib>
@@ -13,36 +16,287 @@
 #include <cassert>
 #include <iomanip>
 
+#include "Arena.h"
+#include "EventList.h"
+#include "Random.h"
+#include "Distributions.h"
+#include "QueueStorage.h"
+#include "TableWriter.h"
+#include "Instrumentation.h"
+#include "Trace.h"
+#include "TimeVariable.h"
+#include "TransactTable.h"
+#include "Condition.h"
+
 namespace smpl
 {
     typedef unsigned int uint;
     typedef unsigned long long u64;
     
     typedef u64 transact_t;
+    /**
+     * Дескриптор запланированного события: младшие 32 бита - номер записи
+     * в таблице событий, старшие - ее поколение. Нулевой дескриптор недействителен
+     */
+    typedef u64 event_handle_t;
+
+    const event_handle_t NoEventHandle = 0;
 
-    class Event;
     class Device;
+    class Storage;
     class Queue;
 
     class Engine {
     private:
+        /**
+         * Арена для устройств, очередей и списка событий прогона.
+         * Объявлена первой, чтобы освобождаться последней
+         */
+        Arena arena;
         /**
          * Выходной поток
          */
         std::ostream *outs;
         std::vector<Queue *> queues;
         std::vector<Device *> devices;
-        std::multiset<Event> events;
+        std::vector<Storage *> storages;
+        EventListType eventListType;
+        /** Список будущих событий */
+        EventList *events;
+        /** Порядковый номер следующего планируемого события */
+        u64 nextSeq;
+
+        enum PendingState {
+            PendingFree,
+            PendingScheduled,
+            PendingCancelled
+        };
+
+        static const uint NoSlot = 0xffffffffu;
+
+        /**
+         * Запись таблицы запланированных событий.
+         * Отмененное событие остается в списке событий до извлечения или
+         * уплотнения списка, запись освобождается только после этого
+         */
+        struct PendingEvent {
+            time_t time;
+            u64 eventId;
+            transact_t transactId;
+            u64 seq;
+            /** Поколение записи, увеличивается при каждом освобождении */
+            uint generation;
+            uint state;
+            /** Соседние события того же транзакта */
+            uint prev, next;
+            /** Исключительное ожидание, которое пробуждает событие, иначе NoSlot */
+            uint waiter;
+        };
+
+        std::vector<PendingEvent> pendingEvents;
+        std::vector<uint> freeSlots;
+        /** Первое событие в списке событий каждого транзакта */
+        std::unordered_map<transact_t, uint> transactEvents;
+        /** Количество действующих событий */
+        size_t pendingCount;
+        /** Количество отмененных, но еще не извлеченных событий */
+        size_t cancelledCount;
+#ifdef SMPL_INSTRUMENT
+        /** Профиль текущего прогона */
+        Profile profile;
+#endif
+        /** Трасса, NULL - запись выключена */
+        TraceWriter *trace;
+
+        /** Зерно эксперимента и номер прогона, из которых выводятся ключи потоков */
+        u64 seed, replication;
+        /** Потоки случайных чисел, нулевой - поток по умолчанию */
+        std::deque<RandomStream> streams;
+        std::map<std::string, uint> streamIds;
+        /** Все потоки антитетические */
+        bool antithetic;
+        /** Переменные с интегральной статистикой и их имена */
+        std::vector<TimeVariable, CacheLineAllocator<TimeVariable> > variables;
+        std::vector<std::string> variableNames;
+        std::map<std::string, uint> variableIds;
+        /** Транзакты, созданные createTransact, и их атрибуты */
+        TransactTable transacts;
+
+        enum WaiterState {
+            WaiterFree,
+            WaiterBlocked,
+            /** Исключительное ожидание, событие пробуждения запланировано, но еще не наступило */
+            WaiterWoken
+        };
+
+        /**
+         * Транзакт, ожидающий выполнения условия (waitUntil). Поколение увеличивается при освобождении
+         * записи, ссылки из индекса на прежнего владельца устаревают
+         */
+        struct Waiter {
+            Condition condition;
+            u64 eventId;
+            transact_t transactId;
+            uint generation;
+            uint state;
+            bool exclusive;
+            /** Запись таблицы событий пробуждения для WaiterWoken */
+            uint slot;
+            /** Соседние ожидания того же транзакта */
+            uint prev, next;
+        };
+
+        struct WaitRef {
+            uint waiter;
+            uint generation;
+        };
+
+        /**
+         * Ожидающие, чьи условия зависят от одной величины, в порядке постановки на ожидание.
+         * stale - оценка сверху числа устаревших ссылок: список уплотняется, когда их становится больше половины
+         */
+        struct WaitList {
+            std::vector<WaitRef> refs;
+            size_t stale;
+
+            WaitList() : stale(0) {}
+        };
+
+        std::vector<Waiter> waiters;
+        std::vector<uint> freeWaiters;
+        /** Индекс зависимостей: списки ожидающих по величинам (вид, номер) */
+        std::vector<WaitList> waitIndex[WaitSourcesEnd];
+        /** Первое ожидание каждого транзакта */
+        std::unordered_map<transact_t, uint> transactWaiters;
+        /** Количество заблокированных транзактов */
+        size_t waitingCount;
+        /** Количество исключительных ожиданий в состоянии WaiterWoken */
+        size_t wokenCount;
 
         time_t _time;
+        /** Время начала сбора статистики, изменяется resetStatistics */
+        time_t statisticsStart;
+
+    public:
+        /**
+         * Полное состояние прогона: модельное время, список событий с таблицей запланированных событий
+         * (дескрипторы событий остаются действительными), состояние и статистика устройств и очередей,
+         * позиции потоков случайных чисел
+         */
+        class Snapshot {
+        private:
+            friend class Engine;
+
+            struct DeviceState {
+                transact_t currentTransactId;
+                time_t lastTimeUsed;
+                size_t transactCount;
+                time_t timeUsedSum;
+            };
+
+            struct StorageState {
+                uint used, maxUsed;
+                size_t requestCount;
+                u64 unitCount, timeUsedSum;
+                time_t lastTimeChanged;
+                std::vector<uint> freeUnits;
+                std::vector<transact_t> holders;
+            };
+
+            struct QueueState {
+                size_t maxLength;
+                u64 timeQueueSum, waitTimeSum, waitTimeSumSquared;
+                time_t lastTimeChanged;
+                size_t count;
+                /** Элементы в порядке обслуживания */
+                std::vector<QueueItem> items;
+            };
+
+            time_t time, statisticsStart;
+            u64 nextSeq, seed, replication;
+            std::vector<Event> events;
+            std::vector<PendingEvent> pendingEvents;
+            std::vector<uint> freeSlots;
+            std::unordered_map<transact_t, uint> transactEvents;
+            size_t pendingCount, cancelledCount;
+            std::vector<DeviceState> devices;
+            std::vector<StorageState> storages;
+            std::vector<QueueState> queues;
+            std::vector<RandomStream> streams;
+            std::map<std::string, uint> streamIds;
+            bool antithetic;
+            std::vector<TimeVariable> variables;
+            std::vector<std::string> variableNames;
+            TransactTable transacts;
+            std::vector<Waiter> waiters;
+            std::vector<uint> freeWaiters;
+            std::vector<WaitList> waitIndex[WaitSourcesEnd];
+            std::unordered_map<transact_t, uint> transactWaiters;
+            size_t waitingCount, wokenCount;
+
+        public:
+            time_t getTime() const {
+                return time;
+            }
+        };
+
+    private:
+
+        uint allocSlot();
+        void freeSlot(uint slot);
+        void linkTransact(uint slot);
+        void unlinkTransact(uint slot);
+        /**
+         * Удаляет отмененные события из списка событий
+         */
+        void compactEvents();
+        void cancelSlot(uint slot);
+        double sourceValue(WaitSource source, uint index);
+        bool holds(const Condition &condition, transact_t transactId);
+        void addDependency(WaitSource source, uint index, uint waiter);
+        void releaseWaiter(uint waiter);
+        void compactWaitList(WaitList &list);
+        void clearWaiters();
+        void wakeWaiters(WaitSource source, uint index);
+        /**
+         * Перепроверка ожиданий по всем входам условия
+         */
+        void wakeInputs(const Condition &condition);
+        /**
+         * Событие e исключительного пробуждения waiter, условие которого нарушено: событие удаляется,
+         * транзакт снова ждет на прежнем месте
+         */
+        void blockAgain(const Event &e, uint waiter);
+        /**
+         * Удаление из начала списка отмененных событий и пробуждений с нарушенным условием
+         */
+        void dropBrokenWakes();
 
     public:
-        Engine(std::ostream *outputStream) : _time(0) {
-            setlocale(LC_ALL, "ru_RU.UTF-8");
+        /**
+         * @param outputStream Поток для вывода отчетов
+         * @param eventListType Способ хранения списка событий
+         */
+        Engine(std::ostream *outputStream, EventListType eventListType = EventListHeap)
+                : eventListType(eventListType), events(createEventList(eventListType, arena)), nextSeq(0), pendingCount(0), cancelledCount(0),
+                  trace(NULL), seed(0), replication(0), antithetic(false), waitingCount(0), wokenCount(0), _time(0), statisticsStart(0) {
+            // Локаль устанавливается один раз: setlocale не потокобезопасна,
+            // а движки разных прогонов могут создаваться параллельно
+            static const bool localeInitialized = setlocale(LC_ALL, "ru_RU.UTF-8") != NULL;
+            (void)localeInitialized;
             outs = outputStream;
+            streamId("");
         }
         ~Engine() {
             reset();
+            events->~EventList();
+        }
+
+        /**
+         * Арена движка. Объекты, созданные в ней, живут до reset
+         */
+        Arena &getArena() {
+            return arena;
         }
 
         std::vector<Queue *> &getQueues(){
@@ -53,41 +307,231 @@ namespace smpl
             return devices;
         }
 
+        std::vector<Storage *> &getStorages() {
+            return storages;
+        }
+
+#ifdef SMPL_INSTRUMENT
+        /**
+         * Профиль прогона с момента restart или reset (только при SMPL_INSTRUMENT)
+         */
+        Profile &getProfile();
+#endif
+
+        /**
+         * Запись трассы планирования, наступления и отмены событий, занятия и освобождения устройств,
+         * постановки в очереди и извлечения из них (Trace.h). NULL - запись выключена.
+         * Трасса не принадлежит движку
+         */
+        void setTrace(TraceWriter *trace) {
+            this->trace = trace;
+        }
+
+        TraceWriter *getTrace() {
+            return trace;
+        }
+
+        /**
+         * Удаление устройств, очередей и событий; вся память прогона возвращается арене одной операцией
+         */
         void reset();
+        /**
+         * Подготовка к новому прогону с сохранением структуры модели: устройства и очереди остаются,
+         * обнуляются их состояние и статистика, очищаются список событий и очереди (выделенная память
+         * контейнеров сохраняется), модельное время становится равным нулю.
+         * Потоки случайных чисел перезапускаются вызовом setSeed
+         */
+        void restart();
+        /**
+         * Поток для вывода отчетов
+         */
+        void setOutputStream(std::ostream *outputStream);
         /**
          * Определение устройства
          * @param name Название устройства
          * @return Созданное устройство
          */
         void createDevice(std::string name);
+        /**
+         * Определение многоканального устройства (накопителя)
+         * @param name Название
+         * @param capacity Количество единиц (каналов)
+         */
+        void createStorage(const std::string &name, uint capacity);
         /**
          * Определение очереди
          * @param name Название очереди
+         * @param discipline Дисциплина обслуживания
+         * @param priorities Количество значений приоритета для QueuePriority
          * @return Созданная очередь
          */
-        void createQueue(std::string name);
+        void createQueue(std::string name, QueueDiscipline discipline = QueueOrdered, uint priorities = 16);
+        /**
+         * Определение переменной с интегральной по времени статистикой: среднее, средние положительной
+         * и отрицательной части, дисперсия, минимум и максимум (TimeVariable). Повторное определение
+         * переменной с тем же именем, например в начале каждого прогона, задает значение и сбрасывает статистику
+         * @param name Название переменной
+         * @param value Начальное значение
+         * @return Номер переменной
+         */
+        uint createVariable(const std::string &name, double value = 0);
+        /**
+         * Номер определенной ранее переменной
+         */
+        uint variableId(const std::string &name);
+
+        void setVariable(uint id, double value) {
+            assert(id < variables.size());
+            variables[id].set(_time, value);
+            notify(WaitVariable, id);
+        }
+
+        void addVariable(uint id, double delta) {
+            assert(id < variables.size());
+            variables[id].set(_time, variables[id].value + delta);
+            notify(WaitVariable, id);
+        }
+
+        double getVariable(uint id) const {
+            assert(id < variables.size());
+            return variables[id].value;
+        }
+
+        /**
+         * Переменная с интегралами, досчитанными до текущего момента. Средние берутся
+         * за getStatisticsTime()
+         */
+        const TimeVariable &variable(uint id);
+
+        const std::vector<std::string> &getVariableNames() const {
+            return variableNames;
+        }
+
+        /**
+         * Таблица транзактов с атрибутами (TransactTable). Атрибуты регистрируются один раз,
+         * например при определении модели: getTransacts().addAttribute<int>("размер")
+         */
+        TransactTable &getTransacts() {
+            return transacts;
+        }
+
+        /**
+         * Создание транзакта в таблице транзактов
+         * @return Номер транзакта с поколением, не равный нулю
+         */
+        transact_t createTransact() {
+            return transacts.create(_time);
+        }
+
+        /**
+         * Удаление транзакта из таблицы. Запланированные события транзакта не отменяются (см. cancelTransact)
+         */
+        void destroyTransact(transact_t transactId) {
+            transacts.destroy(transactId, _time);
+        }
+
+        template<typename T>
+        T &attribute(Attribute<T> attribute, transact_t transactId) {
+            return transacts.get(attribute, transactId);
+        }
+
+        /**
+         * Ожидание транзактом выполнения условия (WAIT UNTIL) вместо периодической проверки.
+         * Если условие уже выполнено, событие eventId транзакта планируется на текущий момент сразу,
+         * иначе - как только условие выполнится. Условие перепроверяется только при изменении его входов
+         * (Condition), поэтому ожидание ничего не стоит, пока входы не меняются
+         * @param exclusive Захват ресурса: при изменении входа пробуждается только первый из ожидающих
+         *        с выполненным условием, и пока его событие не наступило, по этому входу другие исключительные
+         *        ожидания не пробуждаются. При наступлении события условие проверяется снова: если его успел
+         *        нарушить другой транзакт, событие не выдается, а транзакт продолжает ждать на прежнем месте.
+         *        Иначе пробуждаются все, для кого условие выполнено
+         */
+        void waitUntil(const Condition &condition, u64 eventId, transact_t transactId, bool exclusive = false);
+        /**
+         * Снятие всех ожиданий транзакта. Уже запланированное пробуждение наступит без повторной проверки
+         * @return Количество снятых ожиданий
+         */
+        size_t cancelWait(transact_t transactId);
+        /**
+         * Количество ожидающих транзактов
+         */
+        size_t waitingTransacts() {
+            return waitingCount;
+        }
+        /**
+         * Изменение величины source с номером index: перепроверка зависящих от нее условий.
+         * Вызывается устройствами, очередями, накопителями и setVariable; функции пользователя
+         * с собственными входами вызывают его сами
+         */
+        void notify(WaitSource source, uint index) {
+            if (waitingCount != 0)
+                wakeWaiters(source, index);
+        }
         /**
          * Планирование события
          * Помещение в список нового события
          * @param eventId AE
          * @param time AT
          * @param transactId AJ
+         * @return Дескриптор для отмены события
          */
-        void schedule(u64 eventId, time_t time, transact_t transactId);
+        event_handle_t schedule(u64 eventId, time_t time, transact_t transactId);
         /**
-         * Обработка очередного события
+         * Обработка очередного события.
+         * Исключительное пробуждение (waitUntil), условие которого нарушено, поглощается без возврата, и
+         * выдается следующее событие; если других событий нет, это ошибка - перед вызовом проверяется eventsCount
          * @param eventId AE, ID события совершенного события
          * @param transactId AJ, ID транзакта
          */
         std::pair<u64, transact_t> cause();
         /**
-         * Удаление события из списка
+         * Удаление события из списка.
+         * Удаляется ближайшее событие eventId транзакта transactId
          * @param eventId AE
          * @param transactId AJ
          * @return Разность между текущим модельным временем и временем наступления удаленного события
          */
         time_t cancel(u64 eventId, transact_t transactId);
+        /**
+         * Удаление события по дескриптору за O(1)
+         * @param handle Дескриптор, полученный от schedule
+         * @return Разность между текущим модельным временем и временем наступления удаленного события
+         */
+        time_t cancel(event_handle_t handle);
+        /**
+         * Удаление всех запланированных событий транзакта
+         * @param transactId AJ
+         * @return Количество удаленных событий
+         */
+        size_t cancelTransact(transact_t transactId);
+        /**
+         * Событие запланировано и еще не наступило и не отменено
+         */
+        bool isPending(event_handle_t handle);
+        /**
+         * Количество запланированных событий. Если остались только исключительные пробуждения,
+         * нарушенные снимаются сразу, поэтому при ненулевом результате cause вернет событие
+         */
+        size_t eventsCount();
+        /**
+         * Время ближайшего запланированного события, событие остается в списке (список не должен быть пуст)
+         */
+        time_t nextTime();
+        /**
+         * Перевод модельного времени вперед без событий, например до конца периода моделирования перед отчетом.
+         * Запланированных событий раньше time быть не должно
+         */
+        void advance(time_t time);
         time_t getTime();
+        /**
+         * Сброс накопленной статистики устройств и очередей, например по окончании периода разгона.
+         * Состояние модели (занятые устройства, элементы очередей, события) не изменяется
+         */
+        void resetStatistics();
+        /**
+         * Длительность сбора статистики: время с начала моделирования или с последнего resetStatistics
+         */
+        time_t getStatisticsTime();
         /**
          * Отражает на стандартном устройстве вывода или в файле состояние списка событий.
          * По каждому элементу списка выводится время свершения события, номер события и номер заявки.
@@ -108,20 +552,59 @@ namespace smpl
         void monitor();
         void reportDevices();
         void reportQueues();
+        void reportVariables();
+        void reportTransacts();
         void report();
+        /**
+         * Задает зерно эксперимента и номер прогона.
+         * Все потоки движка перезапускаются с ключами, выведенными из (seed, replication, имя потока)
+         */
+        void setSeed(u64 seed, u64 replication = 0);
+        /**
+         * Перевод всех потоков случайных чисел на начало подпотока substream.
+         * Продолжения одного сохраненного состояния с разными подпотоками независимы
+         */
+        void setSubstream(u64 substream);
+        /**
+         * Антитетический режим всех потоков, в том числе создаваемых позже (RandomStream::setAntithetic).
+         * Прогон с тем же зерном и номером в антитетическом режиме образует антитетическую пару с обычным
+         */
+        void setAntithetic(bool antithetic);
+        /**
+         * Сохранение состояния прогона
+         */
+        void save(Snapshot &snapshot);
+        /**
+         * Восстановление состояния, сохраненного движком с теми же устройствами и очередями.
+         * Состояние модели пользователя восстанавливается отдельно
+         */
+        void restore(const Snapshot &snapshot);
+        /**
+         * Номер именованного потока случайных чисел, поток создается при первом обращении.
+         * Пустое имя - поток по умолчанию
+         */
+        uint streamId(const std::string &name);
+        /**
+         * Именованный поток случайных чисел
+         */
+        RandomStream &stream(const std::string &name);
+        RandomStream &stream(uint id);
         /**
          * Разыгрывает случайное число, равномерно распределенное на интервале от L до R
          * @param L
          * @param R
-         * @return
+         * @return Число из [L; R)
          */
-        static uint iRandom(uint L, uint R);
+        uint iRandom(uint L, uint R);
         /**
-         * Генерирует случайное число с плавающей точкой в отрезке [0; 1]
+         * Генерирует случайное число с плавающей точкой в отрезке [0; 1)
          * @return
          */
-        static double fRandom();
-        static uint negExp(uint x);
+        double fRandom();
+        /**
+         * Экспоненциально распределенное целое со средним x
+         */
+        uint negExp(uint x);
         static void justify(std::string &s, size_t sz);
         static void justifyVec(std::vector<std::string> &vec, const std::vector<size_t> &widths);
         static void fillVec(char c, std::vector<std::string> &vec, const std::vector<size_t> &widths);
@@ -129,24 +612,7 @@ namespace smpl
         static size_t getLen(std::string &s);
         template<typename T>
         static std::string toString(T x);
-        static std::string printTable(std::vector< std::vector<std::string> > table);
-    };
-
-    /**
-     * Событие
-     */
-    class Event {
-    public:
-        /** T, время события */
-        time_t time;
-        /** E, номер события */
-        u64 eventId;
-        /** J, транзакт */
-        transact_t transactId;
-
-        friend bool operator<(const Event &a, const Event &b) {
-            return a.time < b.time || (a.time == b.time && a.eventId < b.eventId);
-        }
+        static std::string printTable(const std::vector< std::vector<std::string> > &table);
     };
 
     /**
@@ -159,6 +625,8 @@ namespace smpl
     public:
         /** Название устройства */
         std::string name;
+        /** Номер устройства в движке */
+        uint index;
         /** J, номер обрабатываемого транзакта. Если =0, то устройство свободно */
         transact_t currentTransactId;
         /** B, время последнего обращения */
@@ -169,7 +637,7 @@ namespace smpl
         time_t timeUsedSum;
 
         Device(const std::string &name, Engine *engine)
-                : name(name), engine(engine), currentTransactId(0), lastTimeUsed(0),
+                : name(name), engine(engine), index((uint)engine->getDevices().size()), currentTransactId(0), lastTimeUsed(0),
                 transactCount(0), timeUsedSum(0) {}
         /**
          * Резервирование устройства за транзактом
@@ -185,35 +653,82 @@ namespace smpl
          * @return
          */
         transact_t status();
+        /**
+         * Сумма периодов занятого состояния вместе с текущим, еще не завершенным
+         */
+        time_t busyTime();
     };
 
     /**
-     * Элемент очереди
+     * Многоканальное устройство (накопитель, STORAGE в GPSS): capacity одинаковых единиц.
+     * Единицы занимаются либо без указания номера (enter/leave), либо поштучно за транзактом
+     * (acquire/release) - номер свободной единицы берется из стека за O(1)
      */
-    class QueueItem {
+    class Storage {
+    private:
+        Engine * engine;
+
+        void change(int delta);
+
     public:
-        /** I, приоритет элемента очереди */
-        u64 priority;
-        /** J, идентификатор транзакта */
-        transact_t transactId;
-        /** T, время поступления элемента */
-        time_t time;
-        /** S, стадия обработки заявки */
-        u64 stage;
-
-        QueueItem(time_t time, transact_t transactId, u64 priority, u64 stage)
-                : time(time), transactId(transactId), priority(priority), stage(stage) {}
-
-        /**
-         * Оператор сравнения двух элементов очереди.
-         * Нужен для работы контейнеров стандартной библиотеки C++
-         * @param a
-         * @param b
-         * @return
+        /** Название накопителя */
+        std::string name;
+        /** Номер накопителя в движке */
+        uint index;
+        /** Емкость */
+        uint capacity;
+        /** Занято единиц */
+        uint used;
+        /** Max, наибольшее число занятых единиц */
+        uint maxUsed;
+        /** Z, счетчик запросов */
+        size_t requestCount;
+        /** Счетчик занятых единиц */
+        u64 unitCount;
+        /** Сумма произведений времени на число занятых единиц */
+        u64 timeUsedSum;
+        /** Время последнего изменения числа занятых единиц */
+        time_t lastTimeChanged;
+        /** Номера свободных единиц, вершина - следующая выдаваемая acquire */
+        std::vector<uint> freeUnits;
+        /** Транзакт, занявший единицу через acquire, 0 - свободна */
+        std::vector<transact_t> holders;
+
+        Storage(const std::string &name, Engine *engine, uint capacity)
+                : engine(engine), name(name), index((uint)engine->getStorages().size()), capacity(capacity), used(0),
+                maxUsed(0), requestCount(0), unitCount(0), timeUsedSum(0), lastTimeChanged(0), holders(capacity, 0) {
+            assert(capacity > 0);
+            clearUnits();
+        }
+        /**
+         * Занятие units единиц без указания номеров
+         */
+        void enter(uint units = 1);
+        /**
+         * Освобождение units единиц, занятых enter
+         */
+        void leave(uint units = 1);
+        /**
+         * Занятие одной единицы за транзактом
+         * @return Номер единицы
          */
-        friend bool operator<(const QueueItem &a, const QueueItem &b) {
-            return a.time < b.time || (a.time == b.time && a.priority < b.priority);
+        uint acquire(transact_t transactId);
+        /**
+         * Освобождение единицы, занятой acquire
+         */
+        void release(uint unit);
+
+        uint available() const {
+            return capacity - used;
         }
+        /**
+         * Сумма произведений времени на число занятых единиц вместе с интервалом после последнего изменения
+         */
+        u64 occupancyTimeSum();
+        /**
+         * Все единицы свободны, статистика не изменяется
+         */
+        void clearUnits();
     };
 
     /**
@@ -235,20 +750,33 @@ namespace smpl
         time_t lastTimeChanged;
         /** Count, счетчик элементов */
         size_t count;
-        /** Контейнер */
-        std::multiset<QueueItem> queue;
+        /** Контейнер, устройство зависит от дисциплины очереди */
+        QueueStorage *queue;
         /** Название очереди */
         std::string name;
+        QueueDiscipline discipline;
+        /** Номер очереди в движке */
+        uint index;
 
-        Queue(const std::string &name, Engine *engine)
+        /**
+         * @param discipline Дисциплина обслуживания
+         * @param priorities Количество значений приоритета для QueuePriority
+         */
+        Queue(const std::string &name, Engine *engine, QueueDiscipline discipline = QueueOrdered, uint priorities = 16)
                 : name(name), engine(engine), maxLength(0), timeQueueSum(0),
-                waitTimeSum(0), waitTimeSumSquared(0), lastTimeChanged(0), count(0) {
+                waitTimeSum(0), waitTimeSumSquared(0), lastTimeChanged(0), count(0),
+                queue(createQueueStorage(discipline, priorities, engine->getArena())), discipline(discipline),
+                index((uint)engine->getQueues().size()) {
             assert(engine != NULL);
         }
+        ~Queue() {
+            queue->~QueueStorage();
+        }
         /**
          * Помещение транзакта в очередь
          * @param transactId AJ, транзакт
-         * @param priority AI, приоритет
+         * @param priority AI, приоритет; в QueuePriority значения не меньше числа приоритетов очереди
+         * обслуживаются как наименьший приоритет
          * @param stage AS_, стадия обработки заявки
          */
         void enqueue(transact_t transactId, u64 priority, u64 stage);
@@ -259,6 +787,10 @@ namespace smpl
          */
         transact_t head(u64 &stage);
         size_t length();
+        /**
+         * Сумма произведений времени на длину очереди вместе с интервалом после последнего изменения длины
+         */
+        u64 lengthTimeSum();
     };
 
     void Engine::justify(std::string &s, size_t sz) {
@@ -312,169 +844,901 @@ namespace smpl
         return len;
     }
 
-    std::string Engine::printTable(std::vector<std::vector<std::string> > table) {
+    std::string Engine::printTable(const std::vector<std::vector<std::string> > &table) {
         assert(!table.empty());
 
         std::string res;
-        const size_t MinColumnWidth = 5;
-
-        std::vector<std::string> header = *table.begin();
-        std::vector<size_t> colWidth(header.size(), MinColumnWidth);
-        std::vector<std::string> sepList;
-        std::string rowSeparator;
-
-        for (size_t i = 0; i < table.size(); ++i) {
-            for (size_t j = 0; j < table[i].size(); ++j) {
-                colWidth[j] = std::max(colWidth[j], getLen(table[i][j]));
-            }
+        {
+            OutputBuffer out(res);
+            writeTable(out, table[0].size(), table.size(), [&table](size_t i, TableRow &row) {
+                for (size_t j = 0; j < table[i].size() && j < row.size(); ++j) {
+                    row[j] = table[i][j];
+                }
+            });
         }
-
-        fillVec('-', sepList, colWidth);
-        rowSeparator = surround('+', sepList);
-
-        justifyVec(header, colWidth);
-        res += rowSeparator + "\n";
-        res += surround('|', header) + "\n" + rowSeparator + "\n";
-
-        for (size_t i = 1; i < table.size(); ++i) {
-            justifyVec(table[i], colWidth);
-            res += surround('|', table[i]) + "\n" + rowSeparator + "\n";
-        }
-
         return res;
     }
 
     template<typename T>
     std::string Engine::toString(T x) {
-        std::stringstream ss;
-        ss << std::fixed << std::setprecision(5) << x;
-        return ss.str();
+        std::string s;
+        format::append(s, x);
+        return s;
     }
 
     void Engine::reset() {
         for (int i = 0; i < (int)queues.size(); ++i) {
-            delete queues[i];
+            queues[i]->~Queue();
         }
-        queues.empty();
+        queues.clear();
 
         for (int i = 0; i < (int)devices.size(); ++i) {
-            delete devices[i];
+            devices[i]->~Device();
         }
-        devices.empty();
+        devices.clear();
 
-        events.empty();
+        for (size_t i = 0; i < storages.size(); ++i) {
+            storages[i]->~Storage();
+        }
+        storages.clear();
+        variables.clear();
+        variableNames.clear();
+        variableIds.clear();
+        transacts = TransactTable();
+        clearWaiters();
+
+        events->~EventList();
+        pendingEvents.clear();
+        freeSlots.clear();
+        transactEvents.clear();
+        pendingCount = cancelledCount = 0;
+        nextSeq = 0;
+        _time = statisticsStart = 0;
+        SMPL_PROFILE(profile.clear());
+
+        arena.release();
+        events = createEventList(eventListType, arena);
+    }
+
+    void Engine::restart() {
+        events->clear();
+        pendingEvents.clear();
+        freeSlots.clear();
+        transactEvents.clear();
+        pendingCount = cancelledCount = 0;
+        nextSeq = 0;
+        SMPL_PROFILE(profile.clear());
+
+        for (size_t i = 0; i < devices.size(); ++i) {
+            Device *dev = devices[i];
+            dev->currentTransactId = 0;
+            dev->lastTimeUsed = 0;
+            dev->transactCount = 0;
+            dev->timeUsedSum = 0;
+        }
+        for (size_t i = 0; i < storages.size(); ++i) {
+            Storage *st = storages[i];
+            st->clearUnits();
+            st->maxUsed = 0;
+            st->requestCount = 0;
+            st->unitCount = 0;
+            st->timeUsedSum = 0;
+            st->lastTimeChanged = 0;
+        }
+        for (size_t i = 0; i < queues.size(); ++i) {
+            Queue *q = queues[i];
+            q->queue->clear();
+            q->maxLength = 0;
+            q->timeQueueSum = 0;
+            q->waitTimeSum = 0;
+            q->waitTimeSumSquared = 0;
+            q->lastTimeChanged = 0;
+            q->count = 0;
+        }
+        for (size_t i = 0; i < variables.size(); ++i) {
+            variables[i].reset(0, 0);
+        }
+        transacts.clear();
+        clearWaiters();
+        _time = statisticsStart = 0;
+    }
+
+    void Engine::save(Snapshot &snapshot) {
+        snapshot.time = _time;
+        snapshot.statisticsStart = statisticsStart;
+        snapshot.nextSeq = nextSeq;
+        snapshot.seed = seed;
+        snapshot.replication = replication;
+
+        snapshot.events.clear();
+        events->collect(snapshot.events);
+        snapshot.pendingEvents = pendingEvents;
+        snapshot.freeSlots = freeSlots;
+        snapshot.transactEvents = transactEvents;
+        snapshot.pendingCount = pendingCount;
+        snapshot.cancelledCount = cancelledCount;
+
+        snapshot.devices.resize(devices.size());
+        for (size_t i = 0; i < devices.size(); ++i) {
+            Snapshot::DeviceState &d = snapshot.devices[i];
+            d.currentTransactId = devices[i]->currentTransactId;
+            d.lastTimeUsed = devices[i]->lastTimeUsed;
+            d.transactCount = devices[i]->transactCount;
+            d.timeUsedSum = devices[i]->timeUsedSum;
+        }
+
+        snapshot.storages.resize(storages.size());
+        for (size_t i = 0; i < storages.size(); ++i) {
+            Snapshot::StorageState &st = snapshot.storages[i];
+            st.used = storages[i]->used;
+            st.maxUsed = storages[i]->maxUsed;
+            st.requestCount = storages[i]->requestCount;
+            st.unitCount = storages[i]->unitCount;
+            st.timeUsedSum = storages[i]->timeUsedSum;
+            st.lastTimeChanged = storages[i]->lastTimeChanged;
+            st.freeUnits = storages[i]->freeUnits;
+            st.holders = storages[i]->holders;
+        }
+
+        snapshot.queues.resize(queues.size());
+        for (size_t i = 0; i < queues.size(); ++i) {
+            Snapshot::QueueState &q = snapshot.queues[i];
+            q.maxLength = queues[i]->maxLength;
+            q.timeQueueSum = queues[i]->timeQueueSum;
+            q.waitTimeSum = queues[i]->waitTimeSum;
+            q.waitTimeSumSquared = queues[i]->waitTimeSumSquared;
+            q.lastTimeChanged = queues[i]->lastTimeChanged;
+            q.count = queues[i]->count;
+            q.items.clear();
+            queues[i]->queue->collect(q.items);
+        }
+
+        snapshot.streams.assign(streams.begin(), streams.end());
+        snapshot.streamIds = streamIds;
+        snapshot.antithetic = antithetic;
+        snapshot.variables.assign(variables.begin(), variables.end());
+        snapshot.variableNames = variableNames;
+        snapshot.transacts = transacts;
+        snapshot.waiters = waiters;
+        snapshot.freeWaiters = freeWaiters;
+        for (int i = 0; i < WaitSourcesEnd; ++i) {
+            snapshot.waitIndex[i] = waitIndex[i];
+        }
+        snapshot.transactWaiters = transactWaiters;
+        snapshot.waitingCount = waitingCount;
+        snapshot.wokenCount = wokenCount;
+    }
+
+    void Engine::restore(const Snapshot &snapshot) {
+        assert(snapshot.devices.size() == devices.size() && snapshot.queues.size() == queues.size() &&
+               snapshot.storages.size() == storages.size());
+        _time = snapshot.time;
+        statisticsStart = snapshot.statisticsStart;
+        nextSeq = snapshot.nextSeq;
+        seed = snapshot.seed;
+        replication = snapshot.replication;
+
+        events->clear();
+        for (size_t i = 0; i < snapshot.events.size(); ++i) {
+            events->push(snapshot.events[i]);
+        }
+        pendingEvents = snapshot.pendingEvents;
+        freeSlots = snapshot.freeSlots;
+        transactEvents = snapshot.transactEvents;
+        pendingCount = snapshot.pendingCount;
+        cancelledCount = snapshot.cancelledCount;
+
+        for (size_t i = 0; i < devices.size(); ++i) {
+            const Snapshot::DeviceState &d = snapshot.devices[i];
+            devices[i]->currentTransactId = d.currentTransactId;
+            devices[i]->lastTimeUsed = d.lastTimeUsed;
+            devices[i]->transactCount = d.transactCount;
+            devices[i]->timeUsedSum = d.timeUsedSum;
+        }
+
+        for (size_t i = 0; i < storages.size(); ++i) {
+            const Snapshot::StorageState &st = snapshot.storages[i];
+            assert(st.holders.size() == storages[i]->capacity);
+            storages[i]->used = st.used;
+            storages[i]->maxUsed = st.maxUsed;
+            storages[i]->requestCount = st.requestCount;
+            storages[i]->unitCount = st.unitCount;
+            storages[i]->timeUsedSum = st.timeUsedSum;
+            storages[i]->lastTimeChanged = st.lastTimeChanged;
+            storages[i]->freeUnits = st.freeUnits;
+            storages[i]->holders = st.holders;
+        }
+
+        for (size_t i = 0; i < queues.size(); ++i) {
+            const Snapshot::QueueState &q = snapshot.queues[i];
+            queues[i]->maxLength = q.maxLength;
+            queues[i]->timeQueueSum = q.timeQueueSum;
+            queues[i]->waitTimeSum = q.waitTimeSum;
+            queues[i]->waitTimeSumSquared = q.waitTimeSumSquared;
+            queues[i]->lastTimeChanged = q.lastTimeChanged;
+            queues[i]->count = q.count;
+            queues[i]->queue->clear();
+            queues[i]->queue->assign(q.items);
+        }
+
+        // Элементы присваиваются на месте: ссылки на потоки (например, в VariateBuffer) остаются действительными
+        while (streams.size() > snapshot.streams.size())
+            streams.pop_back();
+        for (size_t i = 0; i < snapshot.streams.size(); ++i) {
+            if (i < streams.size()) {
+                streams[i] = snapshot.streams[i];
+            } else {
+                streams.push_back(snapshot.streams[i]);
+            }
+        }
+        streamIds = snapshot.streamIds;
+        antithetic = snapshot.antithetic;
+        variables.assign(snapshot.variables.begin(), snapshot.variables.end());
+        variableNames = snapshot.variableNames;
+        variableIds.clear();
+        for (size_t i = 0; i < variableNames.size(); ++i) {
+            variableIds[variableNames[i]] = (uint)i;
+        }
+        transacts = snapshot.transacts;
+        waiters = snapshot.waiters;
+        freeWaiters = snapshot.freeWaiters;
+        for (int i = 0; i < WaitSourcesEnd; ++i) {
+            waitIndex[i] = snapshot.waitIndex[i];
+        }
+        transactWaiters = snapshot.transactWaiters;
+        waitingCount = snapshot.waitingCount;
+        wokenCount = snapshot.wokenCount;
+    }
+
+    void Engine::setOutputStream(std::ostream *outputStream) {
+        outs = outputStream;
     }
 
     void Engine::createDevice(std::string name) {
-        Device * d = new Device(name, this);
+        Device * d = arena.create<Device>(name, this);
         devices.push_back(d);
     }
 
-    void Engine::createQueue(std::string name) {
-        Queue * q = new Queue(name, this);
+    void Engine::createStorage(const std::string &name, uint capacity) {
+        Storage * st = arena.create<Storage>(name, this, capacity);
+        storages.push_back(st);
+    }
+
+    void Engine::createQueue(std::string name, QueueDiscipline discipline, uint priorities) {
+        Queue * q = arena.create<Queue>(name, this, discipline, priorities);
         queues.push_back(q);
     }
 
-    void Engine::schedule(u64 eventId, time_t time, transact_t transactId) {
+    uint Engine::createVariable(const std::string &name, double value) {
+        std::map<std::string, uint>::iterator it = variableIds.find(name);
+        uint id;
+        if (it != variableIds.end()) {
+            id = it->second;
+        } else {
+            id = (uint)variables.size();
+            variables.push_back(TimeVariable());
+            variableNames.push_back(name);
+            variableIds[name] = id;
+        }
+        variables[id].reset(_time, value);
+        return id;
+    }
+
+    uint Engine::variableId(const std::string &name) {
+        std::map<std::string, uint>::iterator it = variableIds.find(name);
+        assert(it != variableIds.end());
+        return it->second;
+    }
+
+    const TimeVariable &Engine::variable(uint id) {
+        assert(id < variables.size());
+        variables[id].accumulate(_time);
+        return variables[id];
+    }
+
+    uint Engine::allocSlot() {
+        if (freeSlots.empty()) {
+            PendingEvent p;
+            p.generation = 1;
+            p.state = PendingFree;
+            pendingEvents.push_back(p);
+            return (uint)pendingEvents.size() - 1;
+        }
+        uint slot = freeSlots.back();
+        freeSlots.pop_back();
+        return slot;
+    }
+
+    void Engine::freeSlot(uint slot) {
+        PendingEvent &p = pendingEvents[slot];
+        p.state = PendingFree;
+        if (++p.generation == 0)
+            p.generation = 1;
+        freeSlots.push_back(slot);
+    }
+
+    void Engine::linkTransact(uint slot) {
+        PendingEvent &p = pendingEvents[slot];
+        std::pair<std::unordered_map<transact_t, uint>::iterator, bool> it =
+                transactEvents.insert(std::make_pair(p.transactId, slot));
+        p.prev = NoSlot;
+        p.next = it.second ? NoSlot : it.first->second;
+        if (!it.second) {
+            pendingEvents[p.next].prev = slot;
+            it.first->second = slot;
+        }
+    }
+
+    void Engine::unlinkTransact(uint slot) {
+        PendingEvent &p = pendingEvents[slot];
+        if (p.next != NoSlot)
+            pendingEvents[p.next].prev = p.prev;
+        if (p.prev != NoSlot) {
+            pendingEvents[p.prev].next = p.next;
+        } else if (p.next != NoSlot) {
+            transactEvents[p.transactId] = p.next;
+        } else {
+            transactEvents.erase(p.transactId);
+        }
+    }
+
+    void Engine::compactEvents() {
+        std::vector<Event> list;
+        list.reserve(events->size());
+        events->collect(list);
+        events->clear();
+        for (size_t i = 0; i < list.size(); ++i) {
+            if (pendingEvents[list[i].slot].state == PendingCancelled) {
+                freeSlot(list[i].slot);
+            } else {
+                events->push(list[i]);
+            }
+        }
+        cancelledCount = 0;
+    }
+
+    void Engine::cancelSlot(uint slot) {
+        PendingEvent &p = pendingEvents[slot];
+        assert(p.state == PendingScheduled);
+        if (trace != NULL)
+            trace->record(TraceCancel, _time, slot, p.eventId, (u64)p.time, p.transactId);
+        p.state = PendingCancelled;
+        // Отмененное пробуждение больше не закрывает входы ожидания для других исключительных ожиданий
+        Condition condition;
+        if (p.waiter != NoSlot) {
+            if (waitingCount != 0)
+                condition = waiters[p.waiter].condition;
+            releaseWaiter(p.waiter);
+        }
+        unlinkTransact(slot);
+        pendingCount--;
+        cancelledCount++;
+        if (cancelledCount > 64 && cancelledCount > pendingCount)
+            compactEvents();
+        wakeInputs(condition);
+    }
+
+    event_handle_t Engine::schedule(u64 eventId, time_t time, transact_t transactId) {
         assert(time >= 0);
         Event e;
         e.eventId = eventId;
         e.time = _time + time;
         e.transactId = transactId;
-        events.insert(e);
+        e.seq = nextSeq++;
+        e.slot = allocSlot();
+
+        PendingEvent &p = pendingEvents[e.slot];
+        p.time = e.time;
+        p.eventId = eventId;
+        p.transactId = transactId;
+        p.seq = e.seq;
+        p.state = PendingScheduled;
+        p.waiter = NoSlot;
+        linkTransact(e.slot);
+        pendingCount++;
+        SMPL_PROFILE(profile.eventListSize(pendingCount));
+        if (trace != NULL)
+            trace->record(TraceSchedule, _time, e.slot, eventId, (u64)e.time, transactId);
+
+        events->push(e);
+        return ((event_handle_t)p.generation << 32) | e.slot;
     }
 
     std::pair<u64, transact_t> Engine::cause() {
-        if (!events.size())
-            assert(events.size() > 0);
+        while (true) {
+            // Не остается событий, только если все поглощенные были нарушенными пробуждениями
+            assert(pendingCount > 0);
+            Event e = events->pop();
+            if (pendingEvents[e.slot].state == PendingCancelled) {
+                cancelledCount--;
+                freeSlot(e.slot);
+                continue;
+            }
+            uint waiter = pendingEvents[e.slot].waiter;
+            if (waiter != NoSlot && !holds(waiters[waiter].condition, waiters[waiter].transactId)) {
+                blockAgain(e, waiter);
+                continue;
+            }
+            unlinkTransact(e.slot);
+            freeSlot(e.slot);
+            pendingCount--;
+            _time = e.time;
+            SMPL_PROFILE(profile.countEvent(e.eventId));
+            if (trace != NULL)
+                trace->record(TraceCause, _time, e.slot, e.eventId, 0, e.transactId);
+            if (waiter != NoSlot) {
+                // Пока событие не наступило, ожидание закрывало свои входы для других исключительных ожиданий
+                Condition condition = waitingCount != 0 ? waiters[waiter].condition : Condition();
+                releaseWaiter(waiter);
+                wakeInputs(condition);
+            }
+            return std::make_pair(e.eventId, e.transactId);
+        }
+    }
 
-        Event e = *events.begin();
-        events.erase(events.begin());
-        _time = e.time;
-        return std::make_pair(e.eventId, e.transactId);
+    void Engine::blockAgain(const Event &e, uint waiter) {
+        // Условие исключительного ожидания нарушено после пробуждения: транзакт снова ждет
+        if (trace != NULL)
+            trace->record(TraceCancel, _time, e.slot, e.eventId, (u64)e.time, e.transactId);
+        Waiter &w = waiters[waiter];
+        w.state = WaiterBlocked;
+        w.slot = NoSlot;
+        waitingCount++;
+        wokenCount--;
+        unlinkTransact(e.slot);
+        freeSlot(e.slot);
+        pendingCount--;
+        // Входы, закрытые пробуждением, пока другие ожидания по ним не проверялись
+        wakeInputs(w.condition);
     }
 
-    time_t Engine::cancel(u64 eventId, transact_t transactId) {
-        Event e;
-        bool found = false;
-        for (std::multiset<Event>::iterator it = events.begin(); it != events.end(); it++) {
-            e = *it;
-            if (e.transactId == transactId || e.eventId == eventId) {
-                found = true;
-                events.erase(it);
-                break;
+    void Engine::dropBrokenWakes() {
+        while (pendingCount != 0) {
+            Event e = events->pop();
+            if (pendingEvents[e.slot].state == PendingCancelled) {
+                cancelledCount--;
+                freeSlot(e.slot);
+                continue;
             }
+            uint waiter = pendingEvents[e.slot].waiter;
+            if (waiter != NoSlot && !holds(waiters[waiter].condition, waiters[waiter].transactId)) {
+                blockAgain(e, waiter);
+                continue;
+            }
+            events->push(e);
+            return;
+        }
+    }
+
+    time_t Engine::cancel(u64 eventId, transact_t transactId) {
+        uint found = NoSlot;
+        std::unordered_map<transact_t, uint>::iterator it = transactEvents.find(transactId);
+        for (uint slot = it != transactEvents.end() ? it->second : NoSlot; slot != NoSlot;
+                slot = pendingEvents[slot].next) {
+            PendingEvent &p = pendingEvents[slot];
+            if (p.eventId == eventId && (found == NoSlot || p.time < pendingEvents[found].time ||
+                    (p.time == pendingEvents[found].time && p.seq < pendingEvents[found].seq)))
+                found = slot;
         }
-        assert(found);
+        assert(found != NoSlot);
 
-        time_t res = e.time - _time;
+        time_t res = pendingEvents[found].time - _time;
+        cancelSlot(found);
         return res;
     }
 
+    time_t Engine::cancel(event_handle_t handle) {
+        assert(isPending(handle));
+        uint slot = (uint)(handle & 0xffffffffu);
+
+        time_t res = pendingEvents[slot].time - _time;
+        cancelSlot(slot);
+        return res;
+    }
+
+    size_t Engine::cancelTransact(transact_t transactId) {
+        std::unordered_map<transact_t, uint>::iterator it = transactEvents.find(transactId);
+        if (it == transactEvents.end())
+            return 0;
+
+        size_t res = 0;
+        uint slot = it->second;
+        while (slot != NoSlot) {
+            uint next = pendingEvents[slot].next;
+            cancelSlot(slot);
+            slot = next;
+            res++;
+        }
+        return res;
+    }
+
+    bool Engine::isPending(event_handle_t handle) {
+        uint slot = (uint)(handle & 0xffffffffu);
+        uint generation = (uint)(handle >> 32);
+        return slot < pendingEvents.size() && pendingEvents[slot].generation == generation &&
+               pendingEvents[slot].state == PendingScheduled;
+    }
+
+    size_t Engine::eventsCount() {
+        // Пока есть другие события, cause вернет хотя бы одно из них
+        if (pendingCount != 0 && pendingCount <= wokenCount)
+            dropBrokenWakes();
+        return pendingCount;
+    }
+
+    double Engine::sourceValue(WaitSource source, uint index) {
+        switch (source) {
+            case WaitDevice:
+                assert(index < devices.size());
+                return devices[index]->currentTransactId != 0 ? 1 : 0;
+            case WaitQueue:
+                assert(index < queues.size());
+                return (double)queues[index]->length();
+            case WaitStorage:
+                assert(index < storages.size());
+                return storages[index]->available();
+            case WaitVariable:
+                assert(index < variables.size());
+                return variables[index].value;
+            default:
+                assert(source < WaitSourcesEnd);
+                return 0;
+        }
+    }
+
+    bool Engine::holds(const Condition &condition, transact_t transactId) {
+        for (size_t i = 0; i < condition.terms.size(); ++i) {
+            const Condition::Term &t = condition.terms[i];
+            if (!Condition::compare(sourceValue(t.source, t.index), t.compare, t.value))
+                return false;
+        }
+        return condition.predicate == NULL || condition.predicate(this, transactId);
+    }
+
+    void Engine::addDependency(WaitSource source, uint index, uint waiter) {
+        std::vector<WaitList> &lists = waitIndex[source];
+        if (index >= lists.size())
+            lists.resize(index + 1);
+        WaitList &list = lists[index];
+        // Ссылки ожидающих, разбуженных через другие входы, иначе копились бы в редко меняющемся списке
+        if (list.stale > 16 && list.stale * 2 > list.refs.size())
+            compactWaitList(list);
+        // Несколько сравнений с одной величиной дают одну ссылку
+        if (!list.refs.empty() && list.refs.back().waiter == waiter &&
+                list.refs.back().generation == waiters[waiter].generation)
+            return;
+        WaitRef r = {waiter, waiters[waiter].generation};
+        list.refs.push_back(r);
+    }
+
+    void Engine::compactWaitList(WaitList &list) {
+        size_t kept = 0;
+        for (size_t i = 0; i < list.refs.size(); ++i) {
+            const Waiter &w = waiters[list.refs[i].waiter];
+            if (w.state != WaiterFree && w.generation == list.refs[i].generation)
+                list.refs[kept++] = list.refs[i];
+        }
+        list.refs.resize(kept);
+        list.stale = 0;
+    }
+
+    void Engine::releaseWaiter(uint waiter) {
+        Waiter &w = waiters[waiter];
+        if (w.state == WaiterBlocked)
+            waitingCount--;
+        if (w.state == WaiterWoken) {
+            pendingEvents[w.slot].waiter = NoSlot;
+            wokenCount--;
+        }
+
+        if (w.next != NoSlot)
+            waiters[w.next].prev = w.prev;
+        if (w.prev != NoSlot) {
+            waiters[w.prev].next = w.next;
+        } else if (w.next != NoSlot) {
+            transactWaiters[w.transactId] = w.next;
+        } else {
+            transactWaiters.erase(w.transactId);
+        }
+
+        for (size_t i = 0; i < w.condition.terms.size(); ++i) {
+            waitIndex[w.condition.terms[i].source][w.condition.terms[i].index].stale++;
+        }
+        for (size_t i = 0; i < w.condition.inputs.size(); ++i) {
+            waitIndex[w.condition.inputs[i].first][w.condition.inputs[i].second].stale++;
+        }
+        w.state = WaiterFree;
+        w.generation++;
+        w.condition = Condition();
+        freeWaiters.push_back(waiter);
+    }
+
+    void Engine::clearWaiters() {
+        waiters.clear();
+        freeWaiters.clear();
+        for (int i = 0; i < WaitSourcesEnd; ++i) {
+            waitIndex[i].clear();
+        }
+        transactWaiters.clear();
+        waitingCount = wokenCount = 0;
+    }
+
+    void Engine::waitUntil(const Condition &condition, u64 eventId, transact_t transactId, bool exclusive) {
+        assert(!condition.terms.empty() || !condition.inputs.empty());
+        if (holds(condition, transactId)) {
+            schedule(eventId, 0, transactId);
+            return;
+        }
+
+        uint waiter;
+        if (freeWaiters.empty()) {
+            waiters.push_back(Waiter());
+            waiter = (uint)waiters.size() - 1;
+            waiters[waiter].generation = 0;
+        } else {
+            waiter = freeWaiters.back();
+            freeWaiters.pop_back();
+        }
+        Waiter &w = waiters[waiter];
+        w.condition = condition;
+        w.eventId = eventId;
+        w.transactId = transactId;
+        w.exclusive = exclusive;
+        w.state = WaiterBlocked;
+        w.slot = NoSlot;
+        waitingCount++;
+
+        std::pair<std::unordered_map<transact_t, uint>::iterator, bool> it =
+                transactWaiters.insert(std::make_pair(transactId, waiter));
+        w.prev = NoSlot;
+        w.next = it.second ? NoSlot : it.first->second;
+        if (!it.second) {
+            waiters[w.next].prev = waiter;
+            it.first->second = waiter;
+        }
+
+        for (size_t i = 0; i < condition.terms.size(); ++i) {
+            addDependency(condition.terms[i].source, condition.terms[i].index, waiter);
+        }
+        for (size_t i = 0; i < condition.inputs.size(); ++i) {
+            addDependency(condition.inputs[i].first, condition.inputs[i].second, waiter);
+        }
+    }
+
+    size_t Engine::cancelWait(transact_t transactId) {
+        std::unordered_map<transact_t, uint>::iterator it = transactWaiters.find(transactId);
+        if (it == transactWaiters.end())
+            return 0;
+
+        size_t res = 0;
+        uint waiter = it->second;
+        while (waiter != NoSlot) {
+            uint next = waiters[waiter].next;
+            releaseWaiter(waiter);
+            waiter = next;
+            res++;
+        }
+        return res;
+    }
+
+    void Engine::wakeWaiters(WaitSource source, uint index) {
+        if (index >= waitIndex[source].size())
+            return;
+        std::vector<WaitRef> &list = waitIndex[source][index].refs;
+        size_t kept = 0;
+        bool stop = false;
+        for (size_t i = 0; i < list.size(); ++i) {
+            WaitRef r = list[i];
+            Waiter &w = waiters[r.waiter];
+            if (w.state == WaiterFree || w.generation != r.generation)
+                continue;
+            if (w.state == WaiterWoken) {
+                // Ресурс обещан транзакту, чье событие еще не наступило
+                stop = stop || w.exclusive;
+            } else if (!stop && holds(w.condition, w.transactId)) {
+                // Пробуждение - событие на текущий момент: обработчик выполняется в общем порядке событий
+                event_handle_t handle = schedule(w.eventId, 0, w.transactId);
+                if (!w.exclusive) {
+                    releaseWaiter(r.waiter);
+                    continue;
+                }
+                // Исключительное ожидание остается на месте до наступления события (Engine::cause)
+                w.state = WaiterWoken;
+                w.slot = (uint)(handle & 0xffffffffu);
+                pendingEvents[w.slot].waiter = r.waiter;
+                waitingCount--;
+                wokenCount++;
+                stop = true;
+            }
+            list[kept++] = r;
+        }
+        list.resize(kept);
+        waitIndex[source][index].stale = 0;
+    }
+
+    void Engine::wakeInputs(const Condition &condition) {
+        for (size_t i = 0; i < condition.terms.size() && waitingCount != 0; ++i) {
+            wakeWaiters(condition.terms[i].source, condition.terms[i].index);
+        }
+        for (size_t i = 0; i < condition.inputs.size() && waitingCount != 0; ++i) {
+            wakeWaiters(condition.inputs[i].first, condition.inputs[i].second);
+        }
+    }
+
+    time_t Engine::nextTime() {
+        assert(pendingCount > 0);
+        while (true) {
+            Event e = events->pop();
+            if (pendingEvents[e.slot].state == PendingCancelled) {
+                cancelledCount--;
+                freeSlot(e.slot);
+                continue;
+            }
+            // Запись таблицы событий не освобождается: дескриптор остается действительным
+            events->push(e);
+            return e.time;
+        }
+    }
+
+    void Engine::advance(time_t time) {
+        assert(time >= _time);
+        // nextTime вызывается и без проверок: он удаляет отмененные события из начала списка
+        if (pendingCount != 0) {
+            time_t next = nextTime();
+            assert(next >= time);
+            (void)next;
+        }
+        _time = time;
+    }
+
     time_t Engine::getTime() {
         return _time;
     }
 
-    void Engine::printEventsState() {
-        std::vector< std::vector<std::string> > table(1);
-        table[0].push_back("Время события");
-        table[0].push_back("Номер события");
-        table[0].push_back("Номер транзакта");
-        table.resize(events.size() + 1);
+    void Engine::resetStatistics() {
+        for (size_t i = 0; i < devices.size(); ++i) {
+            Device *dev = devices[i];
+            dev->transactCount = 0;
+            dev->timeUsedSum = 0;
+            // Занятость до сброса не учитывается
+            if (dev->currentTransactId != 0)
+                dev->lastTimeUsed = _time;
+        }
+        for (size_t i = 0; i < storages.size(); ++i) {
+            Storage *st = storages[i];
+            st->requestCount = 0;
+            st->unitCount = 0;
+            st->timeUsedSum = 0;
+            st->maxUsed = st->used;
+            st->lastTimeChanged = _time;
+        }
+        for (size_t i = 0; i < queues.size(); ++i) {
+            Queue *q = queues[i];
+            q->timeQueueSum = 0;
+            q->waitTimeSum = 0;
+            q->waitTimeSumSquared = 0;
+            q->count = 0;
+            SMPL_PROFILE(profile.queueLength(i, q->maxLength));
+            q->maxLength = q->length();
+            q->lastTimeChanged = _time;
+        }
+        for (size_t i = 0; i < variables.size(); ++i) {
+            variables[i].reset(_time, variables[i].value);
+        }
+        transacts.resetStatistics();
+        statisticsStart = _time;
+    }
 
-        int i = 1;
-        for (std::multiset<Event>::iterator it = events.begin(); it != events.end(); it++) {
-            Event e = *it;
-            table[i].push_back(toString(e.time));
-            table[i].push_back(toString(e.eventId));
-            table[i].push_back(toString(e.transactId));
-            i++;
+#ifdef SMPL_INSTRUMENT
+    Profile &Engine::getProfile() {
+        // Длины очередей отслеживает сама очередь (maxLength), в профиль они переносятся при обращении
+        for (size_t i = 0; i < queues.size(); ++i) {
+            profile.queueLength(i, queues[i]->maxLength);
         }
+        return profile;
+    }
+#endif
+
+    time_t Engine::getStatisticsTime() {
+        return _time - statisticsStart;
+    }
+
+    void Engine::printEventsState() {
+        std::vector<Event> list;
+        list.reserve(events->size());
+        events->collect(list);
+        size_t scheduled = 0;
+        for (size_t i = 0; i < list.size(); i++) {
+            if (pendingEvents[list[i].slot].state == PendingScheduled)
+                list[scheduled++] = list[i];
+        }
+        list.resize(scheduled);
+        std::sort(list.begin(), list.end());
 
         *outs << "Список событий:\n";
-        *outs << printTable(table);
+        OutputBuffer out(*outs);
+        writeTable(out, 3, list.size() + 1, [&list](size_t i, TableRow &row) {
+            if (i == 0) {
+                row[0] = "Время события";
+                row[1] = "Номер события";
+                row[2] = "Номер транзакта";
+                return;
+            }
+            const Event &e = list[i - 1];
+            row.set(0, e.time);
+            row.set(1, e.eventId);
+            row.set(2, e.transactId);
+        });
     }
 
     void Engine::printQueuesState() {
-        std::vector< std::vector<std::string> > table(1);
-        table[0].push_back("Приоритет");
-        table[0].push_back("Время поступл.");
-        table[0].push_back("Номер транзакта");
-
+        // Строка таблицы: заголовок очереди (item == NULL) или элемент очереди
+        struct Line {
+            const Queue *queue;
+            size_t item;
+        };
+        std::vector<QueueItem> items;
+        std::vector<Line> lines;
         for (size_t i = 0; i < queues.size(); ++i) {
-            std::vector<std::string> rowQ(3, "");
-            rowQ[0] = "Очередь:"; rowQ[1] = queues[i]->name;
-            table.push_back(rowQ);
-
-            std::multiset<QueueItem> container = queues[i]->queue;
-
-            for (std::multiset<QueueItem>::iterator it = container.begin(); it != container.end(); it++) {
-                QueueItem item = *it;
-                std::vector<std::string> row(3);
-                row[0] = toString(item.priority);
-                row[1] = toString(item.time);
-                row[2] = toString(item.transactId);
+            Line header = {queues[i], (size_t)-1};
+            lines.push_back(header);
+            size_t first = items.size();
+            queues[i]->queue->collect(items);
+            for (size_t k = first; k < items.size(); k++) {
+                Line line = {queues[i], k};
+                lines.push_back(line);
             }
         }
 
         *outs << "Список очередей:\n";
-        *outs << printTable(table);
+        OutputBuffer out(*outs);
+        writeTable(out, 3, lines.size() + 1, [&lines, &items](size_t i, TableRow &row) {
+            if (i == 0) {
+                row[0] = "Приоритет";
+                row[1] = "Время поступл.";
+                row[2] = "Номер транзакта";
+                return;
+            }
+            const Line &line = lines[i - 1];
+            if (line.item == (size_t)-1) {
+                row[0] = "Очередь:";
+                row[1] = line.queue->name;
+                return;
+            }
+            const QueueItem &item = items[line.item];
+            row.set(0, item.priority);
+            row.set(1, item.time);
+            row.set(2, item.transactId);
+        });
     }
 
     void Engine::printDevicesState() {
-        std::vector< std::vector<std::string> > table(1);
-        table[0].push_back("Имя устройства");
-        table[0].push_back("Номер транзакта");
-        table.resize(devices.size() + 1);
-
-        for (size_t i = 0; i < devices.size(); ++i) {
-            Device * dev = devices[i];
-            table[i+1].push_back(toString(dev->name));
-            table[i+1].push_back(toString(dev->currentTransactId));
-        }
-
         *outs << "Список устройств:\n";
-        *outs << printTable(table);
+        OutputBuffer out(*outs);
+        writeTable(out, 2, devices.size() + 1, [this](size_t i, TableRow &row) {
+            if (i == 0) {
+                row[0] = "Имя устройства";
+                row[1] = "Номер транзакта";
+                return;
+            }
+            const Device *dev = devices[i - 1];
+            row[0] = dev->name;
+            row.set(1, dev->currentTransactId);
+        });
+        if (storages.empty())
+            return;
+        writeTable(out, 3, storages.size() + 1, [this](size_t i, TableRow &row) {
+            if (i == 0) {
+                row[0] = "Имя накопителя";
+                row[1] = "Занято";
+                row[2] = "Емкость";
+                return;
+            }
+            const Storage *st = storages[i - 1];
+            row[0] = st->name;
+            row.set(1, st->used);
+            row.set(2, st->capacity);
+        });
     }
 
     void Engine::monitor() {
@@ -485,81 +1749,221 @@ namespace smpl
     }
 
     void Engine::reportDevices() {
-        std::vector< std::vector<std::string> > table(1);
-
-        table[0].push_back("Имя устройства");
-        table[0].push_back("Ср.вр.зан.");
-        table[0].push_back("% зан.вр.");
-        table[0].push_back("Кол. запр.");
-        table.resize(devices.size() + 1);
-
-        for (size_t i = 0; i < devices.size(); ++i) {
-            Device * dev = devices[i];
-            table[i+1].push_back(toString(dev->name));
-            table[i+1].push_back(dev->transactCount ?
-                                 toString(dev->timeUsedSum * 1.0 / dev->transactCount) : "-");
-            table[i+1].push_back(_time ?
-                                 toString(dev->timeUsedSum * 1.0 / _time * 100) : "-");
-            table[i+1].push_back(toString(dev->transactCount));
-        }
-
         *outs << "Устройства\n";
-        *outs << printTable(table);
+        OutputBuffer out(*outs);
+        writeTable(out, 4, devices.size() + 1, [this](size_t i, TableRow &row) {
+            if (i == 0) {
+                row[0] = "Имя устройства";
+                row[1] = "Ср.вр.зан.";
+                row[2] = "% зан.вр.";
+                row[3] = "Кол. запр.";
+                return;
+            }
+            Device *dev = devices[i - 1];
+            row[0] = dev->name;
+            if (dev->transactCount) {
+                row.set(1, dev->timeUsedSum * 1.0 / dev->transactCount);
+            } else {
+                row[1] = "-";
+            }
+            if (getStatisticsTime()) {
+                row.set(2, dev->busyTime() * 1.0 / getStatisticsTime() * 100);
+            } else {
+                row[2] = "-";
+            }
+            row.set(3, dev->transactCount);
+        });
+        if (storages.empty())
+            return;
+        writeTable(out, 8, storages.size() + 1, [this](size_t i, TableRow &row) {
+            if (i == 0) {
+                row[0] = "Имя накопителя";
+                row[1] = "Емкость";
+                row[2] = "Ср.содерж.";
+                row[3] = "% зан.";
+                row[4] = "Ср.вр.ед.";
+                row[5] = "Кол. запр.";
+                row[6] = "Занято";
+                row[7] = "Max";
+                return;
+            }
+            Storage *st = storages[i - 1];
+            u64 occupancy = st->occupancyTimeSum();
+            row[0] = st->name;
+            row.set(1, st->capacity);
+            if (getStatisticsTime()) {
+                row.set(2, occupancy * 1.0 / getStatisticsTime());
+                row.set(3, occupancy * 100.0 / getStatisticsTime() / st->capacity);
+            } else {
+                row[2] = row[3] = "-";
+            }
+            if (st->unitCount) {
+                row.set(4, occupancy * 1.0 / st->unitCount);
+            } else {
+                row[4] = "-";
+            }
+            row.set(5, st->requestCount);
+            row.set(6, st->used);
+            row.set(7, st->maxUsed);
+        });
     }
 
     void Engine::reportQueues() {
-        std::vector< std::vector<std::string> > table(1);
-        table[0].push_back("Имя очереди");
-        table[0].push_back("Ср.вр.ожидания.");
-        table[0].push_back("Ср.кв.откл.");
-        table[0].push_back("Max");
-        table[0].push_back("Ср.длина");
-        table[0].push_back("Текущая длина");
-
-        for (size_t i = 0; i < queues.size(); ++i) {
-            std::vector<std::string> row(table[0].size(), "");
-            Queue * q = queues[i];
-
+        *outs << "Очереди:\n";
+        OutputBuffer out(*outs);
+        writeTable(out, 6, queues.size() + 1, [this](size_t i, TableRow &row) {
+            if (i == 0) {
+                row[0] = "Имя очереди";
+                row[1] = "Ср.вр.ожидания.";
+                row[2] = "Ср.кв.откл.";
+                row[3] = "Max";
+                row[4] = "Ср.длина";
+                row[5] = "Текущая длина";
+                return;
+            }
+            Queue *q = queues[i - 1];
             double avgWaitTime = q->count ? q->waitTimeSum *1.0 / q->count : 0;
 
-            row[0] = toString(q->name);
-            row[1] = q->count ? toString(avgWaitTime) : " - ";
-            row[2] = q->count ? toString(sqrt(q->waitTimeSumSquared/q->count - avgWaitTime*avgWaitTime)) : " - ";
-            row[3] = toString(q->maxLength);
-            row[4] = _time ? toString(q->timeQueueSum*1.0/_time) : " - ";
-            row[5] = toString(q->length());
-            table.push_back(row);
-        }
+            row[0] = q->name;
+            if (q->count) {
+                row.set(1, avgWaitTime);
+                row.set(2, sqrt(q->waitTimeSumSquared/q->count - avgWaitTime*avgWaitTime));
+            } else {
+                row[1] = row[2] = " - ";
+            }
+            row.set(3, q->maxLength);
+            if (getStatisticsTime()) {
+                row.set(4, q->lengthTimeSum()*1.0/getStatisticsTime());
+            } else {
+                row[4] = " - ";
+            }
+            row.set(5, q->length());
+        });
+    }
 
-        *outs << "Очереди:\n";
-        *outs << printTable(table);
+    void Engine::reportVariables() {
+        *outs << "Переменные:\n";
+        OutputBuffer out(*outs);
+        time_t duration = getStatisticsTime();
+        writeTable(out, 8, variables.size() + 1, [this, duration](size_t i, TableRow &row) {
+            if (i == 0) {
+                row[0] = "Имя переменной";
+                row[1] = "Значение";
+                row[2] = "Среднее";
+                row[3] = "Ср.полож.";
+                row[4] = "Ср.отриц.";
+                row[5] = "Ср.кв.откл.";
+                row[6] = "Min";
+                row[7] = "Max";
+                return;
+            }
+            const TimeVariable &v = variable((uint)(i - 1));
+            row[0] = variableNames[i - 1];
+            row.set(1, v.value);
+            row.set(2, v.mean(duration));
+            row.set(3, v.positiveMean(duration));
+            row.set(4, v.negativeMean(duration));
+            row.set(5, sqrt(v.variance(duration)));
+            row.set(6, v.min);
+            row.set(7, v.max);
+        });
+    }
+
+    void Engine::reportTransacts() {
+        *outs << "Транзакты:\n";
+        OutputBuffer out(*outs);
+        writeTable(out, 5, 2, [this](size_t i, TableRow &row) {
+            if (i == 0) {
+                row[0] = "Живых";
+                row[1] = "Max";
+                row[2] = "Создано";
+                row[3] = "Удалено";
+                row[4] = "Ср.вр.жизни";
+                return;
+            }
+            row.set(0, transacts.live);
+            row.set(1, transacts.maxLive);
+            row.set(2, transacts.createdCount);
+            row.set(3, transacts.destroyedCount);
+            if (transacts.destroyedCount) {
+                row.set(4, transacts.lifetimeSum * 1.0 / transacts.destroyedCount);
+            } else {
+                row[4] = "-";
+            }
+        });
     }
 
     void Engine::report() {
         *outs << "Время моделирования: " << _time << " тактов\n";
         reportDevices();
         reportQueues();
+        if (!variables.empty())
+            reportVariables();
+        if (transacts.live || transacts.maxLive)
+            reportTransacts();
     }
 
-    uint Engine::iRandom(uint L, uint R) {
-        if (L > R) {
-            std::swap(L, R);
+    void Engine::setSeed(u64 seed, u64 replication) {
+        this->seed = seed;
+        this->replication = replication;
+        for (std::map<std::string, uint>::iterator it = streamIds.begin(); it != streamIds.end(); it++) {
+            streams[it->second] = RandomStream(RandomStream::makeKey(seed, replication, it->first));
+            streams[it->second].setAntithetic(antithetic);
+        }
+    }
+
+    void Engine::setAntithetic(bool antithetic) {
+        this->antithetic = antithetic;
+        for (size_t i = 0; i < streams.size(); i++) {
+            streams[i].setAntithetic(antithetic);
         }
-        return L + rand()%(R-L);
+    }
+
+    void Engine::setSubstream(u64 substream) {
+        for (size_t i = 0; i < streams.size(); i++) {
+            streams[i].setSubstream(substream);
+        }
+    }
+
+    uint Engine::streamId(const std::string &name) {
+        std::map<std::string, uint>::iterator it = streamIds.find(name);
+        if (it != streamIds.end())
+            return it->second;
+        uint id = (uint)streams.size();
+        streams.push_back(RandomStream(RandomStream::makeKey(seed, replication, name)));
+        streams.back().setAntithetic(antithetic);
+        streamIds[name] = id;
+        return id;
+    }
+
+    RandomStream &Engine::stream(const std::string &name) {
+        return streams[streamId(name)];
+    }
+
+    RandomStream &Engine::stream(uint id) {
+        assert(id < streams.size());
+        return streams[id];
+    }
+
+    uint Engine::iRandom(uint L, uint R) {
+        return streams[0].uniformInt(L, R);
     }
 
     double Engine::fRandom() {
-        return rand() * 1.0 / RAND_MAX;
+        return streams[0].uniform();
     }
 
     uint Engine::negExp(uint x) {
-        return (uint) round(-log(1 - fRandom()) * x);
+        return (uint) round(streams[0].exponential(x));
     }
 
     void Device::reserve(transact_t transactId) {
         assert(currentTransactId == 0);
         currentTransactId = transactId;
         lastTimeUsed = engine->getTime();
+        if (engine->getTrace() != NULL)
+            engine->getTrace()->record(TraceReserve, engine->getTime(), index, 0, 0, transactId);
+        engine->notify(WaitDevice, index);
     }
     
     void Device::release() {
@@ -568,7 +1972,69 @@ namespace smpl
         }
         timeUsedSum += engine->getTime() - lastTimeUsed;
         transactCount++;
+        if (engine->getTrace() != NULL)
+            engine->getTrace()->record(TraceRelease, engine->getTime(), index, 0, 0, currentTransactId);
         currentTransactId = 0;
+        engine->notify(WaitDevice, index);
+    }
+
+    time_t Device::busyTime() {
+        return timeUsedSum + (currentTransactId != 0 ? engine->getTime() - lastTimeUsed : 0);
+    }
+
+    void Storage::change(int delta) {
+        time_t now = engine->getTime();
+        timeUsedSum += (u64)(now - lastTimeChanged) * used;
+        lastTimeChanged = now;
+        used += delta;
+        if (used > maxUsed)
+            maxUsed = used;
+        engine->notify(WaitStorage, index);
+    }
+
+    void Storage::enter(uint units) {
+        assert(units > 0 && units <= available());
+        requestCount++;
+        unitCount += units;
+        change((int)units);
+    }
+
+    void Storage::leave(uint units) {
+        // Единицы, занятые acquire, освобождаются только release
+        assert(units <= used - (capacity - (uint)freeUnits.size()));
+        change(-(int)units);
+    }
+
+    uint Storage::acquire(transact_t transactId) {
+        assert(available() > 0 && !freeUnits.empty() && transactId != 0);
+        uint unit = freeUnits.back();
+        freeUnits.pop_back();
+        holders[unit] = transactId;
+        requestCount++;
+        unitCount++;
+        change(1);
+        return unit;
+    }
+
+    void Storage::release(uint unit) {
+        assert(unit < capacity && holders[unit] != 0);
+        holders[unit] = 0;
+        freeUnits.push_back(unit);
+        change(-1);
+    }
+
+    u64 Storage::occupancyTimeSum() {
+        return timeUsedSum + (u64)(engine->getTime() - lastTimeChanged) * used;
+    }
+
+    void Storage::clearUnits() {
+        used = 0;
+        freeUnits.resize(capacity);
+        for (uint i = 0; i < capacity; i++) {
+            // Первой выдается единица 0
+            freeUnits[i] = capacity - 1 - i;
+            holders[i] = 0;
+        }
     }
 
     transact_t Device::status() {
@@ -577,29 +2043,38 @@ namespace smpl
 
     void Queue::enqueue(transact_t transactId, u64 priority, u64 stage) {
         // TODO: check if transact already in queue
-        queue.insert(QueueItem(engine->getTime(), transactId, priority, stage));
+        queue->push(QueueItem(engine->getTime(), transactId, priority, stage));
 
-        timeQueueSum += (queue.size() - 1) * (engine->getTime() - lastTimeChanged);
-        maxLength = std::max(maxLength, queue.size());
+        timeQueueSum += (queue->size() - 1) * (engine->getTime() - lastTimeChanged);
+        maxLength = std::max(maxLength, queue->size());
         lastTimeChanged = engine->getTime();
+        if (engine->getTrace() != NULL)
+            engine->getTrace()->record(TraceEnqueue, engine->getTime(), index, priority, stage, transactId);
+        engine->notify(WaitQueue, index);
     }
 
     transact_t Queue::head(u64 &stage) {
-        QueueItem qi = *queue.begin();
-        queue.erase(queue.begin());
+        QueueItem qi = queue->pop();
 
-        timeQueueSum += (queue.size() + 1) * (engine->getTime() - lastTimeChanged);
+        timeQueueSum += (queue->size() + 1) * (engine->getTime() - lastTimeChanged);
         waitTimeSum += engine->getTime() - qi.time;
         waitTimeSumSquared += (engine->getTime() - qi.time) * (engine->getTime() - qi.time);
         lastTimeChanged = engine->getTime();
         count++;
 
         stage = qi.stage;
+        if (engine->getTrace() != NULL)
+            engine->getTrace()->record(TraceHead, engine->getTime(), index, 0, stage, qi.transactId);
+        engine->notify(WaitQueue, index);
         return qi.transactId;
     }
 
+    u64 Queue::lengthTimeSum() {
+        return timeQueueSum + (u64)(engine->getTime() - lastTimeChanged) * queue->size();
+    }
+
     size_t Queue::length() {
-        return queue.size();
+        return queue->size();
     }
 }
 
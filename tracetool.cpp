@@ -0,0 +1,378 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <memory>
+#include <tuple>
+#include <algorithm>
+#include <cstdlib>
+#include "Trace.h"
+
+using namespace std;
+using namespace smpl;
+
+// Просмотр, сравнение и воспроизведение двоичных трасс движка (MultiSMPL::setTraceFile, Engine::setTrace).
+// Трасса задается файлом или префиксом: префикс означает все файлы prefix.0, prefix.1, ... потоков
+
+// Непрерывный участок трассы одного прогона
+struct Segment {
+    const TraceReader *reader;
+    size_t begin, end;
+};
+
+struct Trace {
+    vector<unique_ptr<TraceReader>> files;
+    // Прогоны по номерам; номер -1 - записи до первой отметки прогона (начало затерто самописцем)
+    map<long long, vector<Segment>> replications;
+
+    explicit Trace(const string &path) {
+        if (ifstream(path.c_str()).good()) {
+            files.emplace_back(new TraceReader(path));
+        } else {
+            for (int i = 0; ifstream((path + "." + to_string(i)).c_str()).good(); i++) {
+                files.emplace_back(new TraceReader(path + "." + to_string(i)));
+            }
+        }
+        if (files.empty())
+            throw runtime_error("Трасса " + path + " не найдена");
+
+        for (size_t f = 0; f < files.size(); f++) {
+            const TraceReader &r = *files[f];
+            long long number = -1;
+            size_t begin = 0;
+            for (size_t i = 0; i <= r.length(); i++) {
+                if (i < r.length() && r[i].kind != TraceReplication)
+                    continue;
+                if (i > begin)
+                    replications[number].push_back(Segment{&r, begin, i});
+                if (i < r.length())
+                    number = (long long)r[i].a;
+                begin = i;
+            }
+        }
+    }
+
+    // Записи прогона в порядке записи
+    vector<const TraceRecord *> replication(long long number) const {
+        vector<const TraceRecord *> result;
+        map<long long, vector<Segment>>::const_iterator it = replications.find(number);
+        if (it == replications.end())
+            return result;
+        for (size_t s = 0; s < it->second.size(); s++) {
+            const Segment &segment = it->second[s];
+            for (size_t i = segment.begin; i < segment.end; i++) {
+                result.push_back(&(*segment.reader)[i]);
+            }
+        }
+        return result;
+    }
+};
+
+void print(ostream &out, size_t index, const TraceRecord &r) {
+    out << index << "\tt=" << r.time << '\t' << TraceReader::kindName(r.kind);
+    switch (r.kind) {
+        case TraceReplication:
+            out << " номер=" << r.a << " поток_чисел=" << r.b << " поток=" << r.object;
+            break;
+        case TraceSchedule:
+        case TraceCancel:
+            out << " событие=" << r.a << " на=" << (long long)r.b << " запись=" << r.object << " транзакт=" << r.transactId;
+            break;
+        case TraceCause:
+            out << " событие=" << r.a << " запись=" << r.object << " транзакт=" << r.transactId;
+            break;
+        case TraceReserve:
+        case TraceRelease:
+            out << " устройство=" << r.object << " транзакт=" << r.transactId;
+            break;
+        case TraceEnqueue:
+            out << " очередь=" << r.object << " приоритет=" << r.a << " стадия=" << r.b << " транзакт=" << r.transactId;
+            break;
+        case TraceHead:
+            out << " очередь=" << r.object << " стадия=" << r.b << " транзакт=" << r.transactId;
+            break;
+        default:
+            out << " объект=" << r.object << " a=" << r.a << " b=" << r.b << " транзакт=" << r.transactId;
+    }
+    out << endl;
+}
+
+// Совпадение записей; поток, выполнявший прогон, не влияет на результат и не сравнивается
+bool same(const TraceRecord &a, const TraceRecord &b) {
+    if (a.kind == TraceReplication && b.kind == TraceReplication) {
+        TraceRecord c = b;
+        c.object = a.object;
+        return a == c;
+    }
+    return a == b;
+}
+
+struct Options {
+    vector<string> files;
+    long long replication;
+    bool hasReplication;
+    int kind;
+    long long object, transact, from, to, at;
+    size_t context;
+
+    Options() : replication(0), hasReplication(false), kind(0), object(-1), transact(-1), from(-1), to(-1), at(-1),
+            context(5) {}
+};
+
+int kindByName(const string &name) {
+    for (uint k = TraceReplication; k < TraceKindsEnd; k++) {
+        if (name == TraceReader::kindName(k))
+            return (int)k;
+    }
+    throw runtime_error("Неизвестный тип записи " + name);
+}
+
+Options parse(int argc, char **argv) {
+    Options o;
+    for (int i = 2; i < argc; i++) {
+        string arg = argv[i];
+        bool value = i + 1 < argc;
+        if (arg == "--replication" && value) {
+            o.replication = atoll(argv[++i]);
+            o.hasReplication = true;
+        } else if (arg == "--kind" && value) {
+            o.kind = kindByName(argv[++i]);
+        } else if (arg == "--object" && value) {
+            o.object = atoll(argv[++i]);
+        } else if (arg == "--transact" && value) {
+            o.transact = atoll(argv[++i]);
+        } else if (arg == "--from" && value) {
+            o.from = atoll(argv[++i]);
+        } else if (arg == "--to" && value) {
+            o.to = atoll(argv[++i]);
+        } else if (arg == "--at" && value) {
+            o.at = atoll(argv[++i]);
+        } else if (arg == "--context" && value) {
+            o.context = (size_t)atoll(argv[++i]);
+        } else if (arg.compare(0, 2, "--") == 0) {
+            throw runtime_error("Неизвестный параметр " + arg);
+        } else {
+            o.files.push_back(arg);
+        }
+    }
+    return o;
+}
+
+bool selected(const Options &o, const TraceRecord &r) {
+    return (o.kind == 0 || (int)r.kind == o.kind) && (o.object < 0 || r.object == (u64)o.object) &&
+           (o.transact < 0 || r.transactId == (u64)o.transact) && (o.from < 0 || r.time >= o.from) &&
+           (o.to < 0 || r.time <= o.to);
+}
+
+int dump(const Options &o) {
+    Trace trace(o.files.at(0));
+    if (o.hasReplication) {
+        vector<const TraceRecord *> records = trace.replication(o.replication);
+        for (size_t i = 0; i < records.size(); i++) {
+            if (selected(o, *records[i]))
+                print(cout, i, *records[i]);
+        }
+        return 0;
+    }
+    for (size_t f = 0; f < trace.files.size(); f++) {
+        const TraceReader &r = *trace.files[f];
+        if (trace.files.size() > 1)
+            cout << "# файл " << f << ", записей " << r.length() << endl;
+        for (size_t i = 0; i < r.length(); i++) {
+            if (selected(o, r[i]))
+                print(cout, i, r[i]);
+        }
+    }
+    return 0;
+}
+
+// Поиск первого расхождения прогон за прогоном, прогоны сравниваются по номерам независимо от потоков
+int diff(const Options &o) {
+    Trace a(o.files.at(0)), b(o.files.at(1));
+    set<long long> numbers;
+    for (map<long long, vector<Segment>>::const_iterator it = a.replications.begin(); it != a.replications.end(); it++) {
+        numbers.insert(it->first);
+    }
+    for (map<long long, vector<Segment>>::const_iterator it = b.replications.begin(); it != b.replications.end(); it++) {
+        numbers.insert(it->first);
+    }
+    if (o.hasReplication)
+        numbers = set<long long>{o.replication};
+
+    size_t compared = 0;
+    for (set<long long>::const_iterator n = numbers.begin(); n != numbers.end(); n++) {
+        vector<const TraceRecord *> x = a.replication(*n), y = b.replication(*n);
+        size_t i = 0;
+        while (i < x.size() && i < y.size() && same(*x[i], *y[i]))
+            i++;
+        compared += i;
+        if (i == x.size() && i == y.size())
+            continue;
+
+        cout << "Прогон " << *n << ": первое расхождение в записи " << i << " (записей " << x.size() << " и "
+             << y.size() << ")" << endl;
+        size_t start = i > o.context ? i - o.context : 0;
+        cout << "Общее начало:" << endl;
+        for (size_t k = start; k < i; k++) {
+            print(cout, k, *x[k]);
+        }
+        const vector<const TraceRecord *> *sides[2] = {&x, &y};
+        for (int side = 0; side < 2; side++) {
+            cout << o.files[side] << ":" << endl;
+            const vector<const TraceRecord *> &v = *sides[side];
+            for (size_t k = i; k < v.size() && k < i + o.context; k++) {
+                print(cout, k, *v[k]);
+            }
+            if (i >= v.size())
+                cout << "(конец прогона)" << endl;
+        }
+        return 1;
+    }
+    cout << "Трассы совпадают: прогонов " << numbers.size() << ", записей " << compared << endl;
+    return 0;
+}
+
+struct Pending {
+    long long time;
+    u64 eventId, seq, transactId;
+};
+
+// Воспроизведение прогона: восстановление списка событий, занятости устройств и длин очередей
+// и проверка, что каждое наступившее событие - наименьшее из запланированных (время, номер события,
+// порядок планирования). События, запланированные до начала трассы (продолжение после разгона,
+// затертое самописцем начало), проверить нельзя, они только подсчитываются
+int replay(const Options &o) {
+    if (!o.hasReplication)
+        throw runtime_error("Для replay нужен --replication");
+    Trace trace(o.files.at(0));
+    vector<const TraceRecord *> records = trace.replication(o.replication);
+    if (records.empty())
+        throw runtime_error("Прогон " + to_string(o.replication) + " в трассе не найден");
+
+    map<uint, Pending> pending;
+    set<tuple<long long, u64, u64, uint>> order;
+    map<uint, u64> holders;
+    map<uint, long long> lengths;
+    u64 seq = 0, unknown = 0, events = 0;
+    long long time = 0;
+    size_t errors = 0, i = 0;
+
+    for (; i < records.size(); i++) {
+        const TraceRecord &r = *records[i];
+        if (o.at >= 0 && r.time > o.at)
+            break;
+        string error;
+        if (r.time < time)
+            error = "время уменьшилось";
+        time = r.time;
+
+        switch (r.kind) {
+            case TraceSchedule: {
+                if (pending.count(r.object)) {
+                    error = "запись таблицы событий уже занята";
+                    break;
+                }
+                if ((long long)r.b < r.time)
+                    error = "событие запланировано в прошлое";
+                Pending p = {(long long)r.b, r.a, seq++, r.transactId};
+                pending[r.object] = p;
+                order.insert(make_tuple(p.time, p.eventId, p.seq, r.object));
+                break;
+            }
+            case TraceCause: {
+                events++;
+                map<uint, Pending>::iterator it = pending.find(r.object);
+                if (it == pending.end()) {
+                    unknown++;
+                    break;
+                }
+                const Pending &p = it->second;
+                if (p.eventId != r.a || p.transactId != r.transactId || p.time != r.time) {
+                    error = "наступившее событие не совпадает с запланированным";
+                } else if (get<3>(*order.begin()) != r.object) {
+                    error = "наступило не самое раннее событие (ожидалось событие " +
+                            to_string(get<1>(*order.begin())) + " в " + to_string(get<0>(*order.begin())) + ")";
+                }
+                order.erase(make_tuple(p.time, p.eventId, p.seq, r.object));
+                pending.erase(it);
+                break;
+            }
+            case TraceCancel: {
+                map<uint, Pending>::iterator it = pending.find(r.object);
+                if (it == pending.end())
+                    break;
+                order.erase(make_tuple(it->second.time, it->second.eventId, it->second.seq, r.object));
+                pending.erase(it);
+                break;
+            }
+            case TraceReserve:
+                if (holders.count(r.object))
+                    error = "устройство уже занято транзактом " + to_string(holders[r.object]);
+                holders[r.object] = r.transactId;
+                break;
+            case TraceRelease:
+                if (holders.count(r.object) && holders[r.object] != r.transactId)
+                    error = "устройство освобождает не занявший его транзакт";
+                holders.erase(r.object);
+                break;
+            case TraceEnqueue:
+                lengths[r.object]++;
+                break;
+            case TraceHead:
+                lengths[r.object]--;
+                break;
+        }
+        if (!error.empty()) {
+            cout << "Ошибка: " << error << endl;
+            print(cout, i, r);
+            errors++;
+        }
+    }
+
+    cout << "Прогон " << o.replication << ", время " << time << ", записей " << i << ", событий " << events;
+    if (unknown)
+        cout << " (запланированных до начала трассы " << unknown << ")";
+    cout << endl;
+    cout << "Запланированные события (" << order.size() << "):" << endl;
+    for (set<tuple<long long, u64, u64, uint>>::const_iterator it = order.begin(); it != order.end(); it++) {
+        cout << "\tt=" << get<0>(*it) << " событие=" << get<1>(*it) << " транзакт="
+             << pending[get<3>(*it)].transactId << endl;
+    }
+    cout << "Занятые устройства:" << endl;
+    for (map<uint, u64>::const_iterator it = holders.begin(); it != holders.end(); it++) {
+        cout << "\t" << it->first << ": транзакт " << it->second << endl;
+    }
+    // Длина относительно начала трассы: у продолжения после разгона очереди могут быть непусты изначально
+    cout << "Длины очередей:" << endl;
+    for (map<uint, long long>::const_iterator it = lengths.begin(); it != lengths.end(); it++) {
+        cout << "\t" << it->first << ": " << it->second << endl;
+    }
+    if (errors)
+        cout << "Нарушений: " << errors << endl;
+    return errors ? 1 : 0;
+}
+
+int main(int argc, char **argv) {
+    string command = argc > 1 ? argv[1] : "";
+    try {
+        Options o = parse(argc, argv);
+        if (command == "dump" && o.files.size() == 1)
+            return dump(o);
+        if (command == "diff" && o.files.size() == 2)
+            return diff(o);
+        if (command == "replay" && o.files.size() == 1)
+            return replay(o);
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return 2;
+    }
+    cerr << "Использование:" << endl
+         << "  tracetool dump TRACE [--replication N] [--kind K] [--object O] [--transact T] [--from T] [--to T]" << endl
+         << "  tracetool diff A B [--replication N] [--context K]" << endl
+         << "  tracetool replay TRACE --replication N [--at T]" << endl
+         << "TRACE - файл трассы или префикс файлов потоков (prefix.0, prefix.1, ...)" << endl
+         << "K - replication, schedule, cause, cancel, reserve, release, enqueue, head" << endl;
+    return 2;
+}
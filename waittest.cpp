@@ -0,0 +1,125 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include "smpl.h"
+
+using namespace std;
+using namespace smpl;
+
+// Проверка ожиданий waitUntil: программа выводит результат каждого случая
+// и завершается с ненулевым кодом, если хотя бы один не выполнен
+
+static int failures = 0;
+
+static void check(const string &name, bool ok) {
+    cout << name << ';' << (ok ? "ok" : "FAIL") << endl;
+    if (!ok)
+        failures++;
+}
+
+// Все события до опустошения списка; номера транзактов наступивших событий
+static vector<transact_t> drain(Engine &e) {
+    vector<transact_t> caused;
+    while (e.eventsCount() > 0) {
+        caused.push_back(e.cause().second);
+    }
+    return caused;
+}
+
+// Обычное ожидание: пробуждение при выполнении условия, без него - ни одного события
+static void plainWait() {
+    Engine e(nullptr);
+    uint v = e.createVariable("v");
+    e.waitUntil(Condition::variable(v, WaitGreaterEqual, 2), 1, 10);
+    e.setVariable(v, 1);
+    bool asleep = e.eventsCount() == 0 && e.waitingTransacts() == 1;
+    e.setVariable(v, 2);
+    vector<transact_t> caused = drain(e);
+    check("plain wait", asleep && caused.size() == 1 && caused[0] == 10 && e.waitingTransacts() == 0);
+}
+
+// Условие исключительного ожидания нарушено до наступления пробуждения, и других событий нет:
+// пробуждение поглощается, цикл по eventsCount завершается, транзакт продолжает ждать
+static void brokenLastWake() {
+    Engine e(nullptr);
+    uint v = e.createVariable("v");
+    e.waitUntil(Condition::variable(v, WaitGreaterEqual, 5), 1, 10, true);
+    e.setVariable(v, 5);
+    e.setVariable(v, 3);
+    vector<transact_t> caused = drain(e);
+    bool asleep = caused.empty() && e.waitingTransacts() == 1;
+    e.setVariable(v, 6);
+    caused = drain(e);
+    check("broken last wake", asleep && caused.size() == 1 && caused[0] == 10 && e.waitingTransacts() == 0);
+}
+
+// Первое исключительное ожидание закрыло вход, пока его пробуждение не наступило, и было снято
+// нарушением условия; второе, чье условие выполнено, должно проснуться
+static void wakeAfterBrokenWake() {
+    Engine e(nullptr);
+    uint v = e.createVariable("v");
+    e.waitUntil(Condition::variable(v, WaitGreaterEqual, 5), 1, 10, true);
+    e.waitUntil(Condition::variable(v, WaitGreaterEqual, 1), 1, 20, true);
+    e.setVariable(v, 5);
+    e.setVariable(v, 3);
+    vector<transact_t> caused = drain(e);
+    check("wake after broken wake", caused.size() == 1 && caused[0] == 20 && e.waitingTransacts() == 1);
+}
+
+// Наступившее исключительное пробуждение открывает вход: следующий ожидающий с выполненным
+// условием просыпается, даже если обработчик первого ничего не изменил
+static void wakeAfterFiredWake() {
+    Engine e(nullptr);
+    uint v = e.createVariable("v");
+    e.waitUntil(Condition::variable(v, WaitGreaterEqual, 1), 1, 10, true);
+    e.waitUntil(Condition::variable(v, WaitGreaterEqual, 1), 1, 20, true);
+    e.setVariable(v, 1);
+    vector<transact_t> caused = drain(e);
+    check("wake after fired wake", caused.size() == 2 && caused[0] == 10 && caused[1] == 20 &&
+                                   e.waitingTransacts() == 0);
+}
+
+// Захват устройства: обработчик пробужденного занимает устройство, второй ждет его освобождения
+static void exclusiveDevice() {
+    Engine e(nullptr);
+    e.createDevice("d");
+    Device *d = e.getDevices()[0];
+    d->reserve(1);
+    e.waitUntil(Condition::deviceFree(0), 1, 10, true);
+    e.waitUntil(Condition::deviceFree(0), 1, 20, true);
+    e.schedule(2, 5, 1);
+    vector<transact_t> order;
+    while (e.eventsCount() > 0) {
+        pair<u64, transact_t> top = e.cause();
+        if (top.first == 1) {
+            order.push_back(top.second);
+            d->reserve(top.second);
+            e.schedule(2, 5, top.second);
+        } else {
+            d->release();
+        }
+    }
+    check("exclusive device", order.size() == 2 && order[0] == 10 && order[1] == 20 && e.getTime() == 15);
+}
+
+// Отмена запланированного исключительного пробуждения открывает вход для следующего ожидающего
+static void wakeAfterCancelledWake() {
+    Engine e(nullptr);
+    uint v = e.createVariable("v");
+    e.waitUntil(Condition::variable(v, WaitGreaterEqual, 1), 1, 10, true);
+    e.waitUntil(Condition::variable(v, WaitGreaterEqual, 1), 1, 20, true);
+    e.setVariable(v, 1);
+    e.cancelTransact(10);
+    vector<transact_t> caused = drain(e);
+    check("wake after cancelled wake", caused.size() == 1 && caused[0] == 20 && e.waitingTransacts() == 0);
+}
+
+int main() {
+    plainWait();
+    brokenLastWake();
+    wakeAfterBrokenWake();
+    wakeAfterFiredWake();
+    exclusiveDevice();
+    wakeAfterCancelledWake();
+    return failures == 0 ? 0 : 1;
+}